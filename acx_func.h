@@ -40,6 +40,8 @@
  */
 #define CMD_TIMEOUT_MS(n)	(n)
 #define ACX_CMD_TIMEOUT_DEFAULT	CMD_TIMEOUT_MS(50)
+/* busy polling for ENABLE_TX/RX completion before sleeping, us */
+#define ACX_CMD_SPIN_US		200
 
 /* Define ACX_GIT_VERSION with "undef" value, if undefined for some reason */
 #ifndef ACX_GIT_VERSION
@@ -112,7 +114,7 @@
 
 #define log(chan, args...) \
 	do { \
-		if (acx_debug & (chan)) \
+		if (acx_debug_on(chan)) \
 			pr_notice(args);	\
 	} while (0)
 
@@ -43,10 +43,40 @@ enum debug_flags {
 	L_ANY		= 0xffff
 };
 
+/* Channels which are tested per frame or per command. While none of
+ * them is enabled, their checks are patched out via a static key */
+#define L_HOTPATH	(L_IRQ | L_XFER | L_DATA | L_DEBUG | L_CTL | L_BUF \
+			| L_USBRXTX)
+
+#if ACX_DEBUG && LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0)
+#define ACX_DEBUG_STATIC_KEYS 1
+#else
+#define ACX_DEBUG_STATIC_KEYS 0
+#endif
+
 #if ACX_DEBUG
 extern unsigned int acx_debug;
+void acx_debug_update(void);
 #else
 enum { acx_debug = 0 };
+static inline void acx_debug_update(void) { }
+#endif
+
+#if ACX_DEBUG_STATIC_KEYS
+#include <linux/jump_label.h>
+
+DECLARE_STATIC_KEY_FALSE(acx_debug_hot_key);
+DECLARE_STATIC_KEY_FALSE(acx_debug_any_key);
+
+/* chan is a compile-time constant, so only one branch survives */
+#define acx_debug_on(chan) \
+	(((chan) & ~L_HOTPATH) \
+	 ? (static_branch_unlikely(&acx_debug_any_key) \
+	    && (acx_debug & (chan))) \
+	 : (static_branch_unlikely(&acx_debug_hot_key) \
+	    && (acx_debug & (chan))))
+#else
+#define acx_debug_on(chan)	(acx_debug & (chan))
 #endif
 
 /* Operations by writing to acx_diag */
@@ -58,6 +88,8 @@ enum {
 
 extern unsigned int acx_hwcrypto;
 extern unsigned int acx_watchdog_enable;
+extern unsigned int acx_stations;
+extern unsigned int acx_key_offload;
 
 /*
  * BOM Constants
@@ -78,16 +110,29 @@ extern unsigned int acx_watchdog_enable;
 #define DEVTYPE_PCI		0
 #define DEVTYPE_USB		1
 #define DEVTYPE_MEM		2
+#define DEVTYPE_SIM		3	/* software model of a PCI ACX111, see sim.c */
 
 #if !(defined(CONFIG_ACX_MAC80211_PCI) || defined(CONFIG_ACX_MAC80211_USB) || defined(CONFIG_ACX_MAC80211_MEM))
 #error Driver must include PCI and/or USB, MEM support. You selected neither.
 #endif
 
+#if defined(CONFIG_ACX_MAC80211_SIM) && !defined(CONFIG_ACX_MAC80211_PCI)
+#error The simulated device (SIM) needs PCI support.
+#endif
+
+#if defined(CONFIG_ACX_MAC80211_SIM)
+ #define IS_SIM(adev)	((adev)->dev_type == DEVTYPE_SIM)
+#else
+ #define IS_SIM(adev)	0
+#endif
+
+/* The simulated device presents the PCI register, mailbox and DMA
+ * interface, so it takes all the PCI paths as well */
 #if defined(CONFIG_ACX_MAC80211_PCI)
  #if !(defined(CONFIG_ACX_MAC80211_USB) || defined(CONFIG_ACX_MAC80211_MEM))
   #define IS_PCI(adev)	1
  #else
-  #define IS_PCI(adev)	((adev)->dev_type == DEVTYPE_PCI)
+  #define IS_PCI(adev)	((adev)->dev_type == DEVTYPE_PCI || IS_SIM(adev))
  #endif
 #else
  #define IS_PCI(adev)	0
@@ -129,7 +174,8 @@ extern unsigned int acx_watchdog_enable;
 
 /* BOM 'After Interrupt' Commands  */
 #define ACX_AFTER_IRQ_CMD_RADIO_RECALIB	0x01
-#define ACX_AFTER_IRQ_UPDATE_TIM	0x02
+#define ACX_AFTER_IRQ_UPDATE_RX_FILTER	0x04
+#define ACX_AFTER_IRQ_SCAN_NEXT		0x08
 
 /*
  * BOM  Tx/Rx buffer sizes and watermarks
@@ -154,8 +200,36 @@ extern unsigned int acx_watchdog_enable;
 /* we start queue if we have >= N free txbufs: */
 #define TX_START_QUEUE 5
 
+/* byte limit of the frames in a tx ring, see acx_tx_dql_update() */
+#define ACX_TX_DQL_MIN		2400		/* a full frame */
+#define ACX_TX_DQL_INIT		(4 * ACX_TX_DQL_MIN)
+#define ACX_TX_DQL_MAX_US	8000		/* of airtime */
+#define ACX_TX_DQL_HOLD		(HZ / 2)	/* to measure the slack */
+/* preamble, SIFS and ACK of a frame, roughly */
+#define ACX_TX_OVERHEAD_US	100
+
 #define ACX_TX_QUEUE_MAX_LENGTH 20
 
+/* With the intermediate tx queues mac80211 keeps the data frames per
+ * station and TID, under its fq_codel, and we pull them when we have
+ * free tx descs (wake_tx_queue).  tx_queue then only has what still
+ * comes through the tx op, e.g. management frames. */
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(4, 2, 0)
+#define ACX_TXQ 1
+#else
+#define ACX_TXQ 0
+#endif
+
+/* frames pulled from a txq before it's the next one's turn */
+#define ACX_TXQ_QUANTUM 2
+
+/* our part of a mac80211 txq */
+struct acx_txq {
+	struct list_head list;		/* in txq_list, if queued */
+	int		queued;
+	struct ieee80211_txq *txq;
+};
+
 /*
  * BOM Global data
  * ==================================================
@@ -177,7 +251,8 @@ enum acx_flags {
 	ACX_FLAG_FW_LOADED,
 	ACX_FLAG_HW_UP,
 	ACX_FLAG_SCANNING,
-	ACX_FLAG_WATCHDOG_RUNNING
+	ACX_FLAG_WATCHDOG_RUNNING,
+	ACX_FLAG_BENCH		/* sim bench running, see sim.c */
 };
 
 /* MAC mode (BSS type) defines
@@ -220,6 +295,22 @@ struct hw_tx_queue {
 		size_t size;
 		dma_addr_t phy;
 	} bufinfo;
+
+	/* byte queue limit, under lock: the tx status may come in
+	 * atomic context (USB), the tx path runs under the sem */
+	struct {
+		spinlock_t lock;
+		unsigned int inflight;	/* bytes */
+		unsigned int limit;
+		unsigned int completed;	/* since the last update */
+		unsigned int lowest;	/* slack, in this hold period */
+		unsigned int byte_ns;	/* airtime per byte, average */
+		unsigned long slack_start;
+		int limited;		/* frames held back by the limit */
+		unsigned long stops;
+		unsigned long starved;
+		unsigned long shrunk;
+	} dql;
 };
 
 struct hw_rx_queue {
@@ -274,6 +365,269 @@ struct rx_desc_pair {
 	struct desc_info buf;
 };
 
+/* per-rate tx accounting, indexed like the band's bitrates[] */
+#define ACX_TX_RATE_STATS_CNT	12
+struct acx_tx_rate_stat {
+	u32	attempts;
+	u32	success;
+};
+#define ACX_RX_RATE_STATS_CNT	12
+
+/* rx capture buffer, see acx_rx_capture_start() */
+struct acx_rx_capture {
+	int		active;
+	size_t		size;		/* of data[] */
+	size_t		len;		/* used so far */
+	unsigned long	records;
+	unsigned long	dropped;	/* didn't fit anymore */
+	ktime_t		start;
+	u8		data[0];	/* acx_rxcap_rec_t + rxbuffer_t, ... */
+};
+
+/* multicast groups, from prepare_multicast to configure_filter */
+struct acx_mc_list {
+	int		overflow;	/* more than the firmware table holds */
+	unsigned int	count;
+	u8		addr[ACX_GROUP_ADDR_MAX][ETH_ALEN];
+};
+
+/* see acx_update_rx_filter() and acx_rx_filter_account() */
+struct acx_rx_filter_stats {
+	unsigned long	updates;	/* RXCONFIG reprogrammed */
+	unsigned long	unchanged;	/* filter change, same RXCONFIG */
+	/* passed by the firmware, then dropped by mac80211 */
+	unsigned long	sw_control;
+	unsigned long	sw_probe_req;
+	unsigned long	sw_other_bss;
+};
+
+/* firmware statistics sampler, see acx_fw_stats_sample(): the
+ * counters of fw_stats_t from tx on, in that order */
+#define ACX_FW_STATS_WORDS \
+	((offsetof(fw_stats_t, _padding) - offsetof(fw_stats_t, tx)) \
+	 / sizeof(u32))
+#define ACX_FW_STATS_RING	64
+
+struct acx_fw_stats_sample {
+	u32	time_ms;		/* since sampling was started */
+	u32	interval_ms;		/* since the previous sample */
+	u32	delta[ACX_FW_STATS_WORDS];
+};
+
+struct acx_fw_stats_ring {
+	unsigned int	interval;	/* seconds */
+	unsigned long	start;		/* jiffies */
+	unsigned long	last;
+	int		have_prev;
+	u32		prev[ACX_FW_STATS_WORDS];
+	unsigned int	head;		/* next slot to fill */
+	unsigned int	count;
+	struct acx_fw_stats_sample samples[ACX_FW_STATS_RING];
+};
+
+/* per-channel medium usage, see survey.c */
+#define ACX_SURVEY_CHANNELS	14
+#define ACX_SURVEY_HIST		16
+
+struct acx_survey_chan {
+	u64		time_us;	/* sampled while on the channel */
+	u64		busy_us;
+	u32		fcs_errors;
+	u8		hist[ACX_SURVEY_HIST];	/* busy % of recent samples */
+	unsigned int	hist_head;	/* next slot to fill */
+	unsigned int	hist_count;
+};
+
+struct acx_survey {
+	u8		channel;	/* the window below is on */
+	int		have_prev;
+	unsigned long	last;		/* jiffies */
+	u32		prev_busy_us;
+	u32		prev_total_us;
+	u32		prev_fcs;
+	/* the firmware scan over scan_chan, 0: none */
+	u8		scan_chan;
+	unsigned long	scan_start;	/* jiffies */
+	u32		scan_busy_us;
+	u32		scan_total_us;
+	u32		scan_fcs;
+	/* sampling only goes on for a while after a survey read */
+	int		consumer;
+	unsigned long	consumer_last;	/* jiffies */
+	int		noise_hist;	/* 0: not tried, 1: ok, -1: unsupported */
+	u8		noise_hist_bins[ACX_NOISE_HIST_LEN];
+	struct acx_survey_chan	chan[ACX_SURVEY_CHANNELS];
+};
+
+/* AP mode TIM, see acx_tim_update() */
+#define ACX_TIM_BITMAP_LEN	(IEEE80211_MAX_AID / 8 + 1)
+
+struct acx_tim {
+	/* from set_tim, adev->spinlock */
+	u8		bitmap[ACX_TIM_BITMAP_LEN];	/* bit per AID */
+	int		dirty;
+	unsigned long	set_calls;
+	unsigned long	coalesced;
+	/* the rest, acx_sem */
+	u8		written[ACX_TIM_BITMAP_LEN];
+	u8		dtim_count;	/* from mac80211's beacon */
+	u8		dtim_period;
+	u8		mcast;		/* multicast buffered bit, idem */
+	u8		*beacon;	/* last one from mac80211 */
+	int		beacon_len;
+	int		head_len;	/* up to its TIM */
+	int		tail_off;	/* after it */
+	unsigned long	last_write;	/* jiffies */
+	unsigned long	writes;
+	unsigned long	unchanged;
+	unsigned long	failed;
+};
+
+/* see acx_set_powersave() */
+struct acx_ps_stats {
+	unsigned long	enter;
+	unsigned long	exit;
+	unsigned long	failed;
+	unsigned long	tx_wakes;	/* tx after the hangover was over */
+	unsigned long	last_tx;	/* jiffies */
+	unsigned long	doze_start;	/* jiffies */
+	unsigned long	last_change;	/* jiffies, last mode update */
+	u64		doze_ms;	/* before doze_start */
+};
+
+/* station mode beacon filter and link monitoring, see bcn_filter.c */
+struct acx_bcn_filter {
+	int		fw;		/* 0: not tried, 1: ok, -1: unsupported */
+	int		disabled;	/* from debugfs */
+	int		enabled;	/* in the firmware */
+	u16		beacon_int;	/* TU */
+	unsigned long	last_beacon;	/* jiffies, from our AP */
+	int		loss_reported;
+	int		rssi_avg;	/* 1/16 dBm, frames from our AP, 0: none */
+	s32		cqm_thold;	/* dBm, 0: off */
+	u32		cqm_hyst;
+	int		cqm_last;	/* last event sent, -1: none */
+	unsigned long	losses;
+	unsigned long	cqm_events;
+	/* rx rates over the last watchdog period, for the host wakeups */
+	unsigned long	rx_frames;
+	unsigned long	rx_beacons;
+	unsigned long	prev_frames;
+	unsigned long	prev_beacons;
+	unsigned long	last_sample;	/* jiffies */
+	unsigned int	frames_per_s;
+	unsigned int	beacons_per_s;
+};
+
+/* firmware station contexts, see sta.c */
+#define ACX_STA_MAX			32
+#define ACX_STA_CONTEXTS_DEFAULT	1
+
+/* per station state, in ieee80211_sta.drv_priv */
+struct acx_sta {
+	struct list_head list;
+	u8		addr[ETH_ALEN];
+	u16		aid;
+	int		ctx;		/* firmware station context, -1: none */
+	int		slot;		/* in acx_sta_table.slot, -1: none */
+	int		ps;		/* dozing, from sta_notify */
+	unsigned long	tx_frames;
+	unsigned long	tx_bytes;
+	unsigned long	tx_failed;
+	unsigned long	rx_frames;
+	unsigned long	rx_bytes;
+	struct ieee80211_key_conf *key;	/* pairwise key in the firmware */
+	int		sw_key;		/* pairwise key in software */
+};
+
+struct acx_sta_table {
+	struct list_head list;		/* all stations, under the sem */
+	struct acx_sta	*ctx[ACX_STA_MAX];	/* by firmware context */
+	struct acx_sta	*aid[ACX_STA_MAX];	/* by AID - 1, under the sem */
+	/* for the tx status and the rx path, which run in atomic
+	 * context: under lock */
+	spinlock_t	lock;
+	struct acx_sta	*slot[ACX_STA_MAX];	/* see acx_sta_tx() */
+	struct acx_sta	*rx_last;	/* transmitter of the last rx */
+	unsigned int	contexts;	/* in the firmware memory config */
+	unsigned int	count;
+	unsigned long	no_ctx;		/* added with all contexts in use */
+};
+
+/* hardware keys, see key.c */
+#define ACX_KEY_GROUP_SLOTS	4
+
+/* ciphers offloaded to the firmware */
+#define ACX_KEY_OFFLOAD_WEP	0x01
+#define ACX_KEY_OFFLOAD_CCMP	0x04
+#define ACX_KEY_OFFLOAD_ALL	(ACX_KEY_OFFLOAD_WEP | ACX_KEY_OFFLOAD_CCMP)
+/* WEP only with the key_offload module parameter, for now */
+#define ACX_KEY_OFFLOAD_DEFAULT	ACX_KEY_OFFLOAD_CCMP
+
+struct acx_key_table {
+	struct ieee80211_key_conf *group[ACX_KEY_GROUP_SLOTS];
+	unsigned int	offload;
+	unsigned int	keys;		/* in the firmware */
+	unsigned long	hw_keys;	/* set in the firmware */
+	unsigned long	sw_keys;	/* left to software crypto */
+	unsigned long	failed;
+	unsigned long	evicted;	/* with their station */
+	unsigned long	tx_hw;
+	unsigned long	tx_sw;
+	unsigned long	rx_hw;
+	unsigned long	rx_sw;
+};
+
+/* channel switches, see acx_set_channel() */
+struct acx_chan_switch {
+	u8		tx_chan;	/* what the firmware is on, 0: disabled */
+	u8		rx_chan;
+	unsigned long	switches;
+	unsigned long	skipped;	/* already on the channel */
+	unsigned long	failed;
+	u32		last_us;
+	u32		max_us;
+	u64		total_us;
+	/* pending channel switch announcement, see acx_op_channel_switch() */
+	unsigned long	csa;
+	u8		csa_chan;
+	int		csa_freq;
+	int		csa_block_tx;
+};
+
+/* one firmware scan of a hw_scan request */
+struct acx_scan_pass {
+	u16		chans;		/* bit n: channel n + 1 */
+	int		ssid;		/* probe request to send, -1: passive */
+};
+
+/* a mac80211 hw_scan request, as a series of firmware scans, see scan.c */
+struct acx_scan {
+	struct cfg80211_scan_request *req;
+	u16		active;		/* channels left, bit n: channel n + 1 */
+	u16		passive;
+	int		chunked;	/* one channel per firmware scan */
+	u8		chan;		/* chunked: the current one, 0: none */
+	int		ssid;		/* next probe request */
+	struct acx_scan_pass next;
+	int		background;	/* back to our AP between passes */
+	int		in_pass;	/* a firmware scan is running */
+	unsigned long	pass_start;	/* jiffies */
+	unsigned long	off_channel;	/* jiffies in passes, background */
+	unsigned long	start;		/* jiffies */
+	unsigned int	passes;		/* firmware scans so far */
+	unsigned int	channels;
+	/* the last request, for debugfs */
+	unsigned long	count;
+	unsigned long	failed;
+	unsigned long	background_count;
+	unsigned long	ps_waits;	/* passes held for a ps change */
+	unsigned int	last_ms;
+	unsigned int	last_passes;
+	unsigned int	last_channels;
+	unsigned int	last_home_pct;	/* background: time on our channel */
+};
+
 /* non-firmware struct, no packing necessary */
 struct acx_device {
 	/* most frequent accesses first (dereferencing and cache line!) */
@@ -293,6 +647,9 @@ struct acx_device {
 
 	u8 *ie_cmd_buf;
 	int ie_cmd_buf_len;
+	/* set while issuing commands whose result nobody checks, the
+	 * bus may then post them (USB) */
+	int cmd_post;
 
 	/* wireless device statistics */
 	struct ieee80211_low_level_stats	ieee_stats;
@@ -300,6 +657,10 @@ struct acx_device {
 	/* net device statistics */
 	struct net_device_stats	stats;
 
+	struct acx_tx_rate_stat	tx_rate_stats[ACX_TX_RATE_STATS_CNT];
+	/* rx frames per rate index, last entry: undecodable plcp */
+	u32			rx_rate_hist[ACX_RX_RATE_STATS_CNT + 1];
+
 #ifdef WIRELESS_EXT
 /* 	struct iw_statistics	wstats;		// wireless statistics */
 #endif
@@ -341,6 +702,9 @@ struct acx_device {
 	struct delayed_work 	watchdog_work;
 	unsigned long 		watchdog_last;
 
+	struct delayed_work	tim_work;
+	struct acx_tim		tim;
+
 	/*** scanning ***/
 	u16		scan_count;	/* number of times to do channel scan */
 	u8		scan_mode;	/* 0 == active, 1 == passive, 2 == background */
@@ -348,7 +712,9 @@ struct acx_device {
 	u16		scan_duration;
 	u16		scan_probe_delay;
 
-	unsigned long 	scan_start;
+	unsigned long 	scan_start;	/* of the current firmware scan */
+	struct acx_scan	scan;
+	struct delayed_work	scan_work;	/* next background pass */
 
 #if WIRELESS_EXT > 15
 /* 	struct iw_spy_data	spy_data;	// FIXME: needs to be implemented! */
@@ -401,6 +767,17 @@ struct acx_device {
 	/* Mac80211 Tx_queue */
 	struct sk_buff_head tx_queue;
 	struct work_struct tx_work;
+	/* tx status reporting, see acx_tx_status_report() */
+	struct {
+		unsigned long	passes;		/* clean passes with status */
+		unsigned long	frames;
+		unsigned int	max_batch;
+		unsigned long	reported;
+		unsigned long	skipped;	/* nobody wanted the status */
+	} tx_status_stats;
+	/* the txqs with frames to pull, round robin, see ACX_TXQ */
+	struct list_head txq_list;
+	spinlock_t	txq_lock;
 
 #ifdef UNUSED
 	int		dup_count;
@@ -416,6 +793,11 @@ struct acx_device {
 	u8		ps_hangover_period;
 	u32		ps_enhanced_transition_time;
 	u32		ps_beacon_rx_time;
+	int		ps_enabled;		/* in the firmware */
+	u8		ps_dtim_period;		/* from mac80211 */
+	int		ps_dynamic_timeout;	/* ms, from mac80211 */
+	int		ps_hangover_user;	/* ms, debugfs, 0: auto */
+	struct acx_ps_stats ps_stats;
 
 	/*** PHY settings ***/
 	u8		fallback_threshold;
@@ -430,6 +812,8 @@ struct acx_device {
 
 	u8		tx_enabled;
 	u8		rx_enabled;
+	struct acx_chan_switch chan_switch;
+	struct delayed_work	chan_switch_work;
 	int		tx_level_dbm;
 	u8		tx_level_val;
 	/* u8		tx_level_auto;		whether to do automatic power adjustment */
@@ -452,6 +836,10 @@ struct acx_device {
 
 	u16		rts_threshold;
 	u16		frag_threshold;
+	int		frag_offload;		/* the firmware fragments */
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(4, 3, 0)
+	struct ieee80211_ops *hw_ops;		/* see acx_alloc_hw() */
+#endif
 	u32		short_retry;
 	u32		long_retry;
 	u16		msdu_lifetime;
@@ -478,11 +866,22 @@ struct acx_device {
 	/*** Card Rx/Tx management ***/
 	u16		rx_config_1;
 	u16		rx_config_2;
+	unsigned int	rx_filter_flags;	/* FIF_*, from configure_filter */
+	int		mc_filter;	/* only mc_list's groups, see below */
+	struct acx_mc_list mc_list;	/* in ACX1xx_IE_DOT11_GROUP_ADDR */
+	int		associated;
+	struct acx_rx_filter_stats rx_filter_stats;
+	struct acx_bcn_filter bcn_filter;
+	struct acx_sta_table sta;
+	struct acx_key_table keys;
 	u16		memblocksize;
 	u16		phy_header_len;
 
 	/* debugfs */
 	struct dentry	*debugfs_dir;
+	struct acx_rx_capture	*rx_capture;	/* adev->spinlock */
+	struct acx_fw_stats_ring *fw_stats_ring;	/* acx_sem */
+	struct acx_survey	survey;		/* acx_sem */
 
 	/* Firmware */
 	firmware_image_t *fw_image;
@@ -526,6 +925,9 @@ struct acx_device {
 #ifdef CONFIG_ACX_MAC80211_MEM
 	struct platform_device	*pdevmem;
 #endif
+#ifdef CONFIG_ACX_MAC80211_SIM
+	struct acxsim		*sim;	/* register/firmware model, sim.c */
+#endif
 
 	unsigned long	membase2;
 	void __iomem	*iobase2;
@@ -548,6 +950,10 @@ struct acx_device {
 	usb_tx_t	*usb_tx;
 	usb_rx_t	*usb_rx;
 
+	usb_cmd_t	*usb_cmd;
+	int		usb_cmd_next;	/* round-robin index into usb_cmd */
+	usb_cmd_stat_t	usb_cmd_stats[ACX_USB_CMD_STAT_CNT];
+
 	int		bulkinep;	/* bulk-in endpoint */
 	int		bulkoutep;	/* bulk-out endpoint */
 	int		rxtruncsize;
@@ -196,6 +196,9 @@ time: 4 bytes:
     first byte of PLCP header.
 */
 
+#define RXBUF_PHY_STAT_PBCC	0x08
+#define RXBUF_PHY_STAT_OFDM	0x04
+
 typedef struct rxbuffer {
 	u16	mac_cnt_rcvd;		/* only 12 bits are len! (0xfff) */
 	u8	mac_cnt_mblks;
@@ -659,6 +662,10 @@ struct rxhostdesc {
  */
 #ifdef CONFIG_ACX_MAC80211_USB
 
+#include <linux/usb/ch9.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+
 /* Used for usb_txbuffer.desc field */
 #define USB_TXBUF_TXDESC	0xA
 /* Size of header (everything up to data[]) */
@@ -714,6 +721,39 @@ typedef struct usb_rx {
 	/* Make entire structure 4k */
 	u8 padding[4*1024 - sizeof(struct usb_rx_plain)];
 } usb_rx_t;
+
+/* Preallocated control URBs + buffers for the command mailbox.
+ * Commands not returning data are posted without waiting, so a
+ * configure burst can keep several of them in flight. */
+#define ACX_USB_CMD_CNT		4
+/* cmd,status + largest template (0x100) + IE header, with headroom */
+#define ACX_USB_CMD_BUFSIZE	1024
+/* cmd values are 0x00..0x21, see acx_cmd_descs[] */
+#define ACX_USB_CMD_STAT_CNT	0x22
+
+typedef struct usb_cmd {
+	u8		busy;
+	u8		posted;
+	struct urb	*urb;
+	acx_device_t	*adev;
+	struct usb_ctrlrequest	setup;
+	struct completion	done;
+	unsigned	cmd;
+	const char	*cmdstr;
+	ktime_t		start;
+	u8		*buf;
+} usb_cmd_t;
+
+/* per-command latency accounting, see debugfs usb_cmd */
+typedef struct usb_cmd_stat {
+	const char	*cmdstr;
+	u32		count;
+	u32		posted;
+	u32		errors;
+	u32		last_us;
+	u32		max_us;
+	u64		total_us;
+} usb_cmd_stat_t;
 #endif /* ACX_USB */
 
 /* BOM Config Option structs */
@@ -1046,6 +1086,49 @@ typedef struct acx1xx_ie_tx_level {
 	u8	level;
 } ACX_PACKED acx1xx_ie_tx_level_t;
 
+/* ACX1xx_IE_DOT11_GROUP_ADDR: the acx111 table has two entries (the IE
+ * interrogates as 12 bytes), matched with RX_CFG1_RCV_MC_ADDR0/1 set */
+#define ACX_GROUP_ADDR_MAX	2
+
+typedef struct acx1xx_ie_group_addr {
+	u16	type;
+	u16	len;
+	u8	addr[ACX_GROUP_ADDR_MAX][ETH_ALEN];
+} ACX_PACKED acx1xx_ie_group_addr_t;
+
+/* ACX1xx_IE_MEDIUM_USAGE: free running counters, see survey.c */
+typedef struct acx1xx_ie_medium_usage {
+	u16	type;
+	u16	len;
+	u32	busy_us;	/* medium sensed busy */
+	u32	total_us;	/* since the counters started */
+} ACX_PACKED acx1xx_ie_medium_usage_t;
+
+typedef struct acx1xx_ie_fcs_error_count {
+	u16	type;
+	u16	len;
+	u32	count;
+} ACX_PACKED acx1xx_ie_fcs_error_count_t;
+
+/* ACX1FF_IE_NOISE_HISTOGRAM_RESULTS, bin layout unknown */
+#define ACX_NOISE_HIST_LEN	0x30
+
+typedef struct acx1ff_ie_noise_histogram {
+	u16	type;
+	u16	len;
+	u8	bins[ACX_NOISE_HIST_LEN];
+} ACX_PACKED acx1ff_ie_noise_histogram_t;
+
+/* ACX1FF_IE_BEACON_FILTER_OPTIONS: beacons whose IEs didn't change
+ * since the last one (TIM bit for our AID included) are dropped, but
+ * at least one in max_num_beacons is passed up */
+typedef struct acx1ff_ie_beacon_filter {
+	u16	type;
+	u16	len;
+	u8	enable;
+	u8	max_num_beacons;
+} ACX_PACKED acx1ff_ie_beacon_filter_t;
+
 #define TX_CFG_ACX100_NUM_POWER_LEVELS 2
 #define TX_CFG_ACX111_NUM_POWER_LEVELS 5
 
@@ -1373,13 +1456,13 @@ enum {
 
 /* Based on wl1251 definitions, TBC: ToBeCheck (not yet verified) */
 enum acx111_cmd_key_type {
-	/* TBC: KEY_WEP_DEFAULT       = 0, */
-	/* TBC: KEY_WEP_ADDR          = 1, */
+	KEY_WEP_DEFAULT       	 = 0,	/* TBC */
+	KEY_WEP_ADDR          	 = 1,	/* TBC */
 	KEY_AES_GROUP         	 = 4,
 	KEY_AES_PAIRWISE      	 = 5,
 	/* TBC: KEY_WEP_GROUP         = 6, */
-	/* TBC: KEY_TKIP_MIC_GROUP    = 10,*/
-	/* TBC: KEY_TKIP_MIC_PAIRWISE = 11,*/
+	KEY_TKIP_MIC_GROUP    	 = 10,	/* TBC */
+	KEY_TKIP_MIC_PAIRWISE 	 = 11,	/* TBC */
 };
 
 enum acx111_cmd_key_action {
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2012
+ * The ACX100 Open Source Project <acx100-devel@lists.sourceforge.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Station mode beacon filter and link monitoring
+ *
+ * While associated, the ACX111 firmware is told to drop the beacons
+ * of our AP which carry nothing new (ACX1FF_IE_BEACON_FILTER_OPTIONS),
+ * so the host isn't woken up ten times a second just to find the same
+ * IEs again.  mac80211 then can't watch the beacons itself, so while
+ * the filter is on the vif is flagged IEEE80211_VIF_BEACON_FILTER and
+ * the watchdog reports the beacon loss instead, allowing for the
+ * beacons the firmware may skip.
+ *
+ * For the same reason the connection quality (CQM RSSI) events are
+ * computed here, from an average of the level of all the frames our
+ * AP sends, not just from its beacons.  The firmware also has a low
+ * RSSI trigger (ACX1FF_IE_LOW_RSSI_THRESH_OPT), but how it reports it
+ * is unknown, so it's not used.
+ */
+
+#include "acx_debug.h"
+
+#include <linux/seq_file.h>
+#include <net/mac80211.h>
+
+#include "acx.h"
+#include "cmd.h"
+#include "ie.h"
+#include "bcn_filter.h"
+
+/* the firmware passes at least one beacon in this many */
+#define ACX_BCN_FILTER_MAX	10
+
+/* beacons missed on top of the filtered ones before reporting the
+ * loss, as mac80211 does */
+#define ACX_BCN_LOSS_COUNT	7
+
+/* weight of a new frame in the level average */
+#define ACX_CQM_WEIGHT		8
+
+/* rx level (0-100, see acx_signal_to_winlevel()) to an approximation
+ * of dBm, the mapping of the Windows driver */
+#define ACX_LEVEL_TO_DBM(level)	((int) (level) / 2 - 100)
+
+static int acx_bcn_filter_active(acx_device_t *adev)
+{
+	return adev->vif && adev->mode == ACX_MODE_2_STA && adev->associated;
+}
+
+/* mac80211 watches the beacons itself unless the firmware filters */
+static void acx_bcn_filter_set_vif(acx_device_t *adev)
+{
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+	if (!adev->vif || adev->vif->type != NL80211_IFTYPE_STATION)
+		return;
+
+	if (adev->bcn_filter.enabled)
+		adev->vif->driver_flags |= IEEE80211_VIF_BEACON_FILTER;
+	else
+		adev->vif->driver_flags &= ~IEEE80211_VIF_BEACON_FILTER;
+#endif
+}
+
+/*
+ * acx_bcn_filter_update
+ *
+ * Turns the firmware filter on or off as our state requires.  Called
+ * with the sem held when the association or the debugfs setting
+ * change.
+ */
+void acx_bcn_filter_update(acx_device_t *adev)
+{
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+	acx1ff_ie_beacon_filter_t ie;
+	int enable;
+
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags) || !IS_ACX111(adev)
+	    || bf->fw < 0) {
+		bf->enabled = 0;
+		acx_bcn_filter_set_vif(adev);
+		return;
+	}
+
+	enable = acx_bcn_filter_active(adev) && !bf->disabled;
+	if (!enable && !bf->enabled) {
+		acx_bcn_filter_set_vif(adev);
+		return;
+	}
+
+	memset(&ie, 0, sizeof(ie));
+	ie.enable = enable;
+	ie.max_num_beacons = ACX_BCN_FILTER_MAX;
+
+	if (OK != acx_configure(adev, &ie, ACX1FF_IE_BEACON_FILTER_OPTIONS)) {
+		log(L_INIT, "no beacon filter in this firmware\n");
+		bf->fw = -1;
+		bf->enabled = 0;
+		acx_bcn_filter_set_vif(adev);
+		return;
+	}
+	bf->fw = 1;
+	bf->enabled = enable;
+	acx_bcn_filter_set_vif(adev);
+
+	log(L_ASSOC, "beacon filter %s\n", enable ? "on" : "off");
+}
+
+/* Restarts the link monitoring, on (dis)association, with the sem held */
+void acx_bcn_filter_reset(acx_device_t *adev)
+{
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+
+	bf->last_beacon = jiffies;
+	bf->loss_reported = 0;
+	bf->rssi_avg = 0;
+	bf->cqm_last = -1;
+}
+
+void acx_bcn_filter_set_cqm(acx_device_t *adev, s32 thold, u32 hyst)
+{
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+
+	bf->cqm_thold = thold;
+	bf->cqm_hyst = hyst;
+	bf->cqm_last = -1;
+}
+
+/*
+ * acx_bcn_filter_rx
+ *
+ * Called for each received frame, before it goes to mac80211.  level is
+ * what we report as its signal.
+ */
+void acx_bcn_filter_rx(acx_device_t *adev, struct ieee80211_hdr *hdr,
+		u8 level)
+{
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+	int dbm16;
+
+	bf->rx_frames++;
+
+	if (adev->mode != ACX_MODE_2_STA || !adev->associated
+	    || ieee80211_is_ctl(hdr->frame_control)
+	    || !mac_is_equal(hdr->addr2, adev->bssid))
+		return;
+
+	if (ieee80211_is_beacon(hdr->frame_control)) {
+		bf->rx_beacons++;
+		bf->last_beacon = jiffies;
+		bf->loss_reported = 0;
+	}
+
+	/* dBm are never positive here, so 0 can mean no average yet */
+	dbm16 = ACX_LEVEL_TO_DBM(level) * 16;
+	if (!bf->rssi_avg)
+		bf->rssi_avg = dbm16;
+	else
+		bf->rssi_avg += (dbm16 - bf->rssi_avg) / ACX_CQM_WEIGHT;
+}
+
+/* Without the filter mac80211 watches the beacons itself */
+static void acx_bcn_filter_check_loss(acx_device_t *adev)
+{
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+	unsigned int beacons, interval;
+	unsigned long timeout;
+
+	if (!bf->enabled || bf->loss_reported || !bf->beacon_int)
+		return;
+
+	/* off channel: start over once back */
+	if (test_bit(ACX_FLAG_SCANNING, &adev->flags)) {
+		bf->last_beacon = jiffies;
+		return;
+	}
+
+	/* in power save the firmware may only wake up for the DTIMs */
+	interval = bf->beacon_int;
+	if (adev->ps_enabled && (adev->ps_wakeup_cfg & PS_CFG_WAKEUP_ON_DTIM)
+	    && adev->ps_dtim_period > 1)
+		interval *= adev->ps_dtim_period;
+
+	beacons = ACX_BCN_FILTER_MAX + ACX_BCN_LOSS_COUNT;
+	timeout = usecs_to_jiffies(beacons * interval * 1024);
+	if (time_before(jiffies, bf->last_beacon + timeout))
+		return;
+
+	log(L_ASSOC, "no beacon for %u ms, reporting beacon loss\n",
+		jiffies_to_msecs(jiffies - bf->last_beacon));
+	bf->loss_reported = 1;
+	bf->losses++;
+	ieee80211_beacon_loss(adev->vif);
+}
+
+static void acx_bcn_filter_check_cqm(acx_device_t *adev)
+{
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+	int rssi, event;
+
+	if (!bf->cqm_thold || !bf->rssi_avg)
+		return;
+
+	rssi = bf->rssi_avg / 16;
+	if (rssi < bf->cqm_thold - (s32) bf->cqm_hyst)
+		event = NL80211_CQM_RSSI_THRESHOLD_EVENT_LOW;
+	else if (rssi > bf->cqm_thold + (s32) bf->cqm_hyst)
+		event = NL80211_CQM_RSSI_THRESHOLD_EVENT_HIGH;
+	else
+		return;
+
+	if (event == bf->cqm_last)
+		return;
+	bf->cqm_last = event;
+	bf->cqm_events++;
+
+	log(L_ASSOC, "cqm: rssi %d dBm %s threshold %d dBm\n", rssi,
+		event == NL80211_CQM_RSSI_THRESHOLD_EVENT_LOW ?
+		"below" : "above", bf->cqm_thold);
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(4, 11, 0)
+	ieee80211_cqm_rssi_notify(adev->vif, event, rssi, GFP_KERNEL);
+#else
+	ieee80211_cqm_rssi_notify(adev->vif, event, GFP_KERNEL);
+#endif
+#endif
+}
+
+/* Called from the watchdog every second, with the sem held */
+void acx_bcn_filter_watchdog(acx_device_t *adev)
+{
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+	unsigned long now = jiffies, period;
+
+	period = now - bf->last_sample;
+	if (period >= HZ) {
+		bf->frames_per_s = (bf->rx_frames - bf->prev_frames) * HZ
+			/ period;
+		bf->beacons_per_s = (bf->rx_beacons - bf->prev_beacons) * HZ
+			/ period;
+		bf->prev_frames = bf->rx_frames;
+		bf->prev_beacons = bf->rx_beacons;
+		bf->last_sample = now;
+	}
+
+	if (acx_bcn_filter_active(adev)) {
+		acx_bcn_filter_check_loss(adev);
+		acx_bcn_filter_check_cqm(adev);
+	}
+}
+
+int acx_bcn_filter_dbgfs_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acx_bcn_filter *bf = &adev->bcn_filter;
+	const char *state;
+
+	acx_sem_lock(adev);
+
+	if (bf->fw < 0 || !IS_ACX111(adev))
+		state = "not supported by the firmware";
+	else if (bf->disabled)
+		state = "disabled";
+	else
+		state = bf->enabled ? "on" : "off";
+
+	seq_printf(file,
+		"firmware filter:\t%s\n"
+		"max beacons:\t%u\n"
+		"beacon interval:\t%u TU\n",
+		state, ACX_BCN_FILTER_MAX, bf->beacon_int);
+
+	if (acx_bcn_filter_active(adev)) {
+		seq_printf(file, "last beacon:\t%u ms ago\n",
+			jiffies_to_msecs(jiffies - bf->last_beacon));
+		if (bf->rssi_avg)
+			seq_printf(file, "rssi:\t%d dBm\n", bf->rssi_avg / 16);
+	}
+
+	seq_printf(file,
+		"cqm threshold:\t%d dBm, hysteresis %u\n"
+		"beacon losses:\t%lu\n"
+		"cqm events:\t%lu\n"
+		"rx frames/s:\t%u\n"
+		"beacons/s:\t%u\n",
+		bf->cqm_thold, bf->cqm_hyst, bf->losses, bf->cqm_events,
+		bf->frames_per_s, bf->beacons_per_s);
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
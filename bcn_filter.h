@@ -0,0 +1,14 @@
+#ifndef _ACX_BCN_FILTER_H_
+#define _ACX_BCN_FILTER_H_
+
+struct seq_file;
+
+void acx_bcn_filter_update(acx_device_t *adev);
+void acx_bcn_filter_rx(acx_device_t *adev, struct ieee80211_hdr *hdr,
+		u8 level);
+void acx_bcn_filter_watchdog(acx_device_t *adev);
+void acx_bcn_filter_reset(acx_device_t *adev);
+void acx_bcn_filter_set_cqm(acx_device_t *adev, s32 thold, u32 hyst);
+int acx_bcn_filter_dbgfs_output(struct seq_file *file, acx_device_t *adev);
+
+#endif
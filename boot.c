@@ -240,7 +240,7 @@ void acx_parse_configoption(acx_device_t *adev,
 	int i;
 	int is_acx111 = IS_ACX111(adev);
 
-	if (acx_debug & L_DEBUG) {
+	if (acx_debug_on(L_DEBUG)) {
 		pr_info("configoption struct content:\n");
 		acx_dump_bytes(pcfg, sizeof(*pcfg));
 	}
@@ -18,6 +18,8 @@
 
 #include "acx_debug.h"
 
+#include <linux/etherdevice.h>
+
 #include "acx.h"
 #include "merge.h"
 #include "cmd.h"
@@ -26,6 +28,7 @@
 #include "tx.h"
 #include "boot.h"
 #include "cardsetting.h"
+#include "survey.h"
 
 /* Please keep acx_reg_domain_ids_len in sync... */
 const u8 acx_reg_domain_ids[acx_reg_domain_ids_len] =
@@ -154,22 +157,57 @@ inline int acx111_feature_set(acx_device_t *adev, u32 f, u32 d)
 
 
 
+/*
+ * acx_set_channel
+ *
+ * There's no firmware command for the channel alone: ENABLE_TX and
+ * ENABLE_RX take it as their parameter.  So a switch is at most those
+ * two, without disabling anything in between, and each is skipped when
+ * its side already is on the channel.  The tx queue is left alone.
+ */
 int acx_set_channel(acx_device_t *adev, u8 channel, int freq)
 {
+	struct acx_chan_switch *cs = &adev->chan_switch;
+	ktime_t start;
+	u32 us;
 	int res = 0;
 
 	adev->rx_status.freq = freq;
 	adev->rx_status.band = IEEE80211_BAND_2GHZ;
 
+	if (cs->tx_chan == channel && cs->rx_chan == channel) {
+		cs->skipped++;
+		return OK;
+	}
+
+	start = ktime_get();
+
+	acx_survey_set_channel(adev, channel);
 	adev->channel = channel;
 
 	adev->tx_enabled = 1;
 	adev->rx_enabled = 1;
 
-	res += acx1xx_update_tx(adev);
-	res += acx1xx_update_rx(adev);
+	if (cs->tx_chan != channel)
+		res += acx1xx_update_tx(adev);
+	if (cs->rx_chan != channel)
+		res += acx1xx_update_rx(adev);
 
-	return res ? NOT_OK : OK;
+	if (res) {
+		cs->failed++;
+		return NOT_OK;
+	}
+
+	us = ktime_us_delta(ktime_get(), start);
+	cs->switches++;
+	cs->last_us = us;
+	cs->total_us += us;
+	if (us > cs->max_us)
+		cs->max_us = us;
+
+	log(L_INIT, "switched to channel %u in %u us\n", channel, us);
+
+	return OK;
 }
 
 static void acx111_sens_radio_16_17(acx_device_t *adev)
@@ -999,6 +1037,9 @@ int acx1xx_update_tx(acx_device_t *adev)
 	else
 		res = acx_issue_cmd(adev, ACX1xx_CMD_DISABLE_TX, NULL, 0);
 
+	/* unknown after a failure */
+	adev->chan_switch.tx_chan = (res == OK && adev->tx_enabled)
+		? adev->channel : 0;
 
 	return res;
 }
@@ -1027,6 +1068,9 @@ int acx1xx_update_rx(acx_device_t *adev)
 	else
 		res = acx_issue_cmd(adev, ACX1xx_CMD_DISABLE_RX, NULL, 0);
 
+	adev->chan_switch.rx_chan = (res == OK && adev->rx_enabled)
+		? adev->channel : 0;
+
 	return res;
 }
 
@@ -1068,6 +1112,29 @@ int acx1xx_update_msdu_lifetime(acx_device_t *adev)
 	return res;
 }
 
+/*
+ * acx111_update_frag_threshold
+ *
+ * The ACX111 firmware fragments the MSDUs longer than the threshold
+ * itself, out of the memconf.fragmentation memory, so a whole MSDU
+ * still takes one descriptor pair on the host.  The table entry of
+ * the IE is -1 (FW150 maps it to cfgInvalid), hence the length.
+ */
+int acx111_update_frag_threshold(acx_device_t *adev)
+{
+	u8 *frag_thresh = adev->ie_cmd_buf;
+
+	if (!IS_ACX111(adev))
+		return NOT_OK;
+
+	log(L_INIT, "Updating the fragmentation threshold: %u\n",
+		adev->frag_threshold);
+
+	*(u16 *) &frag_thresh[4] = cpu_to_le16(adev->frag_threshold);
+	return acx_configure_len(adev, frag_thresh,
+			ACX111_IE_DOT11_FRAG_THRESH, 2);
+}
+
 int acx_update_hw_encryption(acx_device_t *adev)
 {
 	int res;
@@ -1284,7 +1351,7 @@ int acx_set_tim_template(acx_device_t *adev, u8 *data, int len)
 
 
 
-	if (acx_debug & L_DEBUG) {
+	if (acx_debug_on(L_DEBUG)) {
 		logf1(L_ANY, "data, len=%d:\n", len);
 		acx_dump_bytes(data, len);
 	}
@@ -1294,6 +1361,11 @@ int acx_set_tim_template(acx_device_t *adev, u8 *data, int len)
 	* structured beacon (this may not be blocking though, but it's
 	* better like this)
 	*/
+	if (len > sizeof(templ) - 2) {
+		logf1(L_ANY, "TIM template too long: %d\n", len);
+		return NOT_OK;
+	}
+
 	memset(&templ, 0, sizeof(templ));
 	if (data)
 		memcpy((u8*) &templ.tim_eid, data, len);
@@ -1342,31 +1414,23 @@ static int acx_s_set_tim_template_off(acx_device_t *adev)
 }
 #endif
 
-#if POWER_SAVE_80211
-static int acx_s_set_null_data_template(acx_device_t *adev)
+/* Sent by the firmware when entering and leaving power save */
+int acx_set_null_data_template(acx_device_t *adev)
 {
 	struct acx_template_nullframe b;
-	int result;
-
 
+	memset(&b, 0, sizeof(b));
+	/* the 3 address header, without addr4 */
+	b.size = cpu_to_le16(offsetof(struct ieee80211_hdr, addr4));
+	b.hdr.frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA
+		| IEEE80211_STYPE_NULLFUNC | IEEE80211_FCTL_TODS);
+	MAC_COPY(b.hdr.addr1, adev->bssid);
+	MAC_COPY(b.hdr.addr2, adev->dev_addr);
+	MAC_COPY(b.hdr.addr3, adev->bssid);
 
-	/* memset(&b, 0, sizeof(b)); not needed, setting all members */
-
-	b.size = cpu_to_le16(sizeof(b) - 2);
-	b.hdr.fc = WF_FTYPE_MGMTi | WF_FSTYPE_NULLi;
-	b.hdr.dur = 0;
-	MAC_BCAST(b.hdr.a1);
-	MAC_COPY(b.hdr.a2, adev->dev_addr);
-	MAC_COPY(b.hdr.a3, adev->bssid);
-	b.hdr.seq = 0;
-
-	result = acx_issue_cmd(adev, ACX1xx_CMD_CONFIG_NULL_DATA,
+	return acx_issue_cmd(adev, ACX1xx_CMD_CONFIG_NULL_DATA,
 			&b, sizeof(b));
-
-
-	return result;
 }
-#endif
 
 static int acx_set_beacon_template(acx_device_t *adev, u8 *data, int len)
 {
@@ -1375,7 +1439,7 @@ static int acx_set_beacon_template(acx_device_t *adev, u8 *data, int len)
 
 
 
-	if (acx_debug & L_DEBUG) {
+	if (acx_debug_on(L_DEBUG)) {
 		logf1(L_ANY, "data, len=%d, sizeof(struct"
 			"acx_template_beacon)=%d:\n",
 			len, (int)sizeof(struct acx_template_beacon));
@@ -1445,12 +1509,186 @@ u8* acx_beacon_find_tim(struct sk_buff *beacon_skb)
 	return tim;
 }
 
+/*
+ * BOM TIM
+ * ==================================================
+ *
+ * In AP mode mac80211 tells us through set_tim which stations have
+ * frames buffered.  We keep the bitmap here and write the TIM element
+ * built from it, not a whole beacon from mac80211: on the ACX111 into
+ * the TIM template, which the firmware sends after the beacon template
+ * (the IEs after the TIM go with it), on the ACX100 into the beacon
+ * template, around which the last beacon from mac80211 is kept.
+ *
+ * The firmware only sends the TIM with the beacons, so acx_op_set_tim()
+ * writes at most once a beacon interval, and nothing if the bitmap
+ * came back to what was written.  The DTIM count and the multicast
+ * bit are taken from the TIM of the last beacon mac80211 gave us.
+ */
+
+/* Builds the TIM element of bitmap into buf, returns its length */
+static int acx_tim_build(acx_device_t *adev, const u8 *bitmap, u8 *buf)
+{
+	struct acx_tim *tim = &adev->tim;
+	int first, last;
+
+	for (first = 0; first < ACX_TIM_BITMAP_LEN; first++)
+		if (bitmap[first])
+			break;
+	if (first == ACX_TIM_BITMAP_LEN) {
+		first = last = 0;
+	} else {
+		for (last = ACX_TIM_BITMAP_LEN - 1; !bitmap[last]; last--)
+			;
+		/* the offset of the partial bitmap must be even */
+		first &= ~1;
+	}
+
+	buf[0] = WLAN_EID_TIM;
+	buf[1] = 3 + last - first + 1;
+	buf[2] = tim->dtim_count;
+	buf[3] = tim->dtim_period;
+	/* bitmap control: offset / 2 << 1, multicast buffered */
+	buf[4] = first | tim->mcast;
+	memcpy(buf + 5, bitmap + first, last - first + 1);
+
+	return 2 + buf[1];
+}
+
+/* Writes the TIM of bitmap, tim->written follows on success */
+static int acx_tim_write(acx_device_t *adev, const u8 *bitmap)
+{
+	struct acx_tim *tim = &adev->tim;
+	u8 buf[sizeof(acx_template_beacon_t) - 2];
+	u8 tim_ie[2 + 255];
+	int len = 0, tim_len, tail_len, res;
+
+	if (!tim->beacon)
+		return NOT_OK;
+
+	tim_len = acx_tim_build(adev, bitmap, tim_ie);
+	tail_len = tim->beacon_len - tim->tail_off;
+	if (IS_ACX100(adev))
+		len = tim->head_len;
+	if (len + tim_len + tail_len > sizeof(buf)) {
+		logf1(L_ANY, "beacon too long for the TIM: %d\n",
+			len + tim_len + tail_len);
+		return NOT_OK;
+	}
+
+	memcpy(buf, tim->beacon, len);
+	memcpy(buf + len, tim_ie, tim_len);
+	len += tim_len;
+	memcpy(buf + len, tim->beacon + tim->tail_off, tail_len);
+	len += tail_len;
+
+	if (IS_ACX111(adev))
+		res = acx_set_tim_template(adev, buf, len);
+	else
+		res = acx_set_beacon_template(adev, buf, len);
+	if (res)
+		return res;
+
+	memcpy(tim->written, bitmap, sizeof(tim->written));
+	tim->writes++;
+	tim->last_write = jiffies;
+	return OK;
+}
+
+static void acx_tim_snapshot(acx_device_t *adev, u8 *bitmap)
+{
+	struct acx_tim *tim = &adev->tim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	memcpy(bitmap, tim->bitmap, ACX_TIM_BITMAP_LEN);
+	tim->dirty = 0;
+	spin_unlock_irqrestore(&adev->spinlock, flags);
+}
+
+/*
+ * acx_tim_update
+ *
+ * Writes the bitmap set_tim changed, from acx_tim_work() with the sem
+ * held.  A failed write is tried again a beacon interval later.
+ */
+void acx_tim_update(acx_device_t *adev)
+{
+	struct acx_tim *tim = &adev->tim;
+	u8 bitmap[ACX_TIM_BITMAP_LEN];
+
+	acx_tim_snapshot(adev, bitmap);
+
+	if (!memcmp(bitmap, tim->written, sizeof(bitmap))) {
+		tim->unchanged++;
+		return;
+	}
+
+	/* the next beacon from mac80211 takes the bitmap along */
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags) || !tim->beacon)
+		return;
+
+	if (OK != acx_tim_write(adev, bitmap)) {
+		tim->failed++;
+		ieee80211_queue_delayed_work(adev->hw, &adev->tim_work,
+			usecs_to_jiffies(adev->beacon_interval * 1024));
+	}
+}
+
+/* Forgets the stations and the beacon, when the interface goes away */
+void acx_tim_reset(acx_device_t *adev)
+{
+	struct acx_tim *tim = &adev->tim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	memset(tim->bitmap, 0, sizeof(tim->bitmap));
+	tim->dirty = 0;
+	spin_unlock_irqrestore(&adev->spinlock, flags);
+
+	memset(tim->written, 0, sizeof(tim->written));
+	kfree(tim->beacon);
+	tim->beacon = NULL;
+}
+
+/* Keeps what's around the TIM of a new beacon and writes it */
+static int acx_tim_set_beacon(acx_device_t *adev, struct sk_buff *beacon,
+			u8 *tim_pos)
+{
+	struct acx_tim *tim = &adev->tim;
+	u8 bitmap[ACX_TIM_BITMAP_LEN];
+	int res;
+
+	kfree(tim->beacon);
+	tim->beacon = kmemdup(beacon->data, beacon->len, GFP_KERNEL);
+	if (!tim->beacon)
+		return NOT_OK;
+
+	tim->beacon_len = beacon->len;
+	tim->head_len = tim_pos - beacon->data;
+	tim->tail_off = min_t(int, tim->head_len + 2 + tim_pos[1],
+			beacon->len);
+	if (tim_pos[1] >= 2) {
+		tim->dtim_count = tim_pos[2];
+		tim->dtim_period = tim_pos[3];
+	}
+	tim->mcast = (tim_pos[1] >= 3) ? (tim_pos[4] & 0x01) : 0;
+
+	if (IS_ACX111(adev)) {
+		res = acx_set_beacon_template(adev, beacon->data,
+					tim->head_len);
+		if (res)
+			return res;
+	}
+
+	acx_tim_snapshot(adev, bitmap);
+	return acx_tim_write(adev, bitmap);
+}
+
 int acx_set_beacon(acx_device_t *adev, struct sk_buff *beacon)
 {
 	int res;
 	u8 *tim_pos;
-	int len_wo_tim;
-	int len_tim;
 
 	/* The TIM template handling between ACX100 and ACX111 works
 	 * differently:
@@ -1463,33 +1701,24 @@ int acx_set_beacon(acx_device_t *adev, struct sk_buff *beacon)
 	 * setup
 	 */
 
-	/* TODO Use pos provided by ieee80211_beacon_get_tim instead */
 	tim_pos = acx_beacon_find_tim(beacon);
-	if (tim_pos == NULL)
+	if (tim_pos) {
+		/* the TIM then comes from our bitmap, see acx_tim_update() */
+		res = acx_tim_set_beacon(adev, beacon, tim_pos);
+	} else {
 		logf0(L_DEBUG, "No tim contained in beacon skb");
-
-	/* ACX111: If beacon contains tim, only configure
-	 * beacon-template until tim
-	 */
-	if (IS_ACX111(adev) && tim_pos)
-		len_wo_tim = tim_pos - beacon->data;
-	else
-		len_wo_tim = beacon->len;
-
-	res = acx_set_beacon_template(adev, beacon->data, len_wo_tim);
+		res = acx_set_beacon_template(adev, beacon->data, beacon->len);
+
+		/* We need to set always a tim template, even if length
+		 * it null, since otherwise the acx is not sending fully
+		 * correct structured beacons.
+		 */
+		if (!res && IS_ACX111(adev))
+			res = acx_set_tim_template(adev, NULL, 0);
+	}
 	if (res)
 		goto out;
 
-	/* We need to set always a tim template, even if length it
-	 * null, since otherwise the acx is not sending fully correct
-	 * structured beacons.
-	 */
-	if (IS_ACX111(adev))
-	{
-		len_tim = beacon->len - len_wo_tim;
-		acx_set_tim_template(adev, tim_pos, len_tim);
-	}
-
 	/* BTW acx111 firmware would not send probe responses if probe
 	 * request does not have all basic rates flagged by 0x80!
 	 * Thus firmware does not conform to 802.11, it should ignore
@@ -1590,7 +1819,7 @@ static void acx_update_ratevector(acx_device_t *adev)
 		bcfg >>= 1;
 	}
 	adev->rate_supported_len = supp - adev->rate_supported;
-	if (acx_debug & L_ASSOC) {
+	if (acx_debug_on(L_ASSOC)) {
 		pr_info("new ratevector: ");
 		acx_dump_bytes(adev->rate_supported, adev->rate_supported_len);
 	}
@@ -1598,6 +1827,117 @@ static void acx_update_ratevector(acx_device_t *adev)
 }
 
 
+/*
+ * Narrows the mode's rx config down to what mac80211 asked for through
+ * configure_filter, so the firmware already drops what mac80211 would
+ * drop anyway, instead of us taking an irq, an skb and a trip through
+ * the stack for it.
+ */
+static void acx_rx_config_filter(acx_device_t *adev)
+{
+	unsigned int flags = adev->rx_filter_flags;
+
+	if (flags & FIF_FCSFAIL)
+		SET_BIT(adev->rx_config_2, RX_CFG2_RCV_BROKEN_FRAMES);
+	else
+		CLEAR_BIT(adev->rx_config_2, RX_CFG2_RCV_BROKEN_FRAMES);
+
+	/* an AP needs PS-Poll, which mac80211 before FIF_PSPOLL
+	 * didn't ask for */
+	if (flags & FIF_CONTROL)
+		SET_BIT(adev->rx_config_2,
+			RX_CFG2_RCV_CTRL_FRAMES | RX_CFG2_RCV_ACK_FRAMES);
+	else {
+		CLEAR_BIT(adev->rx_config_2, RX_CFG2_RCV_ACK_FRAMES);
+		if ((flags & ACX_FIF_PSPOLL) || (!ACX_FIF_PSPOLL
+			&& adev->mode == ACX_MODE_3_AP))
+			SET_BIT(adev->rx_config_2, RX_CFG2_RCV_CTRL_FRAMES);
+		else
+			CLEAR_BIT(adev->rx_config_2, RX_CFG2_RCV_CTRL_FRAMES);
+	}
+
+	/* an AP answers them from the template, see acx_set_beacon() */
+	if ((flags & ACX_FIF_PROBE_REQ) && adev->mode != ACX_MODE_3_AP)
+		SET_BIT(adev->rx_config_2, RX_CFG2_RCV_PROBE_REQ);
+	else
+		CLEAR_BIT(adev->rx_config_2, RX_CFG2_RCV_PROBE_REQ);
+
+	if (flags & ACX_FIF_PROMISC_IN_BSS)
+		CLEAR_BIT(adev->rx_config_1, RX_CFG1_FILTER_MAC);
+	else
+		SET_BIT(adev->rx_config_1, RX_CFG1_FILTER_MAC);
+
+	/* Foreign BSSs only once associated: before, and while
+	 * scanning, their beacons and probe responses are what we're
+	 * looking for */
+	if (!(flags & (FIF_OTHER_BSS | FIF_BCN_PRBRESP_PROMISC))
+	    && adev->mode == ACX_MODE_2_STA && adev->associated
+	    && !test_bit(ACX_FLAG_SCANNING, &adev->flags))
+		SET_BIT(adev->rx_config_1, RX_CFG1_FILTER_BSSID);
+	else
+		CLEAR_BIT(adev->rx_config_1, RX_CFG1_FILTER_BSSID);
+
+	/* the group address table, or all multicast */
+	if (adev->mc_filter && !(flags & FIF_ALLMULTI)) {
+		SET_BIT(adev->rx_config_1, RX_CFG1_FILTER_ALL_MULTI);
+		CLEAR_BIT(adev->rx_config_1,
+			RX_CFG1_RCV_MC_ADDR0 | RX_CFG1_RCV_MC_ADDR1);
+		if (adev->mc_list.count > 0)
+			SET_BIT(adev->rx_config_1, RX_CFG1_RCV_MC_ADDR0);
+		if (adev->mc_list.count > 1)
+			SET_BIT(adev->rx_config_1, RX_CFG1_RCV_MC_ADDR1);
+	} else
+		CLEAR_BIT(adev->rx_config_1, RX_CFG1_FILTER_ALL_MULTI
+			| RX_CFG1_RCV_MC_ADDR0 | RX_CFG1_RCV_MC_ADDR1);
+}
+
+static int acx_update_group_addr(acx_device_t *adev)
+{
+	acx1xx_ie_group_addr_t ie;
+
+	memset(&ie, 0, sizeof(ie));
+	memcpy(ie.addr, adev->mc_list.addr, sizeof(ie.addr));
+
+	return acx_configure_len(adev, &ie, ACX1xx_IE_DOT11_GROUP_ADDR,
+				sizeof(ie.addr));
+}
+
+/*
+ * acx_set_mc_list
+ *
+ * Takes the multicast groups mac80211 wants, NULL for all of them.
+ * The firmware table is reprogrammed if its content changes, the rx
+ * config is up to acx_update_rx_filter().  Called with the sem held.
+ */
+int acx_set_mc_list(acx_device_t *adev, const struct acx_mc_list *mc)
+{
+	int mc_filter = mc && !mc->overflow;
+
+	adev->mc_filter = mc_filter;
+	if (!mc_filter)
+		return OK;
+
+	if (mc->count == adev->mc_list.count
+	    && !memcmp(mc->addr, adev->mc_list.addr,
+			mc->count * ETH_ALEN))
+		return OK;
+
+	memset(&adev->mc_list, 0, sizeof(adev->mc_list));
+	adev->mc_list.count = mc->count;
+	memcpy(adev->mc_list.addr, mc->addr, mc->count * ETH_ALEN);
+
+	/* acx_update_mode() programs it when the interface comes up */
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags))
+		return OK;
+
+	if (OK != acx_update_group_addr(adev)) {
+		/* all multicast then */
+		adev->mc_filter = 0;
+		return NOT_OK;
+	}
+	return OK;
+}
+
 static int acx_update_rx_config(acx_device_t *adev)
 {
 	int res;
@@ -1705,6 +2045,8 @@ static int acx_update_rx_config(acx_device_t *adev)
 		break;
 	}
 
+	if (adev->mode != ACX_MODE_MONITOR)
+		acx_rx_config_filter(adev);
 	adev->rx_config_1 |= RX_CFG1_INCLUDE_RXBUF_HDR;
 
 	if ((adev->rx_config_1 & RX_CFG1_INCLUDE_PHY_HDR)
@@ -1725,6 +2067,102 @@ static int acx_update_rx_config(acx_device_t *adev)
 	return res;
 }
 
+/*
+ * acx_update_rx_filter
+ *
+ * Called with the sem held when the mac80211 filter flags, the
+ * association or scanning changed.  Reprograms ACX1xx_IE_RXCONFIG only
+ * if that changes the rx config.
+ */
+int acx_update_rx_filter(acx_device_t *adev)
+{
+	u16 cfg1 = adev->rx_config_1;
+	u16 cfg2 = adev->rx_config_2;
+	int res = 0;
+
+	/* acx_update_mode() programs it when the interface comes up */
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags))
+		return OK;
+
+	switch (adev->mode) {
+	case ACX_MODE_2_STA:
+	case ACX_MODE_0_ADHOC:
+	case ACX_MODE_3_AP:
+		break;
+	default:
+		return OK;
+	}
+
+	/* same as acx_update_rx_config() would compute, without
+	 * telling the firmware yet */
+	acx_rx_config_filter(adev);
+	if (cfg1 == adev->rx_config_1 && cfg2 == adev->rx_config_2) {
+		adev->rx_filter_stats.unchanged++;
+		return OK;
+	}
+	adev->rx_filter_stats.updates++;
+
+	/* see acx_update_mode() */
+	acx1xx_set_rx_enable(adev, 0);
+	res += acx_update_rx_config(adev);
+	res += acx1xx_set_rx_enable(adev, 1);
+
+	return res ? NOT_OK : OK;
+}
+
+/* The BSSID of a frame, NULL if it has none (WDS) */
+static const u8 *acx_rx_frame_bssid(struct ieee80211_hdr *hdr)
+{
+	if (!ieee80211_has_tods(hdr->frame_control)) {
+		if (!ieee80211_has_fromds(hdr->frame_control))
+			return hdr->addr3;
+		return hdr->addr2;
+	}
+	if (!ieee80211_has_fromds(hdr->frame_control))
+		return hdr->addr1;
+	return NULL;
+}
+
+/*
+ * acx_rx_filter_account
+ *
+ * Counts the received frames mac80211 is going to drop according to
+ * the filter flags it gave us, but which the firmware let through.
+ * Shown in the "rx_filter" debugfs file.
+ */
+void acx_rx_filter_account(acx_device_t *adev, struct ieee80211_hdr *hdr)
+{
+	unsigned int flags = adev->rx_filter_flags;
+	__le16 fc = hdr->frame_control;
+	const u8 *bssid;
+
+	if (adev->mode == ACX_MODE_MONITOR)
+		return;
+
+	if (ieee80211_is_ctl(fc)) {
+		if (!(flags & FIF_CONTROL) && !ieee80211_is_pspoll(fc))
+			adev->rx_filter_stats.sw_control++;
+		return;
+	}
+
+	if (ieee80211_is_probe_req(fc)) {
+		if (adev->mode == ACX_MODE_2_STA
+		    && !(flags & ACX_FIF_PROBE_REQ))
+			adev->rx_filter_stats.sw_probe_req++;
+		return;
+	}
+
+	if (adev->mode != ACX_MODE_2_STA || !adev->associated
+	    || (flags & (FIF_OTHER_BSS | FIF_BCN_PRBRESP_PROMISC))
+	    || test_bit(ACX_FLAG_SCANNING, &adev->flags))
+		return;
+
+	bssid = acx_rx_frame_bssid(hdr);
+	if (bssid && !is_broadcast_ether_addr(bssid)
+	    && !mac_is_equal(bssid, adev->bssid))
+		adev->rx_filter_stats.sw_other_bss++;
+}
+
 int acx_set_mode(acx_device_t *adev, u16 mode)
 {
 	adev->mode = mode;
@@ -1745,6 +2183,8 @@ int acx_update_mode(acx_device_t *adev)
 		/* Rx should be disabled before changing rx_config. This improved
 		   a lot ifup stability on acx100/mem with the hx4700 */
 		acx1xx_set_rx_enable(adev, 0);
+		if (adev->mc_filter && OK != acx_update_group_addr(adev))
+			adev->mc_filter = 0;
 		res += acx_update_rx_config(adev);
 
 		acx1xx_set_rx_enable(adev, 1);
@@ -1825,7 +2265,9 @@ void acx_set_defaults(acx_device_t *adev)
 	 * complete" interrupt, so our current infrastructure will
 	 * fail: */
 	adev->scan_count = 1;
-	adev->scan_mode = ACX_SCAN_OPT_ACTIVE;
+	/* background scans while associated, see scan.c */
+	adev->scan_mode = ACX_SCAN_OPT_BACKGROUND;
+	adev->keys.offload = acx_key_offload & ACX_KEY_OFFLOAD_ALL;
 	adev->scan_duration = 100;
 	adev->scan_probe_delay = 200;
 	/* reported to break scanning: adev->scan_probe_delay =
@@ -1878,21 +2320,13 @@ void acx_set_defaults(acx_device_t *adev)
 		acx_set_hw_encryption_off(adev);
 
 
-/* #define ENABLE_POWER_SAVE */
-#ifdef ENABLE_POWER_SAVE
-	adev->ps_wakeup_cfg = PS_CFG_ENABLE | PS_CFG_WAKEUP_ALL_BEAC;
-	adev->ps_listen_interval = 1;
-	adev->ps_options =
-	    PS_OPT_ENA_ENHANCED_PS | PS_OPT_TX_PSPOLL | PS_OPT_STILL_RCV_BCASTS;
-	adev->ps_hangover_period = 30;
-	adev->ps_enhanced_transition_time = 0;
-#else
+	/* power save is off until mac80211 asks for it */
 	adev->ps_wakeup_cfg = 0;
 	adev->ps_listen_interval = 0;
 	adev->ps_options = 0;
-	adev->ps_hangover_period = 0;
+	adev->ps_hangover_period = ACX_PS_HANGOVER_DEFAULT;
 	adev->ps_enhanced_transition_time = 0;
-#endif
+	adev->ps_dynamic_timeout = 0;
 
 }
 
@@ -1900,6 +2334,10 @@ void acx_update_settings(acx_device_t *adev)
 {
 	log(L_INIT, "Updating initial settings\n");
 
+	/* none of these results is checked, acx_update_mode() has a
+	 * fallback on the group address table though */
+	adev->cmd_post = 1;
+
 	acx1xx_update_station_id(adev);
 
 	acx1xx_update_rate_fallback(adev);
@@ -1914,10 +2352,14 @@ void acx_update_settings(acx_device_t *adev)
 
 	acx1xx_update_retry(adev);
 	acx1xx_update_msdu_lifetime(adev);
+	if (adev->frag_offload)
+		acx111_update_frag_threshold(adev);
 	acx_update_reg_domain(adev);
 
 	acx_update_hw_encryption(adev);
 
+	adev->cmd_post = 0;
+
 	acx_update_mode(adev);
 
 	/* For the acx100, we leave the firmware sensitivity and it
@@ -1930,16 +2372,33 @@ void acx_update_settings(acx_device_t *adev)
 }
 
 
-#if 0
-static void acx_s_update_80211_powersave_mode(acx_device_t * adev)
+/*
+ * BOM 802.11 power save
+ * ==================================================
+ *
+ * Station mode only.  mac80211 asks for it with IEEE80211_CONF_PS once
+ * associated; the firmware then tells the AP with the null data
+ * template, dozes between the beacons it has to listen to and fetches
+ * what the TIM says is buffered for us with PS-Polls.
+ *
+ * We advertise dynamic power save, so mac80211 doesn't take us out of
+ * it before each tx: the firmware wakes up by itself to send and stays
+ * awake for the hangover period afterwards, in case the answer comes
+ * quickly.  The hangover follows mac80211's dynamic_ps_timeout (the
+ * firmware counts in 1/1024 s, close enough to ms), unless set through
+ * debugfs.
+ */
+static int acx_update_80211_powersave_mode(acx_device_t *adev)
 {
 	/* merge both structs in a union to be able to have common code */
 	union {
 		acx111_ie_powersave_t acx111;
 		acx100_ie_powersave_t acx100;
 	} pm;
+	unsigned int type = IS_ACX111(adev) ?
+		ACX111_IE_POWER_MGMT : ACX100_IE_POWER_MGMT;
+	int res;
 
-	/* change 802.11 power save mode settings */
 	log(L_INIT, "updating 802.11 power save mode settings: "
 	    "wakeup_cfg 0x%02X, listen interval %u, "
 	    "options 0x%02X, hangover period %u, "
@@ -1947,19 +2406,8 @@ static void acx_s_update_80211_powersave_mode(acx_device_t * adev)
 	    adev->ps_wakeup_cfg, adev->ps_listen_interval,
 	    adev->ps_options, adev->ps_hangover_period,
 	    adev->ps_enhanced_transition_time);
-	acx_interrogate(adev, &pm, ACX1xx_IE_POWER_MGMT);
-	log(L_INIT, "Previous PS mode settings: wakeup_cfg 0x%02X, "
-	    "listen interval %u, options 0x%02X, "
-	    "hangover period %u, "
-	    "enhanced_ps_transition_time %u, beacon_rx_time %u\n",
-	    pm.acx111.wakeup_cfg,
-	    pm.acx111.listen_interval,
-	    pm.acx111.options,
-	    pm.acx111.hangover_period,
-	    IS_ACX111(adev) ?
-	    pm.acx111.enhanced_ps_transition_time
-	    : pm.acx100.enhanced_ps_transition_time,
-	    IS_ACX111(adev) ? pm.acx111.beacon_rx_time : (u32) - 1);
+
+	memset(&pm, 0, sizeof(pm));
 	pm.acx111.wakeup_cfg = adev->ps_wakeup_cfg;
 	pm.acx111.listen_interval = adev->ps_listen_interval;
 	pm.acx111.options = adev->ps_options;
@@ -1972,19 +2420,115 @@ static void acx_s_update_80211_powersave_mode(acx_device_t * adev)
 		pm.acx100.enhanced_ps_transition_time =
 		    cpu_to_le16(adev->ps_enhanced_transition_time);
 	}
-	acx_configure(adev, &pm, ACX1xx_IE_POWER_MGMT);
-	acx_interrogate(adev, &pm, ACX1xx_IE_POWER_MGMT);
-	log(L_INIT, "wakeup_cfg: 0x%02X\n", pm.acx111.wakeup_cfg);
-	acx_mwait(40);
-	acx_interrogate(adev, &pm, ACX1xx_IE_POWER_MGMT);
-	log(L_INIT, "wakeup_cfg: 0x%02X\n", pm.acx111.wakeup_cfg);
-	log(L_INIT, "power save mode change %s\n",
-	    (pm.acx111.
-	     wakeup_cfg & PS_CFG_PENDING) ? "FAILED" : "was successful");
-	/* FIXME: maybe verify via PS_CFG_PENDING bit here
-	 * that power save mode change was successful. */
-	/* FIXME: we shouldn't trigger a scan immediately after
-	 * fiddling with power save mode (since the firmware is sending
-	 * a NULL frame then). */
+
+	/* the firmware sends the null data frame now: no background
+	 * scan before it's out, see acx_ps_settling() */
+	res = acx_configure(adev, &pm, type);
+	if (res == OK)
+		adev->ps_stats.last_change = jiffies;
+	return res;
+}
+
+/* Jiffies left until the last power save mode update settled, 0 if
+ * it did */
+unsigned long acx_ps_settling(acx_device_t *adev)
+{
+	unsigned long end = adev->ps_stats.last_change
+		+ msecs_to_jiffies(ACX_PS_SETTLE_MS);
+
+	if (!adev->ps_stats.last_change || !time_before(jiffies, end))
+		return 0;
+	return end - jiffies;
+}
+
+static u8 acx_ps_hangover(acx_device_t *adev)
+{
+	int ms = adev->ps_hangover_user;
+
+	if (!ms)
+		ms = adev->ps_dynamic_timeout;
+	if (ms <= 0)
+		return ACX_PS_HANGOVER_DEFAULT;
+
+	return clamp(ms, ACX_PS_HANGOVER_MIN, ACX_PS_HANGOVER_MAX);
+}
+
+/*
+ * acx_set_powersave
+ *
+ * Called with the sem held from acx_op_config(), and with enable = 0
+ * when the interface goes away.  Also reprograms the hangover while in
+ * power save.
+ */
+int acx_set_powersave(acx_device_t *adev, int enable)
+{
+	struct acx_ps_stats *st = &adev->ps_stats;
+	int res;
+
+	if (adev->mode != ACX_MODE_2_STA)
+		enable = 0;
+	if (!enable && !adev->ps_enabled)
+		return OK;
+
+	if (enable) {
+		/* ps_dtim_period: the DTIM period of our AP, within what
+		 * mac80211 lets us sleep through, 0 if unknown */
+		adev->ps_wakeup_cfg = PS_CFG_ENABLE
+			| ((adev->ps_dtim_period > 1) ?
+			   PS_CFG_WAKEUP_ON_DTIM : PS_CFG_WAKEUP_ALL_BEAC);
+		adev->ps_listen_interval = 1;
+		adev->ps_options = PS_OPT_TX_PSPOLL | PS_OPT_STILL_RCV_BCASTS;
+		adev->ps_hangover_period = acx_ps_hangover(adev);
+
+		if (!adev->ps_enabled
+		    && OK != acx_set_null_data_template(adev)) {
+			st->failed++;
+			return NOT_OK;
+		}
+	} else {
+		adev->ps_wakeup_cfg = 0;
+		adev->ps_options = 0;
+	}
+
+	res = acx_update_80211_powersave_mode(adev);
+	if (res != OK) {
+		st->failed++;
+		return res;
+	}
+
+	if (enable && !adev->ps_enabled) {
+		st->enter++;
+		st->doze_start = jiffies;
+		st->last_tx = 0;
+	} else if (!enable && adev->ps_enabled) {
+		st->exit++;
+		st->doze_ms += jiffies_to_msecs(jiffies - st->doze_start);
+	}
+	adev->ps_enabled = enable;
+
+	log(L_ASSOC, "power save %s, wakeup_cfg 0x%02X, hangover %u\n",
+		enable ? "on" : "off", adev->ps_wakeup_cfg,
+		adev->ps_hangover_period);
+
+	return OK;
+}
+
+/*
+ * acx_ps_account_tx
+ *
+ * Called for each frame sent.  While in power save, the first one
+ * after the hangover period is over makes the firmware wake up.
+ */
+void acx_ps_account_tx(acx_device_t *adev)
+{
+	struct acx_ps_stats *st = &adev->ps_stats;
+	unsigned long now = jiffies;
+
+	if (!adev->ps_enabled)
+		return;
+
+	if (!st->last_tx || time_after(now, st->last_tx
+			+ msecs_to_jiffies(adev->ps_hangover_period)))
+		st->tx_wakes++;
+	st->last_tx = now;
 }
-#endif
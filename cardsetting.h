@@ -38,6 +38,7 @@ int acx1xx_set_rx_enable(acx_device_t *adev, u8 rx_enabled);
 int acx1xx_update_rx(acx_device_t *adev);
 int acx1xx_update_retry(acx_device_t *adev);
 int acx1xx_update_msdu_lifetime(acx_device_t *adev);
+int acx111_update_frag_threshold(acx_device_t *adev);
 int acx111_set_recalib_auto(acx_device_t *adev, int enable);
 int acx_update_hw_encryption(acx_device_t *adev);
 int acx_set_hw_encryption_on(acx_device_t *adev);
@@ -46,7 +47,52 @@ int acx_set_hw_encryption_off(acx_device_t *adev);
 int acx_set_beacon(acx_device_t *adev, struct sk_buff *beacon);
 int acx_set_tim_template(acx_device_t *adev, u8 *data, int len);
 int acx_set_probe_request_template(acx_device_t *adev, unsigned char *data, unsigned int len);
+int acx_set_null_data_template(acx_device_t *adev);
 u8* acx_beacon_find_tim(struct sk_buff *beacon_skb);
+void acx_tim_update(acx_device_t *adev);
+void acx_tim_reset(acx_device_t *adev);
+
+/* FIF_* flags acx_update_rx_filter() maps to the rx config; the
+ * ones mac80211 doesn't have (anymore) are 0 */
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 34)
+#define ACX_FIF_PSPOLL		FIF_PSPOLL
+#else
+#define ACX_FIF_PSPOLL		0
+#endif
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+#define ACX_FIF_PROBE_REQ	FIF_PROBE_REQ
+#else
+#define ACX_FIF_PROBE_REQ	0
+#endif
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(4, 2, 0)
+#define ACX_FIF_PROMISC_IN_BSS	FIF_PROMISC_IN_BSS
+#else
+#define ACX_FIF_PROMISC_IN_BSS	0
+#endif
+
+#define ACX_FIF_SUPPORTED \
+	(FIF_ALLMULTI | FIF_FCSFAIL | FIF_CONTROL | FIF_OTHER_BSS \
+	 | FIF_BCN_PRBRESP_PROMISC | ACX_FIF_PSPOLL | ACX_FIF_PROBE_REQ \
+	 | ACX_FIF_PROMISC_IN_BSS)
+
+int acx_update_rx_filter(acx_device_t *adev);
+int acx_set_mc_list(acx_device_t *adev, const struct acx_mc_list *mc);
+void acx_rx_filter_account(acx_device_t *adev, struct ieee80211_hdr *hdr);
+
+/* firmware wake time after a tx while in power save, in ms (1/1024 s),
+ * see acx_set_powersave() */
+#define ACX_PS_HANGOVER_DEFAULT	30
+#define ACX_PS_HANGOVER_MIN	10
+#define ACX_PS_HANGOVER_MAX	255
+
+/* after a power save mode update, the firmware tells our AP with a
+ * null data frame: time left for it (retries included) before the
+ * firmware may leave the channel, in ms */
+#define ACX_PS_SETTLE_MS	50
+
+int acx_set_powersave(acx_device_t *adev, int enable);
+unsigned long acx_ps_settling(acx_device_t *adev);
+void acx_ps_account_tx(acx_device_t *adev);
 
 int acx_set_mode(acx_device_t *adev, u16 mode);
 int acx_update_mode(acx_device_t *adev);
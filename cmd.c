@@ -24,6 +24,7 @@
 #include "cmd.h"
 #include "utils.h"
 #include "main.h"
+#include "trace.h"
 
 /* Controller Commands
  * Can be found in the cmdTable table on the "Rev. 1.5.0" (FW150) firmware
@@ -97,17 +98,28 @@ int acx_issue_cmd_timeout(acx_device_t *adev, enum acx_cmd cmd, void *param,
 {
 	const unsigned int cmdval = acx_cmd_descs[cmd].val;
 	const char *cmdstr = acx_cmd_descs[cmd].name;
+	ktime_t start;
+	int res;
+
+	trace_acx_cmd_issue(adev, cmdval, cmdstr, len);
+	start = ktime_get();
 
 	if (IS_PCI(adev) || IS_MEM(adev))
-		return _acx_issue_cmd_timeo_debug(adev, cmdval, param, len,
+		res = _acx_issue_cmd_timeo_debug(adev, cmdval, param, len,
 						timeout, cmdstr);
-	if (IS_USB(adev))
-		return acxusb_issue_cmd_timeo_debug(adev, cmdval, param, len,
+	else if (IS_USB(adev))
+		res = acxusb_issue_cmd_timeo_debug(adev, cmdval, param, len,
 						timeout, cmdstr);
+	else {
+		log(L_ANY, "Unsupported dev_type=%i\n", (adev)->dev_type);
+		res = NOT_OK;
+	}
 
-	log(L_ANY, "Unsupported dev_type=%i\n", (adev)->dev_type);
+	/* For posted USB commands this is the submit time only */
+	trace_acx_cmd_done(adev, cmdval, cmdstr, res,
+			ktime_to_us(ktime_sub(ktime_get(), start)));
 
-	return (NOT_OK);
+	return res;
 }
 
 inline int acx_issue_cmd(acx_device_t *adev, enum acx_cmd cmd, void *param, unsigned len)
@@ -124,7 +136,6 @@ inline int acx_configure(acx_device_t *adev, void *pdr, enum acx_ie type)
 int acx_configure_len(acx_device_t *adev, void *pdr, enum acx_ie type, u16 len)
 {
 	int res;
-	char msgbuf[255];
 
 	const u16 typeval = acx_ie_descs[type].val;
 	const char *typestr = acx_ie_descs[type].name;
@@ -136,13 +147,13 @@ int acx_configure_len(acx_device_t *adev, void *pdr, enum acx_ie type, u16 len)
 	((acx_ie_generic_t *) pdr)->len = cpu_to_le16(len);
 	res = acx_issue_cmd(adev, ACX1xx_CMD_CONFIGURE, pdr, len + 4);
 
-	sprintf(msgbuf, "%s: type=0x%04X, typestr=%s, len=%u",
-		wiphy_name(adev->hw->wiphy), typeval, typestr, len);
-
+	/* log() only formats when the channel is on */
 	if (likely(res == OK))
-		log(L_DEBUG,  "%s: OK\n", msgbuf);
-	 else
-		log(L_ANY,  "%s: FAILED\n", msgbuf);
+		log(L_DEBUG, "%s: type=0x%04X, typestr=%s, len=%u: OK\n",
+			wiphy_name(adev->hw->wiphy), typeval, typestr, len);
+	else
+		log(L_ANY, "%s: type=0x%04X, typestr=%s, len=%u: FAILED\n",
+			wiphy_name(adev->hw->wiphy), typeval, typestr, len);
 
 	return res;
 }
@@ -272,9 +283,18 @@ int acx_cmd_join_bssid(acx_device_t *adev, const u8 *bssid)
         return res;
 }
 
-int acx_cmd_scan(acx_device_t *adev)
+/*
+ * acx_cmd_scan
+ *
+ * Starts a firmware scan of the channels in chans (bit n: channel n + 1),
+ * min_dwell and max_dwell in TU, see acx111_scan_t.  The ACX111 takes a
+ * channel list; the ACX100 only a start channel, so it's given either
+ * one channel or all of them.
+ */
+int acx_cmd_scan(acx_device_t *adev, u16 chans, u8 options,
+		u16 min_dwell, u16 max_dwell)
 {
-	int res;
+	int res, chan;
 
         union {
                 acx111_scan_t acx111;
@@ -288,22 +308,27 @@ int acx_cmd_scan(acx_device_t *adev)
 
         s.acx111.count = cpu_to_le16(adev->scan_count);
         s.acx111.rate = adev->scan_rate;
-        s.acx111.options = adev->scan_mode;
-        s.acx111.chan_duration = cpu_to_le16(adev->scan_duration);
-        s.acx111.max_probe_delay = cpu_to_le16(adev->scan_probe_delay);
+        s.acx111.options = options;
+        s.acx111.chan_duration = cpu_to_le16(min_dwell);
+        s.acx111.max_probe_delay = cpu_to_le16(max_dwell);
 
         /* ...then differences */
 
         if (IS_ACX111(adev)) {
-                s.acx111.channel_list_select = 0; /* scan every allowed channel */
-                /*s.acx111.channel_list_select = 1;*/ /* scan given channels */
+                s.acx111.channel_list_select = 1; /* scan given channels */
                 /*s.acx111.modulation = 0x40;*/ /* long preamble? OFDM? -> only for active scan */
                 s.acx111.modulation = 0;
-                /*s.acx111.channel_list[0] = 6;
-                s.acx111.channel_list[1] = 4;*/
+		s.acx111.channel_list[0] = chans & 0xff;
+		s.acx111.channel_list[1] = chans >> 8;
         } else {
-                s.acx100.start_chan = cpu_to_le16(1);
-                s.acx100.flags = cpu_to_le16(0x8000);
+		chan = ffs(chans);
+                s.acx100.start_chan = cpu_to_le16(chan);
+		/* the flags are taken as a channel mask, with 0x8000 for
+		 * all of them */
+		if (chans == BIT(chan - 1))
+			s.acx100.flags = cpu_to_le16(chans);
+		else
+			s.acx100.flags = cpu_to_le16(0x8000);
         }
 
         res = acx_issue_cmd(adev, ACX1xx_CMD_SCAN, &s, sizeof(s));
@@ -59,6 +59,7 @@ int acx_configure_len(acx_device_t *adev, void *pdr, enum acx_ie type, u16 len);
 int acx_interrogate(acx_device_t *adev, void *pdr, enum acx_ie type);
 
 int acx_cmd_join_bssid(acx_device_t *adev, const u8 *bssid);
-int acx_cmd_scan(acx_device_t *adev);
+int acx_cmd_scan(acx_device_t *adev, u16 chans, u8 options,
+		u16 min_dwell, u16 max_dwell);
 
 #endif
@@ -25,6 +25,7 @@
 #include "debug.h"
 #include "mem.h"
 #include "pci.h"
+#include "sim.h"
 #include "cmd.h"
 #include "ie.h"
 #include "utils.h"
@@ -104,6 +105,7 @@ static int __init acx_init_module(void)
 	       "go to http://acx100.sourceforge.net/wiki for "
 	       "further information\n");
 
+	acx_debug_update();
 	acx_debugfs_init();
 
 	r1 = r2 = r3 = -EINVAL;
@@ -117,6 +119,10 @@ static int __init acx_init_module(void)
 		goto errout;
 	}
 
+	/* simulated devices are optional, don't fail the module for them */
+	if (acxsim_init_module())
+		pr_info("simulated device support not available\n");
+
 	/* return success if at least one succeeded */
 	return 0;
 
@@ -131,6 +137,7 @@ static void __exit acx_cleanup_module(void)
 	acxpci_cleanup_module();
 	acxusb_cleanup_module();
 	acxmem_cleanup_module();
+	acxsim_cleanup_module();
 
 	acx_debugfs_exit();
 }
@@ -151,13 +158,62 @@ unsigned int acx_watchdog_enable = 0;
 module_param_named(watchdog, acx_watchdog_enable, uint, 0644);
 MODULE_PARM_DESC(debug, "Enable watchdog");
 
+unsigned int acx_stations = ACX_STA_CONTEXTS_DEFAULT;
+module_param_named(stations, acx_stations, uint, 0444);
+MODULE_PARM_DESC(stations, "Station contexts in the acx111 firmware (1-32, default 1): "
+	"stations with one get their pairwise key offloaded");
+
+unsigned int acx_key_offload = ACX_KEY_OFFLOAD_DEFAULT;
+module_param_named(key_offload, acx_key_offload, uint, 0444);
+MODULE_PARM_DESC(key_offload, "Ciphers offloaded to the acx111 firmware: "
+	"1 WEP, 4 CCMP (default 4; WEP untested)");
+
 #if ACX_DEBUG
 
-/* will add __read_mostly later */
-unsigned int acx_debug = ACX_DEFAULT_MSG;
+unsigned int acx_debug __read_mostly = ACX_DEFAULT_MSG;
+
+#if ACX_DEBUG_STATIC_KEYS
+DEFINE_STATIC_KEY_FALSE(acx_debug_hot_key);
+DEFINE_STATIC_KEY_FALSE(acx_debug_any_key);
+#endif
+
+/* Must be called from process context after every change of
+ * acx_debug, so acx_debug_on() sees the new mask */
+void acx_debug_update(void)
+{
+#if ACX_DEBUG_STATIC_KEYS
+	if (acx_debug & L_HOTPATH)
+		static_branch_enable(&acx_debug_hot_key);
+	else
+		static_branch_disable(&acx_debug_hot_key);
+
+	if (acx_debug)
+		static_branch_enable(&acx_debug_any_key);
+	else
+		static_branch_disable(&acx_debug_any_key);
+#endif
+}
+
+#if ACX_DEBUG_STATIC_KEYS
+static int acx_debug_set(const char *val, const struct kernel_param *kp)
+{
+	int res = param_set_uint(val, kp);
+
+	if (!res)
+		acx_debug_update();
+	return res;
+}
 
+static struct kernel_param_ops acx_debug_ops = {
+	.set = acx_debug_set,
+	.get = param_get_uint,
+};
+/* parameter is 'debug', corresponding var is acx_debug */
+module_param_cb(debug, &acx_debug_ops, &acx_debug, 0644);
+#else
 /* parameter is 'debug', corresponding var is acx_debug */
 module_param_named(debug, acx_debug, uint, 0644);
+#endif
 MODULE_PARM_DESC(debug, "Debug level mask (see L_xxx constants)");
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 36)
@@ -220,9 +276,11 @@ static int acx_debug_flag_set(const char *val, const struct kernel_param *kp)
 		}
 		if (i == ARRAY_SIZE(flag_names)) {
 			pr_err("no match on val: %s\n", p);
+			acx_debug_update();
 			return -EINVAL;
 		}
 	}
+	acx_debug_update();
 	return 0;
 }
 
@@ -24,6 +24,7 @@
 #include <linux/wireless.h>
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
+#include <linux/vmalloc.h>
 #include <net/mac80211.h>
 
 #include "acx.h"
@@ -36,11 +37,24 @@
 #include "cardsetting.h"
 #include "main.h"
 #include "boot.h"
+#include "rx.h"
+#include "tx.h"
+#include "sim.h"
+#include "survey.h"
+#include "bcn_filter.h"
+#include "scan.h"
+#include "sta.h"
+#include "key.h"
 #include "debug.h"
 
 enum file_index {
 	INFO, DIAG, EEPROM, PHY, DEBUG,
 	SENSITIVITY, TX_LEVEL, ANTENNA, REG_DOMAIN,
+	USB_CMD, TX_RATES, RX_RATES, BENCH,
+	RX_CAPTURE, RX_REPLAY, FW_STATS, SURVEY,
+	RX_FILTER, BEACON_FILTER, POWER_SAVE, TIM,
+	SCAN, CHAN_SWITCH, STATIONS, KEYS,
+	TX_LIMITS,
 };
 static const char *const dbgfs_files[] = {
 	[INFO]		= "info",
@@ -52,9 +66,26 @@ static const char *const dbgfs_files[] = {
 	[TX_LEVEL]	= "tx_level",
 	[ANTENNA]	= "antenna",
 	[REG_DOMAIN]	= "reg_domain",
+	[USB_CMD]	= "usb_cmd",
+	[TX_RATES]	= "tx_rates",
+	[RX_RATES]	= "rx_rates",
+	[BENCH]		= "bench",
+	[RX_CAPTURE]	= "rx_capture",
+	[RX_REPLAY]	= "rx_replay",
+	[FW_STATS]	= "fw_stats",
+	[SURVEY]	= "survey",
+	[RX_FILTER]	= "rx_filter",
+	[BEACON_FILTER]	= "beacon_filter",
+	[POWER_SAVE]	= "power_save",
+	[TIM]		= "tim",
+	[SCAN]		= "scan",
+	[CHAN_SWITCH]	= "channel_switch",
+	[STATIONS]	= "stations",
+	[KEYS]		= "keys",
+	[TX_LIMITS]	= "tx_limits",
 };
-BUILD_BUG_DECL(dbgfs_files__VS__enum_REG_DOMAIN,
-	ARRAY_SIZE(dbgfs_files) != REG_DOMAIN + 1);
+BUILD_BUG_DECL(dbgfs_files__VS__enum_TX_LIMITS,
+	ARRAY_SIZE(dbgfs_files) != TX_LIMITS + 1);
 
 static struct dentry *acx_dbgfs_dir;
 
@@ -603,6 +634,7 @@ static ssize_t acx_dbgfs_write_debug(acx_device_t *adev, struct file *file,
 	if (count == size) {
 		ret = count;
 		acx_debug = val;
+		acx_debug_update();
 	}
 
 	log(L_ANY, "acx_debug=0x%04x\n", acx_debug);
@@ -798,6 +830,746 @@ out:
 	return ret;
 }
 
+static int acx_dbgfs_show_usb_cmd(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	if (IS_USB(adev))
+		acxusb_dbgfs_cmd_output(file, adev);
+	else
+		seq_printf(file, "not an USB device\n");
+
+	return 0;
+}
+
+static int acx_dbgfs_show_tx_rates(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	struct ieee80211_supported_band *sband;
+	struct acx_tx_rate_stat *st;
+	int i;
+
+	acx_sem_lock(adev);
+
+	sband = adev->hw->wiphy->bands[IEEE80211_BAND_2GHZ];
+	seq_printf(file, "%-6s %10s %10s %7s\n",
+		"rate", "attempts", "success", "succ%");
+	for (i = 0; i < sband->n_bitrates && i < ACX_TX_RATE_STATS_CNT; i++) {
+		st = &adev->tx_rate_stats[i];
+		seq_printf(file, "%3u.%u %10u %10u %6u%%\n",
+			sband->bitrates[i].bitrate / 10,
+			sband->bitrates[i].bitrate % 10,
+			st->attempts, st->success,
+			st->attempts ? st->success * 100 / st->attempts : 0);
+	}
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+static ssize_t acx_dbgfs_write_tx_rates(acx_device_t *adev, struct file *file,
+					const char __user *ubuf, size_t count,
+					loff_t *ppos)
+{
+	/* any write resets the table */
+	acx_sem_lock(adev);
+	memset(adev->tx_rate_stats, 0, sizeof(adev->tx_rate_stats));
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_rx_rates(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	struct ieee80211_supported_band *sband;
+	int i;
+
+	acx_sem_lock(adev);
+
+	sband = adev->hw->wiphy->bands[IEEE80211_BAND_2GHZ];
+	seq_printf(file, "%-7s %10s\n", "rate", "frames");
+	for (i = 0; i < sband->n_bitrates && i < ACX_RX_RATE_STATS_CNT; i++)
+		seq_printf(file, "%3u.%u   %10u\n",
+			sband->bitrates[i].bitrate / 10,
+			sband->bitrates[i].bitrate % 10,
+			adev->rx_rate_hist[i]);
+	seq_printf(file, "%-7s %10u\n", "unknown",
+		adev->rx_rate_hist[ACX_RX_RATE_STATS_CNT]);
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+static ssize_t acx_dbgfs_write_rx_rates(acx_device_t *adev, struct file *file,
+					const char __user *ubuf, size_t count,
+					loff_t *ppos)
+{
+	/* any write resets the histogram */
+	acx_sem_lock(adev);
+	memset(adev->rx_rate_hist, 0, sizeof(adev->rx_rate_hist));
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_bench(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	/* takes the sem itself, for the whole run */
+	if (IS_SIM(adev))
+		acxsim_dbgfs_bench_output(file, adev);
+	else
+		seq_printf(file, "not a simulated device\n");
+
+	return 0;
+}
+
+static ssize_t acx_dbgfs_write_bench(acx_device_t *adev, struct file *file,
+				const char __user *ubuf, size_t count,
+				loff_t *ppos)
+{
+	ssize_t ret = -EINVAL;
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	if (!IS_SIM(adev))
+		return -ENODEV;
+
+	/* frames per size */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+
+	if (count == size) {
+		acx_sem_lock(adev);
+		ret = acxsim_set_bench_frames(adev, val);
+		acx_sem_unlock(adev);
+		if (!ret)
+			ret = count;
+	}
+
+	return ret;
+}
+
+static int acx_dbgfs_show_rx_capture(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	int res;
+
+	/* binary, see rx.h */
+	acx_sem_lock(adev);
+	res = acx_rx_capture_output(file, adev);
+	acx_sem_unlock(adev);
+
+	return res;
+}
+
+static ssize_t acx_dbgfs_write_rx_capture(acx_device_t *adev, struct file *file,
+					const char __user *ubuf, size_t count,
+					loff_t *ppos)
+{
+	ssize_t ret = -EINVAL;
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* buffer size in KB to start a capture, 0 to stop it */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+
+	if (count != size || val > ACX_RXCAP_MAX_KB)
+		return ret;
+
+	ret = 0;
+	acx_sem_lock(adev);
+	if (val)
+		ret = acx_rx_capture_start(adev, val * 1024);
+	else
+		acx_rx_capture_stop(adev);
+	acx_sem_unlock(adev);
+
+	return ret ? ret : count;
+}
+
+static int acx_dbgfs_show_rx_replay(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	/* takes the sem itself, for the whole run */
+	if (IS_SIM(adev))
+		acxsim_dbgfs_replay_output(file, adev);
+	else
+		seq_printf(file, "not a simulated device\n");
+
+	return 0;
+}
+
+static ssize_t acx_dbgfs_write_rx_replay(acx_device_t *adev, struct file *file,
+					const char __user *ubuf, size_t count,
+					loff_t *ppos)
+{
+	ssize_t ret;
+
+	if (!IS_SIM(adev))
+		return -ENODEV;
+
+	/* the capture to replay, as read from rx_capture */
+	acx_sem_lock(adev);
+	ret = acxsim_replay_write(adev, ubuf, count, ppos);
+	acx_sem_unlock(adev);
+
+	return ret;
+}
+
+/*
+ * Firmware statistics sampler
+ *
+ * Every fw_stats_ring->interval seconds the watchdog reads
+ * ACX1xx_IE_FIRMWARE_STATISTICS and keeps the increase of each counter
+ * in a ring of the last ACX_FW_STATS_RING samples, read as CSV from
+ * the "fw_stats" debugfs file.  Writing the interval in seconds
+ * (re)starts sampling, 0 stops it.
+ */
+
+/* fw_stats_t counters, in the order of struct acx_fw_stats_sample */
+static const char *const acx_fw_stats_names[] = {
+	"tx_desc_of",
+	"rx_oom", "rx_hdr_of", "rx_hw_stuck", "rx_dropped_frame",
+	"rx_frame_ptr_err", "rx_xfr_hint_trig", "rx_aci_events",
+	"rx_aci_resets",
+	"rx_dma_req", "rx_dma_err", "tx_dma_req", "tx_dma_err",
+	"cmd_cplt", "fiq", "rx_hdrs", "rx_cmplt", "rx_mem_of", "rx_rdys",
+	"irqs", "tx_procs", "decrypt_done", "dma_0_done", "dma_1_done",
+	"tx_exch_complet", "commands", "rx_procs", "hw_pm_mode_changes",
+	"host_acks", "pci_pm", "acm_wakeups",
+	"wep_key_count", "wep_default_key_count", "dot11_def_key_mib",
+	"wep_key_not_found", "wep_decrypt_fail", "wep_pkt_decrypt",
+	"wep_decrypt_irqs",
+	"tx_start_ctr", "no_ps_tx_too_short", "rx_start_ctr",
+	"no_ps_rx_too_short", "lppd_started", "no_lppd_too_noisy",
+	"no_lppd_too_short", "no_lppd_matching_frame",
+	"mic_rx_pkts", "mic_calc_fail",
+	"aes_enc_fail", "aes_dec_fail", "aes_enc_pkts", "aes_dec_pkts",
+	"aes_enc_irq", "aes_dec_irq",
+	"heartbeat", "calibration", "rx_mismatch", "rx_mem_empty",
+	"rx_pool", "oom_late", "phy_tx_err", "tx_stuck",
+};
+BUILD_BUG_DECL(acx_fw_stats_names__VS__ACX_FW_STATS_WORDS,
+	ARRAY_SIZE(acx_fw_stats_names) != ACX_FW_STATS_WORDS);
+
+#define FW_STATS_WORD(member) \
+	((offsetof(fw_stats_t, member) - offsetof(fw_stats_t, tx)) / sizeof(u32))
+
+/* at least ACX100 PCI F/W 1.9.8.b and ACX100 USB F/W 1.0.7-USB don't
+ * have these, see acx_dbgfs_show_diag() */
+static int acx_fw_stats_acx111_only(unsigned int i)
+{
+	return i == FW_STATS_WORD(rx.rx_aci_events)
+		|| i == FW_STATS_WORD(rx.rx_aci_resets)
+		|| i == FW_STATS_WORD(wep.wep_pkt_decrypt)
+		|| i == FW_STATS_WORD(wep.wep_decrypt_irqs);
+}
+
+/* Unpacks the firmware's counters into the acx111 layout */
+static void acx_fw_stats_words(acx_device_t *adev, const fw_stats_t *fw_stats,
+			u32 *words)
+{
+	const u32 *raw = (const u32 *) &fw_stats->tx;
+	unsigned int i, r = 0, nraw;
+
+	/* len as interpreted by acx_dbgfs_show_diag() */
+	nraw = min_t(unsigned int, le16_to_cpu(fw_stats->len),
+		sizeof(*fw_stats));
+	nraw = (nraw > 2 * sizeof(u16)) ? (nraw - 2 * sizeof(u16)) / 4 : 0;
+
+	for (i = 0; i < ACX_FW_STATS_WORDS; i++) {
+		if (IS_ACX100(adev) && acx_fw_stats_acx111_only(i))
+			words[i] = 0;
+		else
+			words[i] = (r < nraw) ? le32_to_cpu(raw[r++]) : 0;
+	}
+}
+
+/*
+ * acx_fw_stats_sample
+ *
+ * Called from the watchdog every second with the sem held, takes a
+ * sample when the interval has passed.
+ */
+void acx_fw_stats_sample(acx_device_t *adev)
+{
+	struct acx_fw_stats_ring *ring;
+	struct acx_fw_stats_sample *sample;
+	fw_stats_t *fw_stats;
+	u32 words[ACX_FW_STATS_WORDS];
+	unsigned long now = jiffies;
+	int i;
+
+	ring = adev->fw_stats_ring;
+	if (!ring || !ring->interval)
+		return;
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags)) {
+		ring->have_prev = 0;
+		return;
+	}
+	if (ring->have_prev
+	    && time_before(now, ring->last + ring->interval * HZ))
+		return;
+
+	fw_stats = kzalloc(sizeof(*fw_stats), GFP_KERNEL);
+	if (!fw_stats)
+		return;
+	if (OK != acx_interrogate(adev, fw_stats,
+				ACX1xx_IE_FIRMWARE_STATISTICS))
+		goto out;
+	acx_fw_stats_words(adev, fw_stats, words);
+
+	if (ring->have_prev) {
+		sample = &ring->samples[ring->head];
+		sample->time_ms = jiffies_to_msecs(now - ring->start);
+		sample->interval_ms = jiffies_to_msecs(now - ring->last);
+		/* counters going backwards: the firmware was reset */
+		for (i = 0; i < ACX_FW_STATS_WORDS; i++)
+			sample->delta[i] = (words[i] >= ring->prev[i])
+				? words[i] - ring->prev[i] : words[i];
+
+		ring->head = (ring->head + 1) % ACX_FW_STATS_RING;
+		if (ring->count < ACX_FW_STATS_RING)
+			ring->count++;
+	}
+	memcpy(ring->prev, words, sizeof(words));
+	ring->have_prev = 1;
+	ring->last = now;
+
+out:
+	kfree(fw_stats);
+}
+
+static int acx_dbgfs_show_fw_stats(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	struct acx_fw_stats_ring *ring;
+	struct acx_fw_stats_sample *sample;
+	unsigned int i, j;
+
+	acx_sem_lock(adev);
+
+	ring = adev->fw_stats_ring;
+	if (!ring)
+		goto out;
+
+	/* oldest first */
+	seq_printf(file, "time_ms,interval_ms");
+	for (j = 0; j < ACX_FW_STATS_WORDS; j++)
+		seq_printf(file, ",%s", acx_fw_stats_names[j]);
+	seq_printf(file, "\n");
+
+	for (i = 0; i < ring->count; i++) {
+		sample = &ring->samples[(ring->head + ACX_FW_STATS_RING
+					- ring->count + i) % ACX_FW_STATS_RING];
+		seq_printf(file, "%u,%u", sample->time_ms,
+			sample->interval_ms);
+		for (j = 0; j < ACX_FW_STATS_WORDS; j++)
+			seq_printf(file, ",%u", sample->delta[j]);
+		seq_printf(file, "\n");
+	}
+out:
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+static ssize_t acx_dbgfs_write_fw_stats(acx_device_t *adev, struct file *file,
+					const char __user *ubuf, size_t count,
+					loff_t *ppos)
+{
+	struct acx_fw_stats_ring *ring;
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* sampling interval in seconds, 0 stops */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+	if (count != size || val > 3600)
+		return -EINVAL;
+
+	acx_sem_lock(adev);
+
+	ring = adev->fw_stats_ring;
+	if (!val) {
+		if (ring)
+			ring->interval = 0;
+		goto out;
+	}
+
+	if (!ring) {
+		ring = vmalloc(sizeof(*ring));
+		if (!ring) {
+			acx_sem_unlock(adev);
+			return -ENOMEM;
+		}
+		adev->fw_stats_ring = ring;
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->interval = val;
+	ring->start = jiffies;
+out:
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_survey(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	/* takes the sem itself */
+	return acx_survey_dbgfs_output(file, adev);
+}
+
+static ssize_t acx_dbgfs_write_survey(acx_device_t *adev, struct file *file,
+				const char __user *ubuf, size_t count,
+				loff_t *ppos)
+{
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* 0 clears the totals and history */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+	if (count != size || val)
+		return -EINVAL;
+
+	acx_sem_lock(adev);
+	acx_survey_reset(adev);
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_rx_filter(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	struct acx_rx_filter_stats *st = &adev->rx_filter_stats;
+
+	acx_sem_lock(adev);
+
+	seq_printf(file,
+		"mac80211 flags:\t0x%08x\n"
+		"rx_config_1:\t0x%04x\n"
+		"rx_config_2:\t0x%04x\n"
+		"mc groups:\t%s%u\n"
+		"updates:\t%lu\n"
+		"unchanged:\t%lu\n"
+		"dropped by mac80211, could be filtered by the firmware:\n"
+		"control:\t%lu\n"
+		"probe_req:\t%lu\n"
+		"other_bss:\t%lu\n",
+		adev->rx_filter_flags,
+		adev->rx_config_1, adev->rx_config_2,
+		adev->mc_filter ? "" : "all, ", adev->mc_list.count,
+		st->updates, st->unchanged,
+		st->sw_control, st->sw_probe_req, st->sw_other_bss);
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+static ssize_t acx_dbgfs_write_rx_filter(acx_device_t *adev, struct file *file,
+				const char __user *ubuf, size_t count,
+				loff_t *ppos)
+{
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* 0 clears the counters */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+	if (count != size || val)
+		return -EINVAL;
+
+	acx_sem_lock(adev);
+	memset(&adev->rx_filter_stats, 0, sizeof(adev->rx_filter_stats));
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_beacon_filter(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	/* takes the sem itself */
+	return acx_bcn_filter_dbgfs_output(file, adev);
+}
+
+static ssize_t acx_dbgfs_write_beacon_filter(acx_device_t *adev,
+				struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* 0 turns the firmware filter off, 1 back on */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+	if (count != size || val > 1)
+		return -EINVAL;
+
+	acx_sem_lock(adev);
+	adev->bcn_filter.disabled = !val;
+	acx_bcn_filter_update(adev);
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_power_save(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	struct acx_ps_stats *st = &adev->ps_stats;
+	u64 doze_ms;
+
+	acx_sem_lock(adev);
+
+	doze_ms = st->doze_ms;
+	if (adev->ps_enabled)
+		doze_ms += jiffies_to_msecs(jiffies - st->doze_start);
+
+	seq_printf(file,
+		"state:\t%s\n"
+		"wakeup_cfg:\t0x%02x\n"
+		"options:\t0x%02x\n"
+		"dtim period:\t%u\n"
+		"hangover:\t%u ms (%s)\n"
+		"dynamic timeout:\t%d ms\n"
+		"enter:\t%lu\n"
+		"exit:\t%lu\n"
+		"failed:\t%lu\n"
+		"tx wakes:\t%lu\n"
+		"time in ps:\t%llu ms\n",
+		adev->ps_enabled ? "on" : "off",
+		adev->ps_wakeup_cfg, adev->ps_options, adev->ps_dtim_period,
+		adev->ps_hangover_period,
+		adev->ps_hangover_user ? "debugfs" : "auto",
+		adev->ps_dynamic_timeout,
+		st->enter, st->exit, st->failed, st->tx_wakes,
+		(unsigned long long) doze_ms);
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+static ssize_t acx_dbgfs_write_power_save(acx_device_t *adev,
+				struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* the hangover in ms, 0 follows mac80211's dynamic_ps_timeout */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+	if (count != size
+	    || (val && (val < ACX_PS_HANGOVER_MIN
+			|| val > ACX_PS_HANGOVER_MAX)))
+		return -EINVAL;
+
+	acx_sem_lock(adev);
+	adev->ps_hangover_user = val;
+	if (adev->ps_enabled)
+		acx_set_powersave(adev, 1);
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_tim(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	struct acx_tim *tim = &adev->tim;
+	unsigned int aid;
+
+	acx_sem_lock(adev);
+
+	seq_printf(file,
+		"set_tim:\t%lu\n"
+		"coalesced:\t%lu\n"
+		"writes:\t%lu\n"
+		"unchanged:\t%lu\n"
+		"failed:\t%lu\n"
+		"dtim period:\t%u\n"
+		"beacon:\t%d bytes, TIM at %d\n"
+		"aids:",
+		tim->set_calls, tim->coalesced, tim->writes, tim->unchanged,
+		tim->failed, tim->dtim_period,
+		tim->beacon ? tim->beacon_len : 0, tim->head_len);
+	for (aid = 1; aid < ACX_TIM_BITMAP_LEN * 8; aid++)
+		if (tim->written[aid / 8] & (1 << (aid % 8)))
+			seq_printf(file, " %u", aid);
+	seq_printf(file, "\n");
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+static int acx_dbgfs_show_scan(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	return acx_scan_dbgfs_output(file, adev);
+}
+
+static ssize_t acx_dbgfs_write_scan(acx_device_t *adev,
+				struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* 0: scans always leave our channel for the whole sweep, 1:
+	 * background scans while associated */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+	if (count != size || val > 1)
+		return -EINVAL;
+
+	acx_sem_lock(adev);
+	if (val)
+		SET_BIT(adev->scan_mode, ACX_SCAN_OPT_BACKGROUND);
+	else
+		CLEAR_BIT(adev->scan_mode, ACX_SCAN_OPT_BACKGROUND);
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_chan_switch(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+	struct acx_chan_switch *cs = &adev->chan_switch;
+
+	acx_sem_lock(adev);
+
+	seq_printf(file,
+		"channel:\t%u (tx %u, rx %u)\n"
+		"switches:\t%lu\n"
+		"skipped:\t%lu\n"
+		"failed:\t%lu\n"
+		"announced:\t%lu\n"
+		"last:\t%u us\n"
+		"max:\t%u us\n"
+		"avg:\t%u us\n",
+		adev->channel, cs->tx_chan, cs->rx_chan, cs->switches,
+		cs->skipped, cs->failed, cs->csa, cs->last_us, cs->max_us,
+		cs->switches ? (u32) div_u64(cs->total_us, cs->switches) : 0);
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+static int acx_dbgfs_show_stations(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	return acx_sta_dbgfs_output(file, adev);
+}
+
+static int acx_dbgfs_show_keys(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	return acx_key_dbgfs_output(file, adev);
+}
+
+static ssize_t acx_dbgfs_write_keys(acx_device_t *adev,
+				struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char *after, buf[32];
+	unsigned long val;
+	size_t size, len;
+
+	/* the ciphers to offload, ACX_KEY_OFFLOAD_*: 0 for software
+	 * crypto only, to compare */
+	len = min(count, sizeof(buf) - 1);
+	if (unlikely(copy_from_user(buf, ubuf, len)))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	val = simple_strtoul(buf, &after, 0);
+	size = after - buf + 1;
+	if (count != size || (val & ~ACX_KEY_OFFLOAD_ALL))
+		return -EINVAL;
+
+	acx_sem_lock(adev);
+	acx_key_set_offload(adev, val);
+	acx_sem_unlock(adev);
+
+	return count;
+}
+
+static int acx_dbgfs_show_tx_limits(struct seq_file *file, void *v)
+{
+	acx_device_t *adev = (acx_device_t *) file->private;
+
+	return acx_tx_dql_dbgfs_output(file, adev);
+}
+
 static acx_dbgfs_show_t *const acx_dbgfs_show_funcs[] = {
 	acx_dbgfs_show_acx,
 	acx_dbgfs_show_diag,
@@ -808,6 +1580,23 @@ static acx_dbgfs_show_t *const acx_dbgfs_show_funcs[] = {
 	acx_dbgfs_show_tx_level,
 	acx_dbgfs_show_antenna,
 	acx_dbgfs_show_reg_domain,
+	acx_dbgfs_show_usb_cmd,
+	acx_dbgfs_show_tx_rates,
+	acx_dbgfs_show_rx_rates,
+	acx_dbgfs_show_bench,
+	acx_dbgfs_show_rx_capture,
+	acx_dbgfs_show_rx_replay,
+	acx_dbgfs_show_fw_stats,
+	acx_dbgfs_show_survey,
+	acx_dbgfs_show_rx_filter,
+	acx_dbgfs_show_beacon_filter,
+	acx_dbgfs_show_power_save,
+	acx_dbgfs_show_tim,
+	acx_dbgfs_show_scan,
+	acx_dbgfs_show_chan_switch,
+	acx_dbgfs_show_stations,
+	acx_dbgfs_show_keys,
+	acx_dbgfs_show_tx_limits,
 };
 
 static acx_dbgfs_write_t *const acx_dbgfs_write_funcs[] = {
@@ -820,6 +1609,23 @@ static acx_dbgfs_write_t *const acx_dbgfs_write_funcs[] = {
 	acx_dbgfs_write_tx_level,
 	acx_dbgfs_write_antenna,
 	acx_dbgfs_write_reg_domain,
+	NULL,
+	acx_dbgfs_write_tx_rates,
+	acx_dbgfs_write_rx_rates,
+	acx_dbgfs_write_bench,
+	acx_dbgfs_write_rx_capture,
+	acx_dbgfs_write_rx_replay,
+	acx_dbgfs_write_fw_stats,
+	acx_dbgfs_write_survey,
+	acx_dbgfs_write_rx_filter,
+	acx_dbgfs_write_beacon_filter,
+	acx_dbgfs_write_power_save,
+	NULL,
+	acx_dbgfs_write_scan,
+	NULL,
+	NULL,
+	acx_dbgfs_write_keys,
+	NULL,
 };
 BUILD_BUG_DECL(acx_proc_show_funcs__VS__acx_proc_write_funcs,
 	ARRAY_SIZE(acx_dbgfs_show_funcs) != ARRAY_SIZE(acx_dbgfs_write_funcs));
@@ -840,6 +1646,23 @@ static int acx_dbgfs_open(struct inode *inode, struct file *file)
 	case TX_LEVEL:
 	case ANTENNA:
 	case REG_DOMAIN:
+	case USB_CMD:
+	case TX_RATES:
+	case RX_RATES:
+	case BENCH:
+	case RX_CAPTURE:
+	case RX_REPLAY:
+	case FW_STATS:
+	case SURVEY:
+	case RX_FILTER:
+	case BEACON_FILTER:
+	case POWER_SAVE:
+	case TIM:
+	case SCAN:
+	case CHAN_SWITCH:
+	case STATIONS:
+	case KEYS:
+	case TX_LIMITS:
 		pr_devel("opening filename=%s fmode=%o fidx=%d adev=%p\n",
 			dbgfs_files[fidx], file->f_mode, (int)fidx, adev);
 		break;
@@ -869,6 +1692,23 @@ static ssize_t acx_dbgfs_write(struct file *file, const char __user *buf,
 	case TX_LEVEL:
 	case ANTENNA:
 	case REG_DOMAIN:
+	case USB_CMD:
+	case TX_RATES:
+	case RX_RATES:
+	case BENCH:
+	case RX_CAPTURE:
+	case RX_REPLAY:
+	case FW_STATS:
+	case SURVEY:
+	case RX_FILTER:
+	case BEACON_FILTER:
+	case POWER_SAVE:
+	case TIM:
+	case SCAN:
+	case CHAN_SWITCH:
+	case STATIONS:
+	case KEYS:
+	case TX_LIMITS:
 		pr_devel("opening filename=%s fmode=%o fidx=%d adev=%p\n",
 			dbgfs_files[fidx], file->f_mode, (int)fidx, adev);
 		break;
@@ -936,6 +1776,9 @@ fail:
 void acx_debugfs_remove_adev(struct acx_device *adev)
 {
 	debugfs_remove_recursive(adev->debugfs_dir);
+	acx_rx_capture_free(adev);
+	vfree(adev->fw_stats_ring);
+	adev->fw_stats_ring = NULL;
 	pr_info("%s %p\n", wiphy_name(adev->hw->wiphy),
 		adev->debugfs_dir);
 	adev->debugfs_dir = NULL;
@@ -10,6 +10,7 @@ int acx_debugfs_add_adev(struct acx_device *adev);
 void acx_debugfs_remove_adev(struct acx_device *adev);
 int __init acx_debugfs_init(void);
 void acx_debugfs_exit(void);
+void acx_fw_stats_sample(acx_device_t *adev);
 
 #else
 
@@ -17,6 +18,7 @@ static int acx_debugfs_add_adev(struct acx_device *adev) { return 0; }
 static void acx_debugfs_remove_adev(struct acx_device *adev) { }
 static int __init acx_debugfs_init(void)  { return 0; }
 static void acx_debugfs_exit(void) { }
+static inline void acx_fw_stats_sample(acx_device_t *adev) { }
 
 #endif /* defined CONFIG_DEBUG_FS */
 
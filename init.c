@@ -208,9 +208,11 @@ static int acx111_create_dma_regions(acx_device_t *adev)
 	}
 
 	memset(&memconf, 0, sizeof(memconf));
-	/* the number of STAs (STA contexts) to support
-	 ** NB: was set to 1 and everything seemed to work nevertheless... */
-	memconf.no_of_stations = 1; //cpu_to_le16(ARRAY_SIZE(adev->sta_list));
+	/* the number of STAs (STA contexts) to support, see sta.c: 1
+	 ** unless the stations module parameter asks for more */
+	adev->sta.contexts = clamp_t(unsigned int, acx_stations, 1,
+				ACX_STA_MAX);
+	memconf.no_of_stations = cpu_to_le16(adev->sta.contexts);
 
 	/* specify the memory block size. Default is 256 */
 	memconf.memory_block_size = cpu_to_le16(adev->memblocksize);
@@ -1,6 +1,8 @@
 #ifndef _INLINES_H_
 #define _INLINES_H_
 
+#include "sim.h"
+
 /* ##################################################
  * BOM Data Access
  * Locking in mem
@@ -151,6 +153,9 @@ INLINE_IO u32 read_reg32(acx_device_t *adev, unsigned int offset)
 	u32 val;
 	u32 addr;
 
+	if (IS_SIM(adev))
+		return acxsim_read_reg(adev, offset);
+
 	if (IS_PCI(adev)) {
 		#if ACX_IO_WIDTH == 32
 		return acx_readl(adev->iobase + adev->io[offset]);
@@ -176,6 +181,9 @@ INLINE_IO u16 read_reg16(acx_device_t *adev, unsigned int offset)
 	u16 lo;
 	u32 addr;
 
+	if (IS_SIM(adev))
+		return acxsim_read_reg(adev, offset);
+
 	if (IS_PCI(adev))
 		return acx_readw(adev->iobase + adev->io[offset]);
 
@@ -196,6 +204,9 @@ INLINE_IO u8 read_reg8(acx_device_t *adev, unsigned int offset)
 	u8 lo;
 	u32 addr;
 
+	if (IS_SIM(adev))
+		return acxsim_read_reg(adev, offset);
+
 	if (IS_PCI(adev))
 		return readb(adev->iobase + adev->io[offset]);
 
@@ -215,6 +226,11 @@ INLINE_IO void write_reg32(acx_device_t *adev, unsigned int offset, u32 val)
 {
 	u32 addr;
 
+	if (IS_SIM(adev)) {
+		acxsim_write_reg(adev, offset, val);
+		return;
+	}
+
 	if (IS_PCI(adev)) {
 		#if ACX_IO_WIDTH == 32
 		acx_writel(val, adev->iobase + adev->io[offset]);
@@ -239,6 +255,11 @@ INLINE_IO void write_reg16(acx_device_t *adev, unsigned int offset, u16 val)
 {
 	u32 addr;
 
+	if (IS_SIM(adev)) {
+		acxsim_write_reg(adev, offset, val);
+		return;
+	}
+
 	if (IS_PCI(adev)) {
 		acx_writew(val, adev->iobase + adev->io[offset]);
 		return;
@@ -257,6 +278,11 @@ INLINE_IO void write_reg8(acx_device_t *adev, unsigned int offset, u8 val)
 {
 	u32 addr;
 
+	if (IS_SIM(adev)) {
+		acxsim_write_reg(adev, offset, val);
+		return;
+	}
+
 	if (IS_PCI(adev)) {
 		writeb(val, adev->iobase + adev->io[offset]);
 		return;
@@ -283,6 +309,8 @@ INLINE_IO void write_reg8(acx_device_t *adev, unsigned int offset, u8 val)
 INLINE_IO void write_flush(acx_device_t *adev)
 {
 	/* readb(adev->iobase + adev->io[IO_ACX_INFO_MAILBOX_OFFS]); */
+	if (IS_SIM(adev))
+		return;
 	if (IS_PCI(adev)) {
 		/* faster version (accesses the first register,
 		 * IO_ACX_SOFT_RESET, which should also be safe): */
@@ -10,7 +10,7 @@
 
 #include "acx_struct_dev.h"
 
-#define DEVTYPE_MAX	3
+#define DEVTYPE_MAX	4
 #define CHIPTYPE_MAX	3
 
 static u16 interrupt_masks[DEVTYPE_MAX][CHIPTYPE_MAX] = {
@@ -95,6 +95,20 @@ static u16 interrupt_masks[DEVTYPE_MAX][CHIPTYPE_MAX] = {
 			| HOST_INT_FCS_THRESHOLD
 			/* | HOST_INT_UNKNOWN        */
 			),
+	},
+
+	/* same as PCI, the simulated firmware raises just these */
+	[ DEVTYPE_SIM ] = {
+		[ CHIPTYPE_ACX111 ]
+		= (u16) ~ (0
+			| HOST_INT_TX_COMPLETE
+			| HOST_INT_RX_COMPLETE
+			| HOST_INT_IV_ICV_FAILURE
+			| HOST_INT_CMD_COMPLETE
+			| HOST_INT_INFO
+			| HOST_INT_SCAN_COMPLETE
+			| HOST_INT_FCS_THRESHOLD
+			),
 	}
 };
 
@@ -102,7 +116,7 @@ static u16 interrupt_masks[DEVTYPE_MAX][CHIPTYPE_MAX] = {
 inline void interrupt_sanity_checks(void) {}
 #else
 
-static const char *devtype_names[] = { "PCI", "USB", "MEM" };
+static const char *devtype_names[] = { "PCI", "USB", "MEM", "SIM" };
 static const char *chiptype_names[] = { "", "ACX100", "ACX111" };
 
 /* defd to textually match #define table in acx-struct-hw (then reordered) */
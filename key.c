@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2012
+ * The ACX100 Open Source Project <acx100-devel@lists.sourceforge.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hardware key table
+ *
+ * The ACX111 firmware does WEP (40 and 104 bit), TKIP and CCMP.  It
+ * keeps a pairwise key in the context of each station (see sta.c) and
+ * the group, or WEP default, keys by key index.  A pairwise key
+ * goes to the firmware when its station got a context, a group key
+ * when its index fits; otherwise set_key fails and mac80211 does the
+ * crypto of that key in software.  So only the keys which don't fit
+ * the firmware cost host CPU, not every key once one didn't.
+ *
+ * Keys go away with DISABLE_KEY, or with their station: a station
+ * removed with its key still in the firmware has it evicted.
+ *
+ * On tx, frames mac80211 left to us to encrypt (a hw_key) go on an
+ * encrypting queue, all others on NOENC_QUEUE_ID.  On rx, protected
+ * frames from a station with a hardware key, group frames while we
+ * have a group key, and with a WEP default key the frames of stations
+ * without a pairwise key, are reported decrypted; everything else is
+ * left to mac80211.  The rx buffer header has no decryption status,
+ * so as before this relies on the firmware decrypting whatever it has
+ * the key for.
+ *
+ * Only CCMP is offloaded by default.  WEP is still to be verified on
+ * the hardware and needs the key_offload module parameter.  TKIP stays
+ * in software: the order the firmware wants the MIC keys in is
+ * unknown.
+ * The ciphers offloaded can also be chosen in the debugfs "keys" file,
+ * to compare hardware and software crypto throughput; it applies to
+ * the keys set from then on, i.e. after the next (re)association.
+ *
+ * The ACX100 encrypts only with the host off (FEATURE2_NO_TXCRYPT is
+ * ACX111 only), so it's left to software crypto.
+ */
+
+#include "acx_debug.h"
+
+#include <linux/seq_file.h>
+#include <net/mac80211.h>
+
+#include "acx.h"
+#include "cmd.h"
+#include "ie.h"
+#include "sta.h"
+#include "key.h"
+
+/* The key types of the ACX111 key command, based on wl1251 */
+static int acx_key_algo(struct ieee80211_key_conf *key)
+{
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 37)
+	switch (key->alg) {
+	case ALG_WEP:
+		return key->keylen == 5 ?
+			ACX_SEC_ALGO_WEP : ACX_SEC_ALGO_WEP104;
+	case ALG_TKIP:
+		return ACX_SEC_ALGO_TKIP;
+	case ALG_CCMP:
+		return ACX_SEC_ALGO_AES;
+	default:
+		return ACX_SEC_ALGO_NONE;
+	}
+#else
+	switch (key->cipher) {
+	case WLAN_CIPHER_SUITE_WEP40:
+		return ACX_SEC_ALGO_WEP;
+	case WLAN_CIPHER_SUITE_WEP104:
+		return ACX_SEC_ALGO_WEP104;
+	case WLAN_CIPHER_SUITE_TKIP:
+		return ACX_SEC_ALGO_TKIP;
+	case WLAN_CIPHER_SUITE_CCMP:
+		return ACX_SEC_ALGO_AES;
+	default:
+		return ACX_SEC_ALGO_NONE;
+	}
+#endif
+}
+
+static unsigned int acx_key_offload_bit(int algo)
+{
+	switch (algo) {
+	case ACX_SEC_ALGO_WEP:
+	case ACX_SEC_ALGO_WEP104:
+		return ACX_KEY_OFFLOAD_WEP;
+	case ACX_SEC_ALGO_AES:
+		return ACX_KEY_OFFLOAD_CCMP;
+	default:
+		return 0;
+	}
+}
+
+static int acx111_set_key_type(acx_device_t *adev, acx111WEPDefaultKey_t *key,
+                               struct ieee80211_key_conf *mac80211_key,
+                               const u8 *addr)
+{
+	int group = is_broadcast_ether_addr(addr);
+
+	switch (acx_key_algo(mac80211_key)) {
+	case ACX_SEC_ALGO_WEP:
+	case ACX_SEC_ALGO_WEP104:
+		key->type = group ? KEY_WEP_DEFAULT : KEY_WEP_ADDR;
+		break;
+	case ACX_SEC_ALGO_AES:
+		key->type = group ? KEY_AES_GROUP : KEY_AES_PAIRWISE;
+		break;
+	default:
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+		log(L_INIT, "Unknown key cipher 0x%x", mac80211_key->cipher);
+#endif
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+
+static int acx111_set_key(acx_device_t *adev, enum set_key_cmd cmd,
+                          const u8 *addr, struct ieee80211_key_conf *key)
+{
+	int ret = -1;
+	acx111WEPDefaultKey_t dk;
+
+	memset(&dk, 0, sizeof(dk));
+
+	switch (cmd) {
+	case SET_KEY:
+		dk.action = cpu_to_le16(KEY_ADD_OR_REPLACE);
+		break;
+	case DISABLE_KEY:
+		dk.action = cpu_to_le16(KEY_REMOVE);
+		break;
+	default:
+		log(L_INIT, "Unsupported key cmd 0x%x", cmd);
+		break;
+	}
+
+	ret = acx111_set_key_type(adev, &dk, key, addr);
+	if (ret < 0) {
+		log(L_INIT, "Set KEY type failed");
+		return ret;
+	}
+
+	memcpy(dk.MacAddr, addr, ETH_ALEN);
+
+	dk.keySize = key->keylen;
+	dk.defaultKeyNum = key->keyidx; /* ignored when setting default key */
+	dk.index = 0;
+
+	memcpy(dk.key, key->key, dk.keySize);
+
+	ret = acx_issue_cmd(adev, ACX1xx_CMD_WEP_MGMT, &dk, sizeof(dk));
+
+	return ret;
+}
+
+/* The key index the firmware uses for our group frames, as AP */
+static void acx111_key_choose(acx_device_t *adev, u8 keyidx)
+{
+	struct {
+		u16 type;
+		u16 len;
+		u8 val;
+		u8 reserved[3];
+	} ACX_PACKED keyindic;
+
+	memset(&keyindic, 0, sizeof(keyindic));
+	keyindic.val = keyidx;
+	if (OK != acx_configure(adev, &keyindic, ACX111_IE_KEY_CHOOSE))
+		log(L_INIT, "KEY_CHOOSE %u failed\n", keyidx);
+}
+
+/* The WEP default key the firmware encrypts with */
+static void acx_key_set_wep_default(acx_device_t *adev, u8 keyidx)
+{
+	ie_dot11WEPDefaultKeyID_t dkey;
+
+	memset(&dkey, 0, sizeof(dkey));
+	dkey.KeyID = keyidx;
+	log(L_INIT, "setting WEP key %u as default\n", keyidx);
+	if (OK != acx_configure(adev, &dkey,
+				ACX1xx_IE_DOT11_WEP_DEFAULT_KEY_SET))
+		log(L_INIT, "WEP_DEFAULT_KEY_SET %u failed\n", keyidx);
+}
+
+/*
+ * acx_key_set
+ *
+ * A key from acx_op_set_key(), with the sem held.  Returns -EOPNOTSUPP
+ * for keys left to software crypto.
+ */
+int acx_key_set(acx_device_t *adev, enum set_key_cmd cmd,
+		struct ieee80211_sta *sta, struct ieee80211_key_conf *key)
+{
+	struct acx_key_table *kt = &adev->keys;
+	struct acx_sta *as = sta ? acx_sta_priv(sta) : NULL;
+	static const u8 bcast_addr[ETH_ALEN] =
+		{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	const u8 *addr = sta ? sta->addr : bcast_addr;
+	int algo = acx_key_algo(key);
+
+	if (cmd == DISABLE_KEY) {
+		if (as) {
+			as->sw_key = 0;
+			if (as->key != key)
+				return 0;
+			as->key = NULL;
+		} else {
+			if (key->keyidx >= ACX_KEY_GROUP_SLOTS
+			    || kt->group[key->keyidx] != key)
+				return 0;
+			kt->group[key->keyidx] = NULL;
+		}
+		acx111_set_key(adev, DISABLE_KEY, addr, key);
+		kt->keys--;
+		return 0;
+	}
+
+	if (!(kt->offload & acx_key_offload_bit(algo))) {
+		log(L_INIT, "offload of cipher %d disabled, software crypto\n",
+			algo);
+		goto software;
+	}
+
+	if ((as && as->ctx < 0)
+	    || (!as && key->keyidx >= ACX_KEY_GROUP_SLOTS)) {
+		log(L_INIT, "no hardware slot for key %u of " MACSTR
+			", software crypto\n", key->keyidx, MAC(addr));
+		goto software;
+	}
+
+	if (OK != acx111_set_key(adev, SET_KEY, addr, key)) {
+		kt->failed++;
+		goto software;
+	}
+
+	if (as) {
+		as->key = key;
+		as->sw_key = 0;
+		key->hw_key_idx = ACX_KEY_GROUP_SLOTS + as->ctx;
+	} else {
+		kt->group[key->keyidx] = key;
+		key->hw_key_idx = key->keyidx;
+		if (algo == ACX_SEC_ALGO_WEP || algo == ACX_SEC_ALGO_WEP104)
+			acx_key_set_wep_default(adev, key->keyidx);
+		else if (adev->mode == ACX_MODE_3_AP)
+			acx111_key_choose(adev, key->keyidx);
+	}
+	kt->keys++;
+	kt->hw_keys++;
+
+	return 0;
+
+software:
+	if (as)
+		as->sw_key = 1;
+	kt->sw_keys++;
+	return -EOPNOTSUPP;
+}
+
+/* Called with the sem held when a station goes, see above */
+void acx_key_sta_remove(acx_device_t *adev, struct acx_sta *as)
+{
+	as->sw_key = 0;
+	if (!as->key)
+		return;
+
+	acx111_set_key(adev, DISABLE_KEY, as->addr, as->key);
+	as->key = NULL;
+	adev->keys.keys--;
+	adev->keys.evicted++;
+}
+
+/* The firmware forgot all keys: on a restart mac80211 sets them again */
+void acx_key_reset(acx_device_t *adev)
+{
+	struct acx_key_table *kt = &adev->keys;
+
+	memset(kt->group, 0, sizeof(kt->group));
+	kt->keys = 0;
+}
+
+static struct ieee80211_key_conf *acx_key_group(acx_device_t *adev)
+{
+	int i;
+
+	for (i = 0; i < ACX_KEY_GROUP_SLOTS; i++)
+		if (adev->keys.group[i])
+			return adev->keys.group[i];
+	return NULL;
+}
+
+/*
+ * acx_key_rx_flags
+ *
+ * The rx status flags of hdr, before it goes up: a protected frame was
+ * decrypted by the firmware if it has a key for its transmitter, a
+ * pairwise key, a group key for group frames or a WEP default key for
+ * a known station without a pairwise one.
+ */
+u32 acx_key_rx_flags(acx_device_t *adev, struct ieee80211_hdr *hdr)
+{
+	struct acx_key_table *kt = &adev->keys;
+	struct ieee80211_key_conf *key = NULL, *group;
+	int known = 0, sw_key = 0;
+	u32 flags = 0;
+
+	if (!ieee80211_has_protected(hdr->frame_control)
+	    || !ieee80211_is_data(hdr->frame_control))
+		return 0;
+
+	if (!adev->hw_encrypt_enabled || !kt->keys) {
+		kt->rx_sw++;
+		return 0;
+	}
+
+	if (!is_multicast_ether_addr(hdr->addr1))
+		known = acx_sta_rx_key(adev, hdr->addr2, &key, &sw_key);
+
+	group = acx_key_group(adev);
+	if (!key && group) {
+		if (is_multicast_ether_addr(hdr->addr1))
+			key = group;
+		else if (known && !sw_key
+			 && acx_key_offload_bit(acx_key_algo(group))
+				== ACX_KEY_OFFLOAD_WEP)
+			key = group;
+	}
+
+	if (key) {
+		/* the trailer, ICV or MIC, is left for mac80211 to trim:
+		 * nothing shows the firmware strips it */
+		flags = RX_FLAG_DECRYPTED | RX_FLAG_IV_STRIPPED;
+		kt->rx_hw++;
+	} else
+		kt->rx_sw++;
+
+	return flags;
+}
+
+int acx_key_dbgfs_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acx_key_table *kt = &adev->keys;
+	struct acx_sta *as;
+	int i;
+
+	acx_sem_lock(adev);
+
+	seq_printf(file,
+		"hw crypto:\t%s\n"
+		"offload:\t0x%x (wep 0x%x, ccmp 0x%x)\n"
+		"keys in hw:\t%u\n"
+		"set in hw:\t%lu\n"
+		"software:\t%lu\n"
+		"failed:\t%lu\n"
+		"evicted:\t%lu\n"
+		"tx hw:\t%lu\n"
+		"tx sw:\t%lu\n"
+		"rx hw:\t%lu\n"
+		"rx sw:\t%lu\n"
+		"group:",
+		adev->hw_encrypt_enabled ? "on" : "off", kt->offload,
+		ACX_KEY_OFFLOAD_WEP, ACX_KEY_OFFLOAD_CCMP,
+		kt->keys, kt->hw_keys, kt->sw_keys, kt->failed, kt->evicted,
+		kt->tx_hw, kt->tx_sw, kt->rx_hw, kt->rx_sw);
+	for (i = 0; i < ACX_KEY_GROUP_SLOTS; i++)
+		if (kt->group[i])
+			seq_printf(file, " %d", i);
+	seq_printf(file, "\npairwise:");
+	list_for_each_entry(as, &adev->sta.list, list)
+		if (as->key)
+			seq_printf(file, " " MACSTR "/%d", MAC(as->addr),
+				as->ctx);
+	seq_printf(file, "\n");
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+/* Sets the ciphers offloaded, with the sem held, and clears the
+ * counters for a new run */
+void acx_key_set_offload(acx_device_t *adev, unsigned int offload)
+{
+	struct acx_key_table *kt = &adev->keys;
+
+	kt->offload = offload & ACX_KEY_OFFLOAD_ALL;
+	kt->tx_hw = kt->tx_sw = 0;
+	kt->rx_hw = kt->rx_sw = 0;
+}
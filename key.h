@@ -0,0 +1,14 @@
+#ifndef _ACX_KEY_H_
+#define _ACX_KEY_H_
+
+struct seq_file;
+
+int acx_key_set(acx_device_t *adev, enum set_key_cmd cmd,
+		struct ieee80211_sta *sta, struct ieee80211_key_conf *key);
+void acx_key_sta_remove(acx_device_t *adev, struct acx_sta *as);
+void acx_key_reset(acx_device_t *adev);
+u32 acx_key_rx_flags(acx_device_t *adev, struct ieee80211_hdr *hdr);
+int acx_key_dbgfs_output(struct seq_file *file, acx_device_t *adev);
+void acx_key_set_offload(acx_device_t *adev, unsigned int offload);
+
+#endif
@@ -31,8 +31,14 @@
 #include "utils.h"
 #include "cardsetting.h"
 #include "tx.h"
+#include "rx.h"
 #include "main.h"
 #include "debug.h"
+#include "survey.h"
+#include "bcn_filter.h"
+#include "scan.h"
+#include "sta.h"
+#include "key.h"
 
 #include "acx_func.h"
 #include "boot.h"
@@ -155,40 +161,6 @@ const u8 acx_bitpos2rate100[] = {
 BUILD_BUG_DECL(Rates, ARRAY_SIZE(acx_bitpos2rate100)
 		   != ARRAY_SIZE(bitpos2genframe_txrate));
 
-static int acx_do_job_update_tim(acx_device_t *adev)
-{
-	int ret;
-	struct sk_buff *beacon;
-	u16 tim_offset;
-	u16 tim_length;
-
-#if CONFIG_ACX_MAC80211_VERSION > KERNEL_VERSION(2, 6, 32)
-	beacon = ieee80211_beacon_get_tim(adev->hw, adev->vif, &tim_offset,
-			&tim_length);
-#else
-	beacon = ieee80211_beacon_get(adev->hw, adev->vif);
-	if (!beacon)
-		goto out;
-
-	tim_offset = acx_beacon_find_tim(beacon) - beacon->data;
-out:
-#endif
-	if (!beacon) {
-		logf0(L_ANY, "Error: beacon==NULL");
-		return NOT_OK;
-	}
-
-	if (IS_ACX111(adev)) {
-		ret = acx_set_tim_template(adev, beacon->data + tim_offset,
-				beacon->len - tim_offset);
-	}
-
-	dev_kfree_skb(beacon);
-
-	return (ret);
-}
-
-
 static int acx_recalib_radio(acx_device_t *adev)
 {
 	if (IS_ACX100(adev)) {
@@ -292,11 +264,17 @@ void acx_after_interrupt_task(acx_device_t *adev)
 		acx_after_interrupt_recalib(adev);
 	}
 
-	if (adev->after_interrupt_jobs & ACX_AFTER_IRQ_UPDATE_TIM) {
-		log(L_IRQ, "ACX_AFTER_IRQ_UPDATE_TIM\n");
-		acx_do_job_update_tim(adev);
+	if (adev->after_interrupt_jobs & ACX_AFTER_IRQ_UPDATE_RX_FILTER) {
+		log(L_IRQ, "ACX_AFTER_IRQ_UPDATE_RX_FILTER\n");
+		acx_update_rx_filter(adev);
 		CLEAR_BIT(adev->after_interrupt_jobs,
-			ACX_AFTER_IRQ_UPDATE_TIM);
+			ACX_AFTER_IRQ_UPDATE_RX_FILTER);
+	}
+
+	if (adev->after_interrupt_jobs & ACX_AFTER_IRQ_SCAN_NEXT) {
+		log(L_IRQ, "ACX_AFTER_IRQ_SCAN_NEXT\n");
+		CLEAR_BIT(adev->after_interrupt_jobs, ACX_AFTER_IRQ_SCAN_NEXT);
+		acx_scan_next(adev);
 	}
 
 	/* others */
@@ -395,20 +373,47 @@ struct ieee80211_hw* acx_alloc_hw(const struct ieee80211_ops *hw_ops)
 {
 	acx_device_t *adev;
 	struct ieee80211_hw *hw;
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(4, 3, 0)
+	struct ieee80211_ops *ops;
+
+	/* our own copy, see acx_op_set_frag_threshold() */
+	ops = kmemdup(hw_ops, sizeof(*ops), GFP_KERNEL);
+	if (!ops)
+		return NULL;
+	hw_ops = ops;
+#endif
 
 	hw = ieee80211_alloc_hw(sizeof(struct acx_device), hw_ops);
 	if (!hw) {
 		pr_err("ieee80211_alloc_hw failed\n");
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(4, 3, 0)
+		kfree(ops);
+#endif
 		return hw;
 	}
 	adev = hw2adev(hw);
 	memset(adev, 0, sizeof(*adev));
 	adev->hw = hw;
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(4, 3, 0)
+	adev->hw_ops = ops;
+#endif
 	pr_info("wiphy: %s", wiphy_name(adev->hw->wiphy));
 
 	return hw;
 }
 
+void acx_free_hw(struct ieee80211_hw *hw)
+{
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(4, 3, 0)
+	struct ieee80211_ops *ops = hw2adev(hw)->hw_ops;
+
+	ieee80211_free_hw(hw);
+	kfree(ops);
+#else
+	ieee80211_free_hw(hw);
+#endif
+}
+
 #define ACX_WATCHDOG_DELAY	1
 #define ACX_SCAN_TIMEOUT	5
 
@@ -441,25 +446,82 @@ static void acx_watchdog_work(struct work_struct *work)
 	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags))
 		return;
 
-	/* Check ongoing scan timeout */
-	if (test_bit(ACX_FLAG_SCANNING, &adev->flags)) {
+	/* acx_stop_watchdog() is called with the sem held and waits
+	 * for us, so don't wait for the sem: just try again next time */
+	if (!mutex_trylock(&adev->mutex))
+		goto out;
+
+	/* Check ongoing scan timeout, not counting the time on our
+	 * channel between background passes */
+	if (acx_watchdog_enable && test_bit(ACX_FLAG_SCANNING, &adev->flags)
+	    && adev->scan.in_pass) {
 		if (jiffies - adev->scan_start > ACX_SCAN_TIMEOUT * HZ) {
 			log(L_ANY,
 			        "Scan completion timeout: triggering hw-recovery\n");
-			acx_sem_lock(adev);
 			acx_recover_hw(adev);
-			acx_sem_unlock(adev);
 		}
 	}
 
+	acx_survey_watchdog(adev);
+	acx_fw_stats_sample(adev);
+	acx_bcn_filter_watchdog(adev);
+
+	mutex_unlock(&adev->mutex);
+out:
 	schedule_delayed_work(&adev->watchdog_work, HZ*ACX_WATCHDOG_DELAY);
 
 	return;
 }
 
+static void acx_tim_work(struct work_struct *work)
+{
+	acx_device_t *adev = container_of(work, struct acx_device,
+					tim_work.work);
+
+	acx_sem_lock(adev);
+	acx_tim_update(adev);
+	acx_sem_unlock(adev);
+}
+
+static void acx_scan_work(struct work_struct *work)
+{
+	acx_device_t *adev = container_of(work, struct acx_device,
+					scan_work.work);
+
+	acx_sem_lock(adev);
+	acx_scan_continue(adev);
+	acx_sem_unlock(adev);
+}
+
+/* The channel switch announced, at the time acx_op_channel_switch()
+ * worked out */
+static void acx_chan_switch_work(struct work_struct *work)
+{
+	acx_device_t *adev = container_of(work, struct acx_device,
+					chan_switch_work.work);
+	struct acx_chan_switch *cs = &adev->chan_switch;
+	int res;
+
+	acx_sem_lock(adev);
+
+	if (test_bit(ACX_FLAG_HW_UP, &adev->flags) && adev->vif) {
+		res = acx_set_channel(adev, cs->csa_chan, cs->csa_freq);
+		ieee80211_chswitch_done(adev->vif, res == OK);
+	}
+
+	if (cs->csa_block_tx) {
+		cs->csa_block_tx = 0;
+		acx_wake_queue(adev->hw, "after the channel switch");
+	}
+
+	acx_sem_unlock(adev);
+}
+
 /* Locking, queueing, etc. mechanics */
 int acx_init_mechanics(acx_device_t *adev)
 {
+	int i;
+
 	/* Locking */
 	spin_lock_init(&adev->spinlock);
 	mutex_init(&adev->mutex);
@@ -473,8 +535,20 @@ int acx_init_mechanics(acx_device_t *adev)
 	/* Skb tx-queue from mac80211 */
 	INIT_WORK(&adev->tx_work, acx_tx_work);
 	skb_queue_head_init(&adev->tx_queue);
+	INIT_LIST_HEAD(&adev->txq_list);
+	spin_lock_init(&adev->txq_lock);
+	for (i = 0; i < ACX111_MAX_NUM_HW_TX_QUEUES; i++) {
+		spin_lock_init(&adev->hw_tx_queue[i].dql.lock);
+		acx_tx_dql_reset(adev, i);
+	}
 
 	INIT_DELAYED_WORK(&adev->watchdog_work, acx_watchdog_work);
+	INIT_DELAYED_WORK(&adev->tim_work, acx_tim_work);
+	INIT_DELAYED_WORK(&adev->scan_work, acx_scan_work);
+	INIT_DELAYED_WORK(&adev->chan_switch_work, acx_chan_switch_work);
+
+	INIT_LIST_HEAD(&adev->sta.list);
+	spin_lock_init(&adev->sta.lock);
 
 	/* Allocate IE cmd buffer */
 	adev->ie_cmd_buf_len=acx_ie_get_max_len()+4;
@@ -490,6 +564,7 @@ int acx_init_mechanics(acx_device_t *adev)
 int acx_free_mechanics(acx_device_t *adev)
 {
 	kfree(adev->ie_cmd_buf);
+	kfree(adev->tim.beacon);
 
 	return 0;
 }
@@ -499,7 +574,11 @@ int acx_init_ieee80211(acx_device_t *adev, struct ieee80211_hw *hw)
 {
 	hw->flags[0] &= ~IEEE80211_HW_RX_INCLUDES_FCS;
 	hw->queues = 1;
-	hw->wiphy->max_scan_ssids = 1;
+	hw->wiphy->max_scan_ssids = ACX_SCAN_MAX_SSIDS;
+	hw->sta_data_size = sizeof(struct acx_sta);
+#if ACX_TXQ
+	hw->txq_data_size = sizeof(struct acx_txq);
+#endif
 
 	/* OW TODO Check if RTS/CTS threshold can be included here */
 
@@ -528,6 +607,24 @@ int acx_init_ieee80211(acx_device_t *adev, struct ieee80211_hw *hw)
 	hw->flags[0] |= IEEE80211_HW_SIGNAL_UNSPEC;
 	hw->max_signal = 100;
 
+	/* the firmware wakes up for tx by itself, see acx_set_powersave() */
+	hw->flags[0] |= IEEE80211_HW_SUPPORTS_PS
+		| IEEE80211_HW_SUPPORTS_DYNAMIC_PS;
+
+	/* the ACX111 firmware fragments if it takes the threshold, see
+	 * acx_op_set_frag_threshold(); FW150 maps the IE to cfgInvalid */
+	adev->frag_offload = IS_ACX111(adev)
+		&& OK == acx111_update_frag_threshold(adev);
+	log(L_INIT, "fragmentation in %s\n",
+		adev->frag_offload ? "firmware" : "mac80211");
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(4, 3, 0)
+	if (adev->frag_offload)
+		hw->flags[0] |= IEEE80211_HW_SUPPORTS_TX_FRAG;
+#else
+	if (!adev->frag_offload)
+		adev->hw_ops->set_frag_threshold = NULL;
+#endif
+
 	if (IS_ACX100(adev)) {
 		adev->hw->wiphy->bands[IEEE80211_BAND_2GHZ] =
 			&acx100_band_2GHz;
@@ -539,6 +636,12 @@ int acx_init_ieee80211(acx_device_t *adev, struct ieee80211_hw *hw)
 		return -1;
 	}
 
+	/* rates would be misreported to rate control */
+	if (OK != acx_rx_rate_selftest(adev)) {
+		log(L_ANY, "Error: rx rate decode selftest failed\n");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -585,6 +688,11 @@ int acx_op_add_interface(struct ieee80211_hw *ieee, struct ieee80211_VIF *vif)
 	case NL80211_IFTYPE_STATION:
 		log(L_ANY, "NL80211_IFTYPE_STATION\n");
 		adev->mode = ACX_MODE_2_STA;
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+		/* cqm comes from bcn_filter.c, and so does the beacon loss
+		 * while the firmware filters, see acx_bcn_filter_set_vif() */
+		VIF_vif(vif)->driver_flags |= IEEE80211_VIF_SUPPORTS_CQM_RSSI;
+#endif
 		break;
 
 	case NL80211_IFTYPE_MONITOR:
@@ -631,6 +739,10 @@ void acx_remove_interface(acx_device_t *adev, struct ieee80211_vif *vif)
 		adev->vif_monitor--;
 	else {
 		adev->vif = NULL;
+		adev->associated = 0;
+		acx_bcn_filter_update(adev);
+		acx_set_powersave(adev, 0);
+		acx_tim_reset(adev);
 	}
 
 	acx_set_mode(adev, ACX_MODE_OFF);
@@ -647,6 +759,9 @@ void acx_op_remove_interface(struct ieee80211_hw *hw, struct ieee80211_VIF *vif)
 	mac_vif = VIF_addr(vif);
 
 	acx_remove_interface(adev, VIF_vif(vif));
+#if ACX_TXQ
+	acx_txq_remove(adev, vif->txq);
+#endif
 
 	log(L_ANY, "Virtual interface removed: type=%d, MAC=%s\n",
 		vif->type, acx_print_mac(mac, mac_vif));
@@ -679,6 +794,16 @@ int acx_op_config(struct ieee80211_hw *hw, u32 changed)
 		acx1xx_set_tx_level_dbm(adev, conf->power_level);
 	}
 
+	/* also sent when dynamic_ps_timeout changes */
+	if (changed & IEEE80211_CONF_CHANGE_PS) {
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+		adev->ps_dtim_period = conf->ps_dtim_period;
+#endif
+		adev->ps_dynamic_timeout = conf->dynamic_ps_timeout;
+		acx_set_powersave(adev, !!(conf->flags & IEEE80211_CONF_PS));
+		changed_not_done &= ~IEEE80211_CONF_CHANGE_PS;
+	}
+
 	if (changed & IEEE80211_CONF_CHANGE_CHANNEL) {
 		logf1(L_DEBUG, "IEEE80211_CONF_CHANGE_CHANNEL,"
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 10, 0)
@@ -729,6 +854,22 @@ void acx_op_bss_info_changed(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 		acx_cmd_join_bssid(adev, adev->bssid);
 	}
 
+	/* the BSSID filter depends on it */
+	if (changed & BSS_CHANGED_ASSOC) {
+		adev->associated = info->assoc;
+		acx_update_rx_filter(adev);
+
+		adev->bcn_filter.beacon_int = info->beacon_int;
+		acx_bcn_filter_reset(adev);
+		acx_bcn_filter_update(adev);
+	}
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+	if (changed & BSS_CHANGED_CQM)
+		acx_bcn_filter_set_cqm(adev, info->cqm_rssi_thold,
+				info->cqm_rssi_hyst);
+#endif
+
 	/* BOM BSS_CHANGED_BEACON */
 	if (changed & BSS_CHANGED_BEACON) {
 
@@ -752,78 +893,6 @@ end_sem_unlock:
 	return;
 }
 
-static int acx111_set_key_type(acx_device_t *adev, acx111WEPDefaultKey_t *key,
-                               struct ieee80211_key_conf *mac80211_key,
-                               const u8 *addr)
-{
-
-#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 37)
-        switch (mac80211_key->alg) {
-#else
-	switch (mac80211_key->cipher) {
-#endif
-
-#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 37)
-        case ALG_CCMP:
-#else
-	case WLAN_CIPHER_SUITE_CCMP:
-#endif
-		if (is_broadcast_ether_addr(addr))
-			key->type = KEY_AES_GROUP;
-		else
-			key->type = KEY_AES_PAIRWISE;
-
-		break;
-	default:
-#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
-		log(L_INIT, "Unknown key cipher 0x%x", mac80211_key->cipher);
-#endif
-		return -EOPNOTSUPP;
-	}
-
-	return 0;
-}
-
-
-static int acx111_set_key(acx_device_t *adev, enum set_key_cmd cmd,
-                          const u8 *addr, struct ieee80211_key_conf *key)
-{
-	int ret = -1;
-	acx111WEPDefaultKey_t dk;
-
-	memset(&dk, 0, sizeof(dk));
-
-	switch (cmd) {
-	case SET_KEY:
-		dk.action = cpu_to_le16(KEY_ADD_OR_REPLACE);
-		break;
-	case DISABLE_KEY:
-		dk.action = cpu_to_le16(KEY_REMOVE);
-		break;
-	default:
-		log(L_INIT, "Unsupported key cmd 0x%x", cmd);
-		break;
-	}
-
-	ret = acx111_set_key_type(adev, &dk, key, addr);
-	if (ret < 0) {
-		log(L_INIT, "Set KEY type failed");
-		return ret;
-	}
-
-	memcpy(dk.MacAddr, addr, ETH_ALEN);
-
-	dk.keySize = key->keylen;
-	dk.defaultKeyNum = key->keyidx; /* ignored when setting default key */
-	dk.index = 0;
-
-	memcpy(dk.key, key->key, dk.keySize);
-
-	ret = acx_issue_cmd(adev, ACX1xx_CMD_WEP_MGMT, &dk, sizeof(dk));
-
-	return ret;
-}
-
 int acx_op_set_key(struct ieee80211_hw *hw, enum set_key_cmd cmd,
                    struct ieee80211_vif *vif, struct ieee80211_sta *sta,
                    struct ieee80211_key_conf *key)
@@ -847,7 +916,7 @@ int acx_op_set_key(struct ieee80211_hw *hw, enum set_key_cmd cmd,
 			"flags=%02x, keyidx=%d, keylen=%d\n", key->cipher, key->icv_len,
 	        key->iv_len, key->hw_key_idx, key->flags, key->keyidx,
 	        key->keylen);
-	if (acx_debug & L_DEBUG)
+	if (acx_debug_on(L_DEBUG))
 		hexdump("key->: key", key->key, key->keylen);
 #endif
 
@@ -865,28 +934,20 @@ int acx_op_set_key(struct ieee80211_hw *hw, enum set_key_cmd cmd,
 			    algorithm, "ACX_SEC_ALGO_WEP");
                 } else {
                     algorithm = ACX_SEC_ALGO_WEP104;
-                    log(L_INIT, "algorithm=%i: %s\n", "ACX_SEC_ALGO_WEP104");
+                    log(L_INIT, "algorithm=%i: %s\n",
+			    algorithm, "ACX_SEC_ALGO_WEP104");
                 }
-
-		acx_set_hw_encryption_off(adev);
-                ret = -EOPNOTSUPP;
                 break;
 #else
 	case WLAN_CIPHER_SUITE_WEP40:
 	        algorithm = ACX_SEC_ALGO_WEP;
                 log(L_INIT, "algorithm=%i: %s\n", algorithm, "ACX_SEC_ALGO_WEP");
-
-                acx_set_hw_encryption_off(adev);
-                ret = -EOPNOTSUPP;
                 break;
 
         case WLAN_CIPHER_SUITE_WEP104:
                 algorithm = ACX_SEC_ALGO_WEP104;
                 log(L_INIT, "algorithm=%i: %s\n",
 			algorithm, "ACX_SEC_ALGO_WEP104");
-
-                acx_set_hw_encryption_off(adev);
-                ret = -EOPNOTSUPP;
                 break;
 #endif
 
@@ -897,9 +958,6 @@ int acx_op_set_key(struct ieee80211_hw *hw, enum set_key_cmd cmd,
 #endif
 	        algorithm = ACX_SEC_ALGO_TKIP;
 	        log(L_INIT, "algorithm=%i: %s\n", algorithm, "ACX_SEC_ALGO_TKIP");
-
-	        acx_set_hw_encryption_off(adev);
-	        ret = -EOPNOTSUPP;
 	        break;
 
 #if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 37)
@@ -909,49 +967,97 @@ int acx_op_set_key(struct ieee80211_hw *hw, enum set_key_cmd cmd,
 #endif
 		algorithm = ACX_SEC_ALGO_AES;
 		log(L_INIT, "algorithm=%i: %s\n", algorithm, "ACX_SEC_ALGO_AES");
-
-		if(!adev->hw_encrypt_enabled){
-			ret=-EOPNOTSUPP;
-		} else {
-			acx111_set_key(adev, cmd, addr, key);
-			ret = 0;
-		}
-
 		break;
 
 	default:
 		algorithm = ACX_SEC_ALGO_NONE;
 
-		acx_set_hw_encryption_off(adev);
-		ret = 0;
+		ret = -EOPNOTSUPP;
 		break;
 	}
 
+	if (algorithm != ACX_SEC_ALGO_NONE) {
+		if(!adev->hw_encrypt_enabled)
+			ret=-EOPNOTSUPP;
+		else
+			ret = acx_key_set(adev, cmd, sta, key);
+	}
+
 	acx_sem_unlock(adev);
 	return ret;
 }
 
+/*
+ * acx_op_prepare_multicast
+ *
+ * Runs in atomic context: only collects the groups, as long as they fit
+ * the firmware table, for acx_op_configure_filter() to program.
+ */
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 35)
+u64 acx_op_prepare_multicast(struct ieee80211_hw *hw,
+			struct netdev_hw_addr_list *mc_list)
+#else
+u64 acx_op_prepare_multicast(struct ieee80211_hw *hw, int mc_count,
+			struct dev_addr_list *mc_list)
+#endif
+{
+	struct acx_mc_list *mc;
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 35)
+	struct netdev_hw_addr *ha;
+#else
+	int i;
+#endif
+
+	/* no list means all multicast */
+	mc = kzalloc(sizeof(*mc), GFP_ATOMIC);
+	if (!mc)
+		return 0;
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 35)
+	netdev_hw_addr_list_for_each(ha, mc_list) {
+		if (mc->count == ACX_GROUP_ADDR_MAX) {
+			mc->overflow = 1;
+			break;
+		}
+		memcpy(mc->addr[mc->count++], ha->addr, ETH_ALEN);
+	}
+#else
+	for (i = 0; i < mc_count && mc_list; i++, mc_list = mc_list->next) {
+		if (mc->count == ACX_GROUP_ADDR_MAX) {
+			mc->overflow = 1;
+			break;
+		}
+		memcpy(mc->addr[mc->count++], mc_list->dmi_addr, ETH_ALEN);
+	}
+#endif
+
+	return (u64) (unsigned long) mc;
+}
+
 void acx_op_configure_filter(struct ieee80211_hw *hw,
 			unsigned int changed_flags,
 			unsigned int *total_flags, u64 multicast)
 {
 	acx_device_t *adev = hw2adev(hw);
-
-
+	struct acx_mc_list *mc = (struct acx_mc_list *) (unsigned long) multicast;
 
 	acx_sem_lock(adev);
 
 	logf1(L_DEBUG, "1: changed_flags=0x%08x, *total_flags=0x%08x\n",
 		changed_flags, *total_flags);
 
-	/* OWI TODO: Set also FIF_PROBE_REQ ? */
-	*total_flags &= (FIF_ALLMULTI | FIF_FCSFAIL
-			| FIF_CONTROL | FIF_OTHER_BSS);
+	*total_flags &= ACX_FIF_SUPPORTED;
 
 	logf1(L_DEBUG, "2: *total_flags=0x%08x\n", *total_flags);
 
+	adev->rx_filter_flags = *total_flags;
+	acx_set_mc_list(adev, mc);
+	acx_update_rx_filter(adev);
+
 	acx_sem_unlock(adev);
 
+	kfree(mc);
+
 }
 
 #if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 2, 0)
@@ -971,11 +1077,45 @@ int acx_conf_tx(struct ieee80211_hw *hw, u16 queue,
 	return 0;
 }
 
+/* Atomic: only the bitmap changes here, acx_tim_work() writes it */
 int acx_op_set_tim(struct ieee80211_hw *hw, struct ieee80211_sta *sta, bool set)
 {
 	acx_device_t *adev = hw2adev(hw);
+	struct acx_tim *tim = &adev->tim;
+	unsigned long flags, next, delay = 0;
+	u8 *byte, mask;
+	int changed;
+
+	if (!sta->aid || sta->aid > IEEE80211_MAX_AID)
+		return -EINVAL;
+
+	byte = &tim->bitmap[sta->aid / 8];
+	mask = 1 << (sta->aid % 8);
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	tim->set_calls++;
+	changed = !(*byte & mask) != !set;
+	if (changed) {
+		if (set)
+			*byte |= mask;
+		else
+			*byte &= ~mask;
+		if (tim->dirty)
+			tim->coalesced++;
+		tim->dirty = 1;
+	}
+	spin_unlock_irqrestore(&adev->spinlock, flags);
 
-	acx_schedule_task(adev, ACX_AFTER_IRQ_UPDATE_TIM);
+	if (!changed)
+		return 0;
+
+	/* the firmware sends it with the next beacon, no need to write
+	 * more often */
+	next = tim->last_write
+		+ usecs_to_jiffies(adev->beacon_interval * 1024);
+	if (time_before(jiffies, next))
+		delay = next - jiffies;
+	ieee80211_queue_delayed_work(hw, &adev->tim_work, delay);
 
 	return 0;
 }
@@ -997,6 +1137,41 @@ int acx_op_get_stats(struct ieee80211_hw *hw,
 }
 
 
+/*
+ * acx_op_set_frag_threshold
+ *
+ * Only an ACX111 whose firmware took the threshold at probe fragments
+ * by itself, see acx_init_ieee80211().  For the others mac80211
+ * fragments, as they don't get IEEE80211_HW_SUPPORTS_TX_FRAG.  Before
+ * 4.3 there's no such flag and mac80211 leaves all fragmentation to a
+ * driver with this op, so acx_init_ieee80211() takes it out of their
+ * copy of the ops.
+ */
+int acx_op_set_frag_threshold(struct ieee80211_hw *hw, u32 value)
+{
+	acx_device_t *adev = hw2adev(hw);
+	int err = 0;
+
+	if (!adev->frag_offload)
+		return 0;
+
+	/* (u32) -1 turns it off */
+	if (value > 2346)
+		value = 2346;
+
+	acx_sem_lock(adev);
+
+	adev->frag_threshold = value;
+	if (test_bit(ACX_FLAG_HW_UP, &adev->flags)
+	    && OK != acx111_update_frag_threshold(adev))
+		err = -EIO;
+
+	acx_sem_unlock(adev);
+
+	return err;
+}
+
+
 #if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 34)
 int acx_e_op_get_tx_stats(struct ieee80211_hw *hw,
 			 struct ieee80211_tx_queue_stats *stats)
@@ -1030,6 +1205,12 @@ void acx_op_tx(struct ieee80211_hw *hw, struct ieee80211_tx_control *control,
 {
 	acx_device_t *adev = hw2adev(hw);
 
+	#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(3, 7, 0)
+	acx_sta_tx(adev, IEEE80211_SKB_CB(skb)->control.sta, skb);
+	#else
+	acx_sta_tx(adev, control->sta, skb);
+	#endif
+
 	skb_queue_tail(&adev->tx_queue, skb);
 
 	ieee80211_queue_work(adev->hw, &adev->tx_work);
@@ -1044,20 +1225,23 @@ void acx_op_tx(struct ieee80211_hw *hw, struct ieee80211_tx_control *control,
 	#endif
 }
 
+#if ACX_TXQ
+/* In atomic context: only queues the txq, for acx_tx_work() */
+void acx_op_wake_tx_queue(struct ieee80211_hw *hw, struct ieee80211_txq *txq)
+{
+	acx_device_t *adev = hw2adev(hw);
+
+	acx_txq_wake(adev, txq);
+	ieee80211_queue_work(hw, &adev->tx_work);
+}
+#endif
+
 int acx_op_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
                    struct cfg80211_scan_request *req)
 {
 	acx_device_t *adev = hw2adev(hw);
-	struct sk_buff *skb;
-	size_t ssid_len = 0;
-	u8 *ssid = NULL;
 	int ret=0;
 
-	if (req->n_ssids) {
-		ssid = req->ssids[0].ssid;
-		ssid_len = req->ssids[0].ssid_len;
-	}
-
 	acx_sem_lock(adev);
 
 	if (unlikely(!test_bit(ACX_FLAG_HW_UP, &adev->flags)))
@@ -1072,48 +1256,107 @@ int acx_op_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 		goto out;
 	}
 
-#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 1, 0)
+	ret = acx_scan_start(adev, req);
+	out:
+	acx_sem_unlock(adev);
 
-#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(3, 8, 0)
-	skb = ieee80211_probereq_get(adev->hw, adev->vif, ssid, ssid_len,
-	        req->ie, req->ie_len);
-	if (!skb) {
-		ret = -ENOMEM;
-		goto out;
+	return ret;
+}
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 34)
+int acx_op_sta_add(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		struct ieee80211_sta *sta)
+{
+	acx_device_t *adev = hw2adev(hw);
+	int ret;
+
+	acx_sem_lock(adev);
+	ret = acx_sta_add(adev, sta);
+	acx_sem_unlock(adev);
+
+	return ret;
+}
+
+int acx_op_sta_remove(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		struct ieee80211_sta *sta)
+{
+	acx_device_t *adev = hw2adev(hw);
+
+	acx_sem_lock(adev);
+	acx_sta_remove(adev, sta);
+	acx_txq_remove_sta(adev, sta);
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+void acx_op_sta_notify(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		enum sta_notify_cmd cmd, struct ieee80211_sta *sta)
+{
+	acx_device_t *adev = hw2adev(hw);
+
+	switch (cmd) {
+	case STA_NOTIFY_SLEEP:
+		acx_sta_notify(adev, sta, 1);
+		break;
+	case STA_NOTIFY_AWAKE:
+		acx_sta_notify(adev, sta, 0);
+		break;
+	default:
+		break;
 	}
+}
+#endif
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+/*
+ * Our AP announced a channel switch: follow it count beacons from now.
+ * The new channel costs acx_set_channel() its two commands at most, and
+ * the config call mac80211 makes for it afterwards nothing.
+ */
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 17, 0)
+void acx_op_channel_switch(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+			struct ieee80211_channel_switch *ch_switch)
 #else
-	skb = ieee80211_probereq_get(adev->hw, adev->vif, ssid, ssid_len,
-		req->ie_len);
-	if (!skb) {
-		ret = -ENOMEM;
-		goto out;
-	}
-	if (req->ie_len)
-		memcpy(skb_put(skb, req->ie_len), req->ie, req->ie_len);
+void acx_op_channel_switch(struct ieee80211_hw *hw,
+			struct ieee80211_channel_switch *ch_switch)
 #endif
+{
+	acx_device_t *adev = hw2adev(hw);
+	struct acx_chan_switch *cs = &adev->chan_switch;
+	struct ieee80211_channel *chan;
+	unsigned long delay = 0;
+	u16 beacon_int;
 
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 10, 0)
+	chan = ch_switch->chandef.chan;
 #else
-	goto out;
+	chan = ch_switch->channel;
 #endif
 
-	ret = acx_set_probe_request_template(adev, skb->data, skb->len);
-	dev_kfree_skb(skb);
-	if (ret < 0)
-		goto out;
+	acx_sem_lock(adev);
 
-        log(L_INIT, "scan start\n");
-        set_bit(ACX_FLAG_SCANNING, &adev->flags);
-        adev->scan_start=jiffies;
-	ret = acx_cmd_scan(adev);
-	if (ret < 0) {
-		clear_bit(ACX_FLAG_SCANNING, &adev->flags);
-		goto out;
+	cs->csa++;
+	cs->csa_chan = chan->hw_value;
+	cs->csa_freq = chan->center_freq;
+
+	if (ch_switch->block_tx && !cs->csa_block_tx) {
+		cs->csa_block_tx = 1;
+		acx_stop_queue(hw, "for the channel switch");
 	}
-	out:
-	acx_sem_unlock(adev);
 
-	return ret;
+	beacon_int = adev->bcn_filter.beacon_int ? : DEFAULT_BEACON_INTERVAL;
+	if (ch_switch->count)
+		delay = usecs_to_jiffies(ch_switch->count * beacon_int * 1024);
+
+	log(L_ASSOC, "channel switch to %u in %u beacons\n", cs->csa_chan,
+		ch_switch->count);
+
+	ieee80211_queue_delayed_work(hw, &adev->chan_switch_work, delay);
+
+	acx_sem_unlock(adev);
 }
+#endif
 
 int acx_recover_hw(acx_device_t *adev)
 {
@@ -9,6 +9,7 @@ extern const int acx111_rates_sizeof;
 extern const u8 bitpos2genframe_txrate[];
 
 struct ieee80211_hw* acx_alloc_hw(const struct ieee80211_ops *hw_ops);
+void acx_free_hw(struct ieee80211_hw *hw);
 
 int acx_start_watchdog(acx_device_t *adev);
 int acx_stop_watchdog(acx_device_t *adev);
@@ -32,6 +33,13 @@ void acx_op_bss_info_changed(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 int acx_op_set_key(struct ieee80211_hw *hw, enum set_key_cmd cmd,
                    struct ieee80211_vif *vif, struct ieee80211_sta *sta,
                    struct ieee80211_key_conf *key);
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 35)
+u64 acx_op_prepare_multicast(struct ieee80211_hw *hw,
+                             struct netdev_hw_addr_list *mc_list);
+#else
+u64 acx_op_prepare_multicast(struct ieee80211_hw *hw, int mc_count,
+                             struct dev_addr_list *mc_list);
+#endif
 void acx_op_configure_filter(struct ieee80211_hw *hw,
                              unsigned int changed_flags,
                              unsigned int *total_flags, u64 multicast);
@@ -46,6 +54,7 @@ int acx_conf_tx(struct ieee80211_hw *hw, u16 queue,
 int acx_op_set_tim(struct ieee80211_hw *hw, struct ieee80211_sta *sta, bool set);
 int acx_op_get_stats(struct ieee80211_hw *hw,
 		struct ieee80211_low_level_stats *stats);
+int acx_op_set_frag_threshold(struct ieee80211_hw *hw, u32 value);
 
 #if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 34)
 int acx_e_op_get_tx_stats(struct ieee80211_hw *hw,
@@ -61,9 +70,30 @@ void acx_op_tx(struct ieee80211_hw *hw, struct ieee80211_tx_control *control,
 	       struct sk_buff *skb);
 #endif
 
+#if ACX_TXQ
+void acx_op_wake_tx_queue(struct ieee80211_hw *hw, struct ieee80211_txq *txq);
+#endif
+
 int acx_op_hw_scan(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
                    struct cfg80211_scan_request *req);
 
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 34)
+int acx_op_sta_add(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		struct ieee80211_sta *sta);
+int acx_op_sta_remove(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		struct ieee80211_sta *sta);
+void acx_op_sta_notify(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+		enum sta_notify_cmd cmd, struct ieee80211_sta *sta);
+#endif
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 17, 0)
+void acx_op_channel_switch(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
+			struct ieee80211_channel_switch *ch_switch);
+#elif CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+void acx_op_channel_switch(struct ieee80211_hw *hw,
+			struct ieee80211_channel_switch *ch_switch);
+#endif
+
 int acx_recover_hw(acx_device_t *adev);
 
 #endif
@@ -79,6 +79,7 @@
 #include "rx.h"
 #include "tx.h"
 #include "main.h"
+#include "survey.h"
 #include "boot.h"
 
 /*
@@ -504,7 +505,7 @@ acxmem_issue_cmd_timeo_debug(acx_device_t *adev, unsigned cmd,
 		goto bad;
 	}
 
-	if ((acx_debug & L_DEBUG) && (cmd != ACX1xx_CMD_INTERROGATE)) {
+	if (acx_debug_on(L_DEBUG) && (cmd != ACX1xx_CMD_INTERROGATE)) {
 		pr_acxmem("input buffer (len=%u):\n", buflen);
 		acx_dump_bytes(buffer, buflen);
 	}
@@ -645,7 +646,7 @@ acxmem_issue_cmd_timeo_debug(acx_device_t *adev, unsigned cmd,
 	/* read in result parameters if needed */
 	if (buffer && buflen && (cmd == ACX1xx_CMD_INTERROGATE)) {
 		acxmem_copy_from_slavemem(adev, buffer, (uintptr_t) (adev->cmd_area + 4), buflen);
-		if (acx_debug & L_DEBUG) {
+		if (acx_debug_on(L_DEBUG)) {
 			log(L_ANY, "output buffer (len=%u): ", buflen);
 			acx_dump_bytes(buffer, buflen);
 		}
@@ -807,40 +808,6 @@ int acxmem_patch_around_bad_spots(acx_device_t *adev)
 int acxmem_patch_around_bad_spots(acx_device_t *adev) { return 0; }
 #endif
 
-#if 0
-static void acxmem_i_set_multicast_list(struct net_device *ndev)
-{
-	acx_device_t *adev = ndev2adev(ndev);
-	unsigned long flags;
-
-
-
-	acx_lock(adev, flags);
-
-	/* firmwares don't have allmulti capability,
-	 * so just use promiscuous mode instead in this case. */
-	if (ndev->flags & (IFF_PROMISC|IFF_ALLMULTI)) {
-		SET_BIT(adev->rx_config_1, RX_CFG1_RCV_PROMISCUOUS);
-		CLEAR_BIT(adev->rx_config_1, RX_CFG1_FILTER_ALL_MULTI);
-		SET_BIT(adev->set_mask, SET_RXCONFIG);
-		/* let kernel know in case *we* needed to set promiscuous */
-		ndev->flags |= (IFF_PROMISC|IFF_ALLMULTI);
-	} else {
-		CLEAR_BIT(adev->rx_config_1, RX_CFG1_RCV_PROMISCUOUS);
-		SET_BIT(adev->rx_config_1, RX_CFG1_FILTER_ALL_MULTI);
-		SET_BIT(adev->set_mask, SET_RXCONFIG);
-		ndev->flags &= ~(IFF_PROMISC|IFF_ALLMULTI);
-	}
-
-	/* cannot update card settings directly here, atomic context */
-	acx_schedule_task(adev, ACX_AFTER_IRQ_UPDATE_CARD_CFG);
-
-	acx_unlock(adev, flags);
-
-
-}
-#endif
-
 
 /*
  * BOM Other (Control Path)
@@ -1055,7 +1022,7 @@ void acxmem_process_rxdesc(acx_device_t *adev)
 	u32 addr;
 	u8 Ctl_8;
 
-	if (unlikely(acx_debug & L_BUFR))
+	if (unlikely(acx_debug_on(L_BUFR)))
 		acx_log_rxbuffer(adev);
 
 	/* First, have a loop to determine the first descriptor that's
@@ -1811,15 +1778,23 @@ static irqreturn_t acxmem_interrupt(int irq, void *dev_id)
 
 static const struct ieee80211_ops acxmem_hw_ops = {
 	.tx		= acx_op_tx,
+#if ACX_TXQ
+	.wake_tx_queue	= acx_op_wake_tx_queue,
+#endif
 	.conf_tx	= acx_conf_tx,
 	.start		= acx_op_start,
 	.stop		= acx_op_stop,
 	.config		= acx_op_config,
 	.set_key	= acx_op_set_key,
 	.get_stats	= acx_op_get_stats,
+	.set_frag_threshold	= acx_op_set_frag_threshold,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+	.get_survey	= acx_op_get_survey,
+#endif
 
 	.add_interface		= acx_op_add_interface,
 	.remove_interface	= acx_op_remove_interface,
+	.prepare_multicast	= acx_op_prepare_multicast,
 	.configure_filter	= acx_op_configure_filter,
 	.bss_info_changed	= acx_op_bss_info_changed,
 
@@ -1829,6 +1804,15 @@ static const struct ieee80211_ops acxmem_hw_ops = {
 
 #if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 34)
 	.get_tx_stats = acx_e_op_get_tx_stats,
+#endif
+	.set_tim = acx_op_set_tim,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+	.channel_switch	= acx_op_channel_switch,
+#endif
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 34)
+	.sta_add	= acx_op_sta_add,
+	.sta_remove	= acx_op_sta_remove,
+	.sta_notify	= acx_op_sta_notify,
 #endif
 };
 
@@ -1898,7 +1882,7 @@ int acx111pci_ioctl_info(struct ieee80211_hw *hw,
 	char fcserror[0x8];
 	char ratefallback[0x5];
 
-	if (!(acx_debug & (L_IOCTL | L_DEBUG)))
+	if (!(acx_debug_on(L_IOCTL | L_DEBUG)))
 		return OK;
 	/* using printk() since we checked debug flag already */
 
@@ -2338,7 +2322,8 @@ static int acxmem_probe(struct platform_device *pdev)
 		goto fail_debugfs;
 
 	/* Init ieee80211_hw  */
-	acx_init_ieee80211(adev, hw);
+	if (acx_init_ieee80211(adev, hw))
+		goto fail_ieee80211_register_hw;
 	hw->wiphy->interface_modes = BIT(NL80211_IFTYPE_STATION)
 					| BIT(NL80211_IFTYPE_ADHOC);
 
@@ -2380,7 +2365,7 @@ static int acxmem_probe(struct platform_device *pdev)
 	fail_ieee80211_alloc_hw:
 	acx_delete_dma_regions(adev);
 	platform_set_drvdata(pdev, NULL);
-	ieee80211_free_hw(hw);
+	acx_free_hw(hw);
 
 	done:
 
@@ -2483,7 +2468,7 @@ static int acxmem_remove(struct platform_device *pdev)
 
 	acx_free_mechanics(adev);
 
-	ieee80211_free_hw(adev->hw);
+	acx_free_hw(adev->hw);
 
 	pr_acxmem("done\n");
 
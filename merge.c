@@ -66,6 +66,9 @@
 #include "main.h"
 #include "boot.h"
 #include "interrupt-masks.h"
+#include "trace.h"
+#include "sta.h"
+#include "key.h"
 
 #define RX_BUFFER_SIZE (sizeof(rxbuffer_t) + 32)
 
@@ -98,6 +101,7 @@ irqreturn_t acx_interrupt(int irq, void *dev_id)
 	irqreason = read_reg16(adev, IO_ACX_IRQ_STATUS_NON_DES);
 	irqmasked = irqreason & ~adev->irq_mask;
 	log(L_IRQ, "irqstatus=%04X, irqmasked=%04X,\n", irqreason, irqmasked);
+	trace_acx_irq(adev, irqreason, irqmasked);
 
 	if (unlikely(irqreason == 0xffff)) {
 		/* 0xffff value hints at missing hardware, so don't do
@@ -572,6 +576,7 @@ static void acx_create_tx_desc_queue(acx_device_t *adev, u32 tx_queue_start, int
 	adev->hw_tx_queue[queue_id].head = 0;
 	adev->hw_tx_queue[queue_id].tail = 0;
 	adev->hw_tx_queue[queue_id].free = TX_CNT;
+	acx_tx_dql_reset(adev, queue_id);
 
 	txdesc = tx->acxdescinfo.start;
 	if (IS_PCI(adev)) {
@@ -1501,7 +1506,7 @@ int _acx_issue_cmd_timeo_debug(acx_device_t *adev, unsigned cmd,
 {
 	unsigned long start = jiffies;
 	unsigned long timeout;
-	unsigned counter;
+	unsigned counter, spin;
 	const char *devname;
 	u16 irqtype;
 	u16 cmd_status = -1;
@@ -1526,7 +1531,7 @@ int _acx_issue_cmd_timeo_debug(acx_device_t *adev, unsigned cmd,
 		goto bad;
 	}
 
-	if ((acx_debug & L_DEBUG) && (cmd != ACX1xx_CMD_INTERROGATE)) {
+	if (acx_debug_on(L_DEBUG) && (cmd != ACX1xx_CMD_INTERROGATE)) {
 		pr_acx("input buffer (len=%u):\n", buflen);
 		acx_dump_bytes(buffer, buflen);
 	}
@@ -1575,6 +1580,18 @@ int _acx_issue_cmd_timeo_debug(acx_device_t *adev, unsigned cmd,
 	/* pci only */
 	timeout = jiffies + cmd_timeout * HZ / 1000;
 
+	/* ENABLE_TX/RX for a channel switch are done well within a ms:
+	 * catch those before sleeping in ms steps.  Everything else
+	 * takes longer, the spin would only burn the cpu. */
+	spin = (cmd == ACX1xx_CMD_ENABLE_TX || cmd == ACX1xx_CMD_ENABLE_RX) ?
+		ACX_CMD_SPIN_US / 10 : 0;
+	for (; spin; spin--) {
+		if (read_reg16(adev, IO_ACX_IRQ_STATUS_NON_DES)
+		    & HOST_INT_CMD_COMPLETE)
+			break;
+		udelay(10);
+	}
+
 	do {
 		irqtype = read_reg16(adev, IO_ACX_IRQ_STATUS_NON_DES);
 		if (irqtype & HOST_INT_CMD_COMPLETE) {
@@ -1647,7 +1664,7 @@ int _acx_issue_cmd_timeo_debug(acx_device_t *adev, unsigned cmd,
 		else
 			memcpy_fromio(buffer, adev->cmd_area + 4, buflen);
 
-		if (acx_debug & L_DEBUG) {
+		if (acx_debug_on(L_DEBUG)) {
 			log(L_ANY, "output buffer (len=%u): ", buflen);
 			acx_dump_bytes(buffer, buflen);
 		}
@@ -1944,44 +1961,6 @@ int acx_get_hardware_info(acx_device_t *adev)
 }
 
 
-#if 0	// acxmem_i_set_multicast_list()
-/***********************************************************************
- ** acxmem_i_set_multicast_list
- ** FIXME: most likely needs refinement
- */
-static void acxmem_i_set_multicast_list(struct net_device *ndev)
-{
-	acx_device_t *adev = ndev2adev(ndev);
-	unsigned long flags;
-
-
-
-	acx_lock(adev, flags);
-
-	/* firmwares don't have allmulti capability, so just use
-	 * promiscuous mode instead in this case. */
-	if (ndev->flags & (IFF_PROMISC|IFF_ALLMULTI)) {
-		SET_BIT(adev->rx_config_1, RX_CFG1_RCV_PROMISCUOUS);
-		CLEAR_BIT(adev->rx_config_1, RX_CFG1_FILTER_ALL_MULTI);
-		SET_BIT(adev->set_mask, SET_RXCONFIG);
-		/* let kernel know in case *we* needed to set promiscuous */
-		ndev->flags |= (IFF_PROMISC|IFF_ALLMULTI);
-	} else {
-		CLEAR_BIT(adev->rx_config_1, RX_CFG1_RCV_PROMISCUOUS);
-		SET_BIT(adev->rx_config_1, RX_CFG1_FILTER_ALL_MULTI);
-		SET_BIT(adev->set_mask, SET_RXCONFIG);
-		ndev->flags &= ~(IFF_PROMISC|IFF_ALLMULTI);
-	}
-
-	/* cannot update card settings directly here, atomic context */
-	acx_schedule_task(adev, ACX_AFTER_IRQ_UPDATE_CARD_CFG);
-
-	acx_unlock(adev, flags);
-
-
-}
-#endif
-
 
 /*
  * BOM Rx Path
@@ -2155,11 +2134,10 @@ void _acx_tx_data(acx_device_t *adev, tx_t *tx_opaque, int len,
 			(IS_PCI(adev) ? (DESC_CTL_AUTODMA | DESC_CTL_RECLAIM) : 0)
 			);
 
-#if ACX_FRAGMENTATION
-		/* SET_BIT(Ctl2_8, DESC_CTL2_MORE_FRAG); cannot set it
-		 * unconditionally, needs to be set for all non-last
-		 * fragments */
-#endif
+		/* no DESC_CTL2_MORE_FRAG: mac80211 does the fragmentation
+		 * for the ACX100 and each fragment comes in its own
+		 * descriptor pair, the ACX111 firmware fragments by
+		 * itself, see acx111_update_frag_threshold() */
 
 		hostdesc1->hd.length = cpu_to_le16(wlhdr_len);
 
@@ -2261,7 +2239,7 @@ void _acx_tx_data(acx_device_t *adev, tx_t *tx_opaque, int len,
 end_of_chain:
 
 	/* Debugging */
-	if (unlikely(acx_debug & (L_XFER|L_DATA))) {
+	if (unlikely(acx_debug_on(L_XFER|L_DATA))) {
 		u16 fc = ((struct ieee80211_hdr *)
 			hostdesc1->data)->frame_control;
 		if (IS_ACX111(adev))
@@ -2282,7 +2260,7 @@ end_of_chain:
 				? "(SPr)" : "",
 				adev->status);
 
-		if (0 && acx_debug & L_DATA) {
+		if (0 && acx_debug_on(L_DATA)) {
 			pr_acx("tx: 802.11 [%d]: ", len);
 			acx_dump_bytes(hostdesc1->data, len);
 		}
@@ -2315,10 +2293,12 @@ unsigned int acx_tx_clean_txdesc(acx_device_t *adev, int queue_id)
 	u8 error, ack_failures, rts_failures, rts_ok, r100, Ctl_8;
 	u32 acxmem;
 	txacxdesc_t tmptxdesc;
+	struct sk_buff_head done;
 
 	struct ieee80211_tx_info *txstatus;
 
 
+	__skb_queue_head_init(&done);
 
 	if (IS_MEM(adev)) {
 		/*
@@ -2330,7 +2310,7 @@ unsigned int acx_tx_clean_txdesc(acx_device_t *adev, int queue_id)
 		tmptxdesc.Ctl_8 = DESC_CTL_HOSTOWN | DESC_CTL_FIRSTFRAG;
 		tmptxdesc.u.r1.rate = 0x0a;
 	}
-	if (unlikely(acx_debug & L_DEBUG))
+	if (unlikely(acx_debug_on(L_DEBUG)))
 		acx_log_txbuffer(adev, queue_id);
 
 	log(L_BUFT, "tx: cleaning up bufs from %u\n", adev->hw_tx_queue[queue_id].tail);
@@ -2362,7 +2342,7 @@ unsigned int acx_tx_clean_txdesc(acx_device_t *adev, int queue_id)
 		if ((Ctl_8 & DESC_CTL_ACXDONE_HOSTOWN)
 			!= DESC_CTL_ACXDONE_HOSTOWN) {
 			/* maybe remove if wrapper */
-			if (unlikely(!num_cleaned) && (acx_debug & L_BUFT))
+			if (unlikely(!num_cleaned) && acx_debug_on(L_BUFT))
 				pr_warn("clean_txdesc: tail isn't free. "
 					"q=%d finger=%d, tail=%d, head=%d\n",
 				        queue_id, finger,
@@ -2417,6 +2397,11 @@ unsigned int acx_tx_clean_txdesc(acx_device_t *adev, int queue_id)
 		} else {
 			txstatus->status.rates[0].count = ack_failures + 1;
 		}
+		acx_tx_rate_stats_update(adev, txstatus);
+		acx_sta_tx_status(adev, hostdesc->skb);
+		acx_tx_dql_completed(adev, queue_id, hostdesc->skb);
+		trace_acx_tx_complete(adev, hostdesc->skb, error,
+				ack_failures, rts_failures, rts_ok);
 
 		/* Free up the transmit data buffers */
 		if (IS_MEM(adev)) {
@@ -2453,24 +2438,22 @@ unsigned int acx_tx_clean_txdesc(acx_device_t *adev, int queue_id)
 			acxpcimem_handle_tx_error(adev, error,
 					finger, txstatus);
 
-		/* And finally report upstream */
+		/* And finally report upstream, all at once after the
+		 * pass */
 
-		if (IS_MEM(adev))
-			ieee80211_tx_status_irqsafe(adev->hw, hostdesc->skb);
-		else {
-#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 37)
-			local_bh_disable();
-			ieee80211_tx_status(adev->hw, hostdesc->skb);
-			local_bh_enable();
-#else
-			ieee80211_tx_status_ni(adev->hw, hostdesc->skb);
-#endif
-		}
+		if (IS_SIM(adev)
+		    && unlikely(test_bit(ACX_FLAG_BENCH, &adev->flags)))
+			acxsim_bench_consume(adev, hostdesc->skb);
+		else
+			__skb_queue_tail(&done, hostdesc->skb);
 		/* update pointer for descr to be cleaned next */
 		finger = (finger + 1) % TX_CNT;
 	}
 	/* remember last position */
 	adev->hw_tx_queue[queue_id].tail = finger;
+	acx_tx_dql_update(adev, queue_id);
+
+	acx_tx_status_report(adev, &done);
 
 
 	return num_cleaned;
@@ -2517,6 +2500,7 @@ void acx_clean_txdesc_emergency(acx_device_t *adev)
 		write_slavemem32(adev, (uintptr_t) &(txd->AcxMemPtr), 0);
 	}
 	adev->hw_tx_queue[0].free = TX_CNT;
+	acx_tx_dql_reset(adev, 0);
 
 	if (IS_MEM(adev))
 		acxmem_init_acx_txbuf2(adev);
@@ -2660,6 +2644,8 @@ static int acx_is_hw_tx_queue_start_limit(acx_device_t *adev)
 				i, adev->hw_tx_queue[i].free);
 			return 0;
 		}
+		if (acx_tx_dql_full(adev, i))
+			return 0;
 	}
 
 	return 1;
@@ -2742,9 +2728,11 @@ void acx_irq_work(struct work_struct *work)
 			for (i=0; i<adev->num_hw_tx_queues; i++)
 				acx_tx_clean_txdesc(adev, i);
 
-			/* Restart queue if stopped and enough tx-descr free */
+			/* Restart queue if stopped and enough tx-descr
+			 * free, but not during a channel switch */
 			if (acx_is_hw_tx_queue_start_limit(adev) &&
-				acx_queue_stopped(adev->hw))
+				acx_queue_stopped(adev->hw) &&
+				!adev->chan_switch.csa_block_tx)
 			{
 				log(L_BUF,"tx: wake queue\n");
 				acx_wake_queue(adev->hw, NULL);
@@ -2775,16 +2763,16 @@ void acx_irq_work(struct work_struct *work)
 
 		/* HOST_INT_SCAN_COMPLETE */
 		if (irqmasked & HOST_INT_SCAN_COMPLETE) {
-			if (test_bit(ACX_FLAG_SCANNING, &adev->flags)) {
-				ieee80211_scan_completed(adev->hw, false);
-				log(L_INIT, "scan completed\n");
-				clear_bit(ACX_FLAG_SCANNING, &adev->flags);
-			}
+			/* next pass of the request, or its completion,
+			 * see acx_scan_next() */
+			if (test_bit(ACX_FLAG_SCANNING, &adev->flags))
+				acx_schedule_task(adev,
+					ACX_AFTER_IRQ_SCAN_NEXT);
 		}
 
 		/* These we just log, but either they happen rarely
 		 * or we keep them masked out */
-		if (acx_debug & L_IRQ)
+		if (acx_debug_on(L_IRQ))
 			acx_log_irq(irqreason);
 
 	} while (irqcnt--);
@@ -2898,7 +2886,7 @@ void acx_handle_info_irq(acx_device_t *adev)
 
 void acx_set_interrupt_mask(acx_device_t *adev)
 {
-	if (acx_debug & L_DEBUG)
+	if (acx_debug_on(L_DEBUG))
 		interrupt_sanity_checks(adev);
 
 	pr_notice("adev->irq_mask: before: %d devtype:%d chiptype:%d tobe: %d\n",
@@ -3128,8 +3116,11 @@ int acx_op_start(struct ieee80211_hw *hw)
 
 	acx_wake_queue(adev->hw, NULL);
 
-	if (acx_watchdog_enable)
-		acx_start_watchdog(adev);
+	/* the beacon loss check, the survey and the firmware statistics
+	 * sampler run off the watchdog too, hw recovery there depends on
+	 * acx_watchdog_enable.  The samplers only issue commands when
+	 * asked to, through debugfs or a survey read */
+	acx_start_watchdog(adev);
 
 	acx_sem_unlock(adev);
 
@@ -3144,6 +3135,7 @@ void acx_stop(acx_device_t *adev)
 		ieee80211_scan_completed(adev->hw, true);
 		acx_issue_cmd(adev, ACX1xx_CMD_STOP_SCAN, NULL, 0);
 		clear_bit(ACX_FLAG_SCANNING, &adev->flags);
+		adev->scan.req = NULL;
 	}
 
 	acx_stop_queue(adev->hw, "on ifdown");
@@ -3154,16 +3146,28 @@ void acx_stop(acx_device_t *adev)
 	acxmem_lock();			// null in pci
 	acx_irq_disable(adev);
 	acxmem_unlock();		//
-	synchronize_irq(adev->irq);
+	if (IS_SIM(adev))
+		acxsim_synchronize_irq(adev);
+	else
+		synchronize_irq(adev->irq);
 
 	acx_sem_unlock(adev);
 	cancel_work_sync(&adev->irq_work);
 	cancel_work_sync(&adev->tx_work);
+	cancel_delayed_work_sync(&adev->tim_work);
+	cancel_delayed_work_sync(&adev->scan_work);
+	cancel_delayed_work_sync(&adev->chan_switch_work);
 	acx_sem_lock(adev);
 
 	acx_tx_queue_flush(adev);
 
 	adev->channel = 1;
+	adev->chan_switch.tx_chan = adev->chan_switch.rx_chan = 0;
+	/* a pending switch went with chan_switch_work */
+	adev->chan_switch.csa_block_tx = 0;
+	acx_sta_reset(adev);
+	acx_key_reset(adev);
+	acx_txq_reset(adev);
 }
 
 
@@ -3177,7 +3181,7 @@ void acx_op_stop(struct ieee80211_hw *hw)
 
 	acx_stop(adev);
 
-	if (acx_watchdog_enable)
+	if (test_bit(ACX_FLAG_WATCHDOG_RUNNING, &adev->flags))
 		acx_stop_watchdog(adev);
 
 	log(L_INIT, "acx: closed device\n");
@@ -3256,7 +3260,7 @@ int acx111pci_ioctl_info(struct ieee80211_hw *hw, struct iw_request_info *info,
 	char fcserror[0x8];
 	char ratefallback[0x5];
 
-	if (!(acx_debug & (L_IOCTL | L_DEBUG)))
+	if (!(acx_debug_on(L_IOCTL | L_DEBUG)))
 		return OK;
 	/* using printk() since we checked debug flag already */
 
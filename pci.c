@@ -61,6 +61,7 @@
 #include "rx.h"
 #include "tx.h"
 #include "main.h"
+#include "survey.h"
 #include "boot.h"
 
 /*
@@ -177,7 +178,7 @@ acxpci_issue_cmd_timeo_debug(acx_device_t * adev, unsigned cmd,
 		goto bad;
 	}
 
-	if ((acx_debug & L_DEBUG) && (cmd != ACX1xx_CMD_INTERROGATE)) {
+	if (acx_debug_on(L_DEBUG) && (cmd != ACX1xx_CMD_INTERROGATE)) {
 		pr_acx("input buffer (len=%u):\n", buflen);
 		acx_dump_bytes(buffer, buflen);
 	}
@@ -314,7 +315,7 @@ acxpci_issue_cmd_timeo_debug(acx_device_t * adev, unsigned cmd,
 	if (buffer && buflen && (cmd == ACX1xx_CMD_INTERROGATE)) {
 		/* adev->cmd_area points to PCI device's memory, not to RAM! */
 		memcpy_fromio(buffer, adev->cmd_area + 4, buflen);
-		if (acx_debug & L_DEBUG) {
+		if (acx_debug_on(L_DEBUG)) {
 			pr_acx("output buffer (len=%u): ", buflen);
 			acx_dump_bytes(buffer, buflen);
 		}
@@ -569,7 +570,7 @@ void acxpci_process_rxdesc(acx_device_t *adev)
 	register rxhostdesc_t *hostdesc;
 	unsigned count, tail;
 
-	if (unlikely(acx_debug & L_BUFR))
+	if (unlikely(acx_debug_on(L_BUFR)))
 		acx_log_rxbuffer(adev);
 
 	/* First, have a loop to determine the first descriptor that's
@@ -661,15 +662,23 @@ more bytes may follow
 
 static const struct ieee80211_ops acxpci_hw_ops = {
 	.tx		= acx_op_tx,
+#if ACX_TXQ
+	.wake_tx_queue	= acx_op_wake_tx_queue,
+#endif
 	.conf_tx	= acx_conf_tx,
 	.start		= acx_op_start,
 	.stop		= acx_op_stop,
 	.config		= acx_op_config,
 	.set_key	= acx_op_set_key,
 	.get_stats	= acx_op_get_stats,
+	.set_frag_threshold	= acx_op_set_frag_threshold,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+	.get_survey	= acx_op_get_survey,
+#endif
 
 	.add_interface		= acx_op_add_interface,
 	.remove_interface	= acx_op_remove_interface,
+	.prepare_multicast	= acx_op_prepare_multicast,
 	.configure_filter	= acx_op_configure_filter,
 	.bss_info_changed	= acx_op_bss_info_changed,
 
@@ -681,6 +690,14 @@ static const struct ieee80211_ops acxpci_hw_ops = {
 	.get_tx_stats = acx_e_op_get_tx_stats,
 #endif
 	.set_tim = acx_op_set_tim,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+	.channel_switch	= acx_op_channel_switch,
+#endif
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 34)
+	.sta_add	= acx_op_sta_add,
+	.sta_remove	= acx_op_sta_remove,
+	.sta_notify	= acx_op_sta_notify,
+#endif
 };
 
 /*
@@ -721,7 +738,7 @@ int acx111pci_ioctl_info(struct net_device *ndev,
 	char fcserror[0x8];
 	char ratefallback[0x5];
 
-	if (!(acx_debug & (L_IOCTL | L_DEBUG)))
+	if (!(acx_debug_on(L_IOCTL | L_DEBUG)))
 		return OK;
 	/* using printk() since we checked debug flag already */
 
@@ -1214,7 +1231,8 @@ static int acxpci_probe(struct pci_dev *pdev,
 #endif
 
 	/* Init ieee80211_hw  */
-	acx_init_ieee80211(adev, hw);
+	if (acx_init_ieee80211(adev, hw))
+		goto fail_debugfs;
 	hw->wiphy->interface_modes =
 			BIT(NL80211_IFTYPE_STATION) |
 			BIT(NL80211_IFTYPE_ADHOC) |
@@ -1278,7 +1296,7 @@ static int acxpci_probe(struct pci_dev *pdev,
 #endif
 
 	fail_init_mechanics:
-	ieee80211_free_hw(hw);
+	acx_free_hw(hw);
 
 	/* ieee80211_alloc_hw */
 	fail_ieee80211_alloc_hw:
@@ -1393,7 +1411,7 @@ static void acxpci_remove(struct pci_dev *pdev)
 	/* Free netdev (quite late, since otherwise we might get
 	 * caught off-guard by a netdev timeout handler execution
 	 * expecting to see a working dev...) */
-	ieee80211_free_hw(adev->hw);
+	acx_free_hw(adev->hw);
 
 	/* put device into ACPI D3 mode (shutdown) */
 #ifdef CONFIG_PM
@@ -1745,7 +1763,10 @@ static int vlynq_probe(struct vlynq_device *vdev,
 	/** done with board specific setup **/
 
 	/* Init ieee80211_hw  */
-	acx_init_ieee80211(adev, hw);
+	if (acx_init_ieee80211(adev, hw)) {
+		result = -EIO;
+		goto fail_vlynq_ieee80211_register_hw;
+	}
 	hw->wiphy->interface_modes =
 			BIT(NL80211_IFTYPE_STATION)	|
 			BIT(NL80211_IFTYPE_ADHOC) |
@@ -1791,7 +1812,7 @@ static int vlynq_probe(struct vlynq_device *vdev,
 	fail_vlynq_enable_device:
 
 	fail_init_mechanics:
-	ieee80211_free_hw(hw);
+	acx_free_hw(hw);
 
 	fail_vlynq_ieee80211_alloc_hw:
 
@@ -1863,7 +1884,7 @@ static void vlynq_remove(struct vlynq_device *vdev)
 
 	acx_free_mechanics(adev);
 
-	ieee80211_free_hw(adev->hw);
+	acx_free_hw(adev->hw);
 
 }
 
@@ -18,13 +18,24 @@
 
 #include "acx_debug.h"
 
+#include <linux/vmalloc.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+
 #include "acx.h"
 #include "pci.h"
 #include "mem.h"
 #include "merge.h"
 #include "usb.h"
 #include "utils.h"
+#include "cardsetting.h"
+#include "bcn_filter.h"
+#include "sta.h"
+#include "key.h"
 #include "rx.h"
+#include "main.h"
+#include "sim.h"
+#include "trace.h"
 
 /*
  * Calculate level like the feb 2003 windows driver seems to do
@@ -104,6 +115,111 @@ const char* acx_get_packet_type_string(u16 fc)
 }
 
 
+/*
+ * Translation of rxbuffer.phy_plcp_signal to rate_idx
+ *
+ * CCK/PBCC: the PLCP SIGNAL field is the rate in 100kbps units.
+ * OFDM: the low nibble is the RATE field of the PLCP header.
+ * Both decode to a bitrate (100kbps) which is looked up in the band,
+ * so the index matches acx100_rates[] as well as acx111_rates[].
+ */
+static u16 acx_plcp_get_bitrate_cck(u8 plcp)
+{
+	switch (plcp) {
+	case 0x0A:	/* 1 Mbit/s */
+	case 0x14:	/* 2 Mbit/s */
+	case 0x37:	/* 5.5 Mbit/s */
+	case 0x6E:	/* 11 Mbit/s */
+	case 0xDC:	/* 22 Mbit/s PBCC */
+		return plcp;
+	}
+	return 0;
+}
+
+static u16 acx_plcp_get_bitrate_ofdm(u8 plcp)
+{
+	switch (plcp & 0xF) {
+	case 0xB:
+		return 60;
+	case 0xF:
+		return 90;
+	case 0xA:
+		return 120;
+	case 0xE:
+		return 180;
+	case 0x9:
+		return 240;
+	case 0xD:
+		return 360;
+	case 0x8:
+		return 480;
+	case 0xC:
+		return 540;
+	}
+	return 0;
+}
+
+int acx_plcp_to_rate_idx(struct ieee80211_supported_band *sband,
+			u8 plcp, int ofdm)
+{
+	u16 bitrate;
+	int i;
+
+	bitrate = ofdm ? acx_plcp_get_bitrate_ofdm(plcp)
+		: acx_plcp_get_bitrate_cck(plcp);
+	if (!bitrate)
+		return -1;
+
+	for (i = 0; i < sband->n_bitrates; i++)
+		if (sband->bitrates[i].bitrate == bitrate)
+			return i;
+	return -1;
+}
+
+#if ACX_DEBUG
+/*
+ * Checks the decoder against the PLCP encoding used for generated
+ * frames (bitpos2genframe_txrate[]): every rate of the device's band
+ * has to come back as its own index.
+ */
+int acx_rx_rate_selftest(acx_device_t *adev)
+{
+	struct ieee80211_supported_band *sband =
+		adev->hw->wiphy->bands[IEEE80211_BAND_2GHZ];
+	const u16 ofdm_mask = RATE111_6 | RATE111_9 | RATE111_12
+		| RATE111_18 | RATE111_24 | RATE111_36 | RATE111_48
+		| RATE111_54;
+	u16 hw_value;
+	u8 plcp;
+	int i, idx, ofdm, res = OK;
+
+	for (i = 0; i < sband->n_bitrates; i++) {
+		hw_value = sband->bitrates[i].hw_value;
+		if (IS_ACX111(adev)) {
+			plcp = bitpos2genframe_txrate[highest_bit(hw_value)];
+			ofdm = !!(hw_value & ofdm_mask);
+		} else {
+			/* RATE100_x is the CCK PLCP value itself */
+			plcp = hw_value;
+			ofdm = 0;
+		}
+		idx = acx_plcp_to_rate_idx(sband, plcp, ofdm);
+		if (idx != i) {
+			pr_err("rx rate decode: %u.%u Mbit/s (plcp 0x%02X%s) "
+				"gives idx %d, expected %d\n",
+				sband->bitrates[i].bitrate / 10,
+				sband->bitrates[i].bitrate % 10,
+				plcp, ofdm ? " OFDM" : "", idx, i);
+			res = NOT_OK;
+		}
+	}
+	log(L_INIT, "rx rate decode selftest %s\n",
+		res == OK ? "passed" : "FAILED");
+
+	return res;
+}
+#endif
+
 /*
  * acx_l_rx
  *
@@ -116,8 +232,10 @@ static void acx_rx(acx_device_t *adev, rxbuffer_t *rxbuf)
 
 	struct ieee80211_hdr *w_hdr;
 	struct sk_buff *skb;
+	struct ieee80211_supported_band *sband;
 	int buflen;
 	int level;
+	int ofdm, rate_idx;
 
 	if (unlikely(!test_bit(ACX_FLAG_HW_UP, &adev->flags))) {
 		pr_info("asked to receive a packet while hw down\n");
@@ -150,28 +268,38 @@ static void acx_rx(acx_device_t *adev, rxbuffer_t *rxbuf)
 	 */
 	status->signal = level;
 
-	if(adev->hw_encrypt_enabled)
-		status->flag = RX_FLAG_DECRYPTED | RX_FLAG_IV_STRIPPED;
+	status->flag = acx_key_rx_flags(adev, w_hdr);
 
 	status->freq = adev->rx_status.freq;
 	status->band = adev->rx_status.band;
 
 	status->antenna = 1;
 
-	/* TODO I'm not sure whether this is (currently) really required. In tests
-	 * this didn't made a difference. Maybe compare what other drivers do.
-	 * TODO Verify translation to rate_idx.
-	 */
-#if 0
-	if (rxbuf->phy_stat_baseband & (1 << 3)) /* Uses OFDM */
-		status->rate_idx =
-			acx_plcp_get_bitrate_ofdm(rxbuf->phy_plcp_signal);
-	else
-		status->rate_idx =
-			acx_plcp_get_bitrate_cck(rxbuf->phy_plcp_signal);
-#endif
+	/* Bit 2 of phy_stat_baseband flags OFDM, bit 3 only selects
+	 * PBCC vs CCK. The OFDM and CCK codes overlap (0x0A), so only
+	 * try the other modulation if the flagged one doesn't decode */
+	ofdm = !!(rxbuf->phy_stat_baseband & RXBUF_PHY_STAT_OFDM);
+	sband = adev->hw->wiphy->bands[status->band];
+	rate_idx = acx_plcp_to_rate_idx(sband, rxbuf->phy_plcp_signal, ofdm);
+	if (unlikely(rate_idx < 0))
+		rate_idx = acx_plcp_to_rate_idx(sband,
+					rxbuf->phy_plcp_signal, !ofdm);
+	if (likely(rate_idx >= 0)) {
+		status->rate_idx = rate_idx;
+		adev->rx_rate_hist[rate_idx]++;
+	} else
+		adev->rx_rate_hist[ACX_RX_RATE_STATS_CNT]++;
+
+	trace_acx_rx(adev, buflen, status->signal, rate_idx,
+		rxbuf->phy_plcp_signal, rxbuf->phy_stat_baseband);
+
+	/* the skb belongs to the stack after this */
+	adev->stats.rx_packets++;
+	adev->stats.rx_bytes += skb->len;
 
-	if (IS_PCI(adev)) {
+	if (IS_SIM(adev) && unlikely(test_bit(ACX_FLAG_BENCH, &adev->flags)))
+		acxsim_bench_consume(adev, skb);
+	else if (IS_PCI(adev)) {
 #if CONFIG_ACX_MAC80211_VERSION <= KERNEL_VERSION(2, 6, 32)
 		local_bh_disable();
 		ieee80211_rx(adev->hw, skb);
@@ -185,10 +313,128 @@ static void acx_rx(acx_device_t *adev, rxbuffer_t *rxbuf)
 		ieee80211_rx_irqsafe(adev->hw, skb);
 	else
 		logf0(L_ANY, "ERROR: Undefined device type !?\n");
+}
 
-	adev->stats.rx_packets++;
-	adev->stats.rx_bytes += skb->len;
+/*
+ * BOM Rx capture
+ * ==================================================
+ */
+
+/* Appends rxbuf to the capture buffer, see rx.h for the format */
+static void acx_rx_capture(acx_device_t *adev, rxbuffer_t *rxbuf)
+{
+	struct acx_rx_capture *cap;
+	acx_rxcap_rec_t *rec;
+	unsigned long flags;
+	unsigned int len;
+
+	len = min_t(unsigned int, RXBUF_BYTES_USED(rxbuf), sizeof(*rxbuf));
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	cap = adev->rx_capture;
+	if (!cap || !cap->active)
+		goto out;
+	if (cap->len + sizeof(*rec) + len > cap->size) {
+		cap->dropped++;
+		goto out;
+	}
+
+	rec = (acx_rxcap_rec_t *) (cap->data + cap->len);
+	rec->len = cpu_to_le16(len);
+	rec->phy_header_len = adev->phy_header_len;
+	rec->reserved = 0;
+	rec->usec = cpu_to_le32((u32) ktime_us_delta(ktime_get(), cap->start));
+	memcpy(rec + 1, rxbuf, len);
+
+	cap->len += sizeof(*rec) + len;
+	cap->records++;
+out:
+	spin_unlock_irqrestore(&adev->spinlock, flags);
+}
+
+/*
+ * acx_rx_capture_start
+ *
+ * Starts recording every rx buffer into a fresh buffer of size bytes,
+ * dropping a previous capture.  Recording stops when the buffer is
+ * full or on acx_rx_capture_stop().
+ */
+int acx_rx_capture_start(acx_device_t *adev, size_t size)
+{
+	struct acx_rx_capture *cap, *old;
+	unsigned long flags;
+
+	cap = vmalloc(sizeof(*cap) + size);
+	if (!cap)
+		return -ENOMEM;
+	memset(cap, 0, sizeof(*cap));
+	cap->size = size;
+	cap->start = ktime_get();
+	cap->active = 1;
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	old = adev->rx_capture;
+	adev->rx_capture = cap;
+	spin_unlock_irqrestore(&adev->spinlock, flags);
+
+	vfree(old);
+	log(L_ANY, "rx capture started, %zu bytes\n", size);
+
+	return 0;
+}
+
+void acx_rx_capture_stop(acx_device_t *adev)
+{
+	struct acx_rx_capture *cap;
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	cap = adev->rx_capture;
+	if (cap)
+		cap->active = 0;
+	spin_unlock_irqrestore(&adev->spinlock, flags);
+
+	if (cap)
+		log(L_ANY, "rx capture stopped: %lu records, %zu bytes, "
+			"%lu dropped\n", cap->records, cap->len, cap->dropped);
+}
+
+void acx_rx_capture_free(acx_device_t *adev)
+{
+	struct acx_rx_capture *cap;
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	cap = adev->rx_capture;
+	adev->rx_capture = NULL;
+	spin_unlock_irqrestore(&adev->spinlock, flags);
+
+	vfree(cap);
+}
+
+/* Ought to be called with acx_sem held, which keeps the capture from
+ * being replaced.  Only a stopped capture is read, so that it doesn't
+ * change under us */
+int acx_rx_capture_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acx_rx_capture *cap = adev->rx_capture;
+	acx_rxcap_hdr_t hdr;
+
+	if (!cap)
+		return 0;
+	if (cap->active)
+		return -EBUSY;
 
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, ACX_RXCAP_MAGIC, sizeof(hdr.magic));
+	hdr.version = cpu_to_le16(ACX_RXCAP_VERSION);
+	hdr.chip_type = adev->chip_type;
+	hdr.dev_type = adev->dev_type;
+
+	seq_write(file, &hdr, sizeof(hdr));
+	seq_write(file, cap->data, cap->len);
+
+	return 0;
 }
 
 /*
@@ -201,7 +447,8 @@ void acx_process_rxbuf(acx_device_t *adev, rxbuffer_t *rxbuf)
 	struct ieee80211_hdr *hdr;
 	u16 fc, buf_len;
 
-
+	if (unlikely(adev->rx_capture))
+		acx_rx_capture(adev, rxbuf);
 
 	hdr = acx_get_wlan_hdr(adev, rxbuf);
 	fc = le16_to_cpu(hdr->frame_control);
@@ -210,7 +457,7 @@ void acx_process_rxbuf(acx_device_t *adev, rxbuffer_t *rxbuf)
 
 	/* For debugging */
 	if (((IEEE80211_FCTL_STYPE & fc) != IEEE80211_STYPE_BEACON)
-		&& (acx_debug & (L_XFER|L_DATA))) {
+		&& (acx_debug_on(L_XFER|L_DATA))) {
 
 		printk_ratelimited(
 			"acx: rx: %s time:%u len:%u signal:%u,raw=%u"
@@ -227,11 +474,15 @@ void acx_process_rxbuf(acx_device_t *adev, rxbuffer_t *rxbuf)
 			adev->status);
 	}
 
-	if (unlikely(acx_debug & L_DATA)) {
+	if (unlikely(acx_debug_on(L_DATA))) {
 		pr_info("rx: 802.11 buf[%u]: \n", buf_len);
 		acx_dump_bytes(hdr, buf_len);
 	}
 
+	acx_rx_filter_account(adev, hdr);
+	acx_bcn_filter_rx(adev, hdr,
+		acx_signal_to_winlevel(rxbuf->phy_level));
+	acx_sta_rx(adev, hdr, RXBUF_BYTES_RCVD(adev, rxbuf));
 	acx_rx(adev, rxbuf);
 
 	/* Now check Rx quality level, AFTER processing packet.  I
@@ -248,62 +499,3 @@ void acx_process_rxbuf(acx_device_t *adev, rxbuffer_t *rxbuf)
 
 
 }
-
-/* TODO Verify these functions: translation rxbuffer.phy_plcp_signal to rate_idx */
-#if 0
-
-/** Rate values **/
-#define ACX_CCK_RATE_1MB            0
-#define ACX_CCK_RATE_2MB            1
-#define ACX_CCK_RATE_5MB            2
-#define ACX_CCK_RATE_11MB           3
-#define ACX_OFDM_RATE_6MB           4
-#define ACX_OFDM_RATE_9MB           5
-#define ACX_OFDM_RATE_12MB          6
-#define ACX_OFDM_RATE_18MB          7
-#define ACX_OFDM_RATE_24MB          8
-#define ACX_OFDM_RATE_36MB          9
-#define ACX_OFDM_RATE_48MB          10
-#define ACX_OFDM_RATE_54MB          11
-
-static u8 acx_plcp_get_bitrate_cck(u8 plcp)
-{
-        switch (plcp) {
-        case 0x0A:
-                return ACX_CCK_RATE_1MB;
-        case 0x14:
-                return ACX_CCK_RATE_2MB;
-        case 0x37:
-                return ACX_CCK_RATE_5MB;
-        case 0x6E:
-                return ACX_CCK_RATE_11MB;
-        }
-        return 0;
-}
-
-/* Extract the bitrate out of an OFDM PLCP header. */
-static u8 acx_plcp_get_bitrate_ofdm(u8 plcp)
-{
-        switch (plcp & 0xF) {
-        case 0xB:
-                return ACX_OFDM_RATE_6MB;
-        case 0xF:
-                return ACX_OFDM_RATE_9MB;
-        case 0xA:
-                return ACX_OFDM_RATE_12MB;
-        case 0xE:
-                return ACX_OFDM_RATE_18MB;
-        case 0x9:
-                return ACX_OFDM_RATE_24MB;
-        case 0xD:
-                return ACX_OFDM_RATE_36MB;
-        case 0x8:
-                return ACX_OFDM_RATE_48MB;
-        case 0xC:
-                return ACX_OFDM_RATE_54MB;
-        }
-        return 0;
-}
-#endif
-
-
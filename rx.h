@@ -1,8 +1,48 @@
 #ifndef _ACX_RX_H_
 #define _ACX_RX_H_
 
+struct seq_file;
+
+/*
+ * rx capture format, as read from the "rx_capture" debugfs file and
+ * accepted by "rx_replay" of a simulated device: an acx_rxcap_hdr_t,
+ * then for every buffer passed to acx_process_rxbuf() an
+ * acx_rxcap_rec_t followed by len bytes of the rxbuffer_t as the
+ * firmware delivered it, phy header included.  Little endian.
+ */
+#define ACX_RXCAP_MAGIC		"ACXRXCAP"
+#define ACX_RXCAP_VERSION	1
+#define ACX_RXCAP_MAX_KB	2048
+
+typedef struct acx_rxcap_hdr {
+	char	magic[8];
+	u16	version;
+	u8	chip_type;
+	u8	dev_type;
+	u32	reserved;
+} ACX_PACKED acx_rxcap_hdr_t;
+
+typedef struct acx_rxcap_rec {
+	u16	len;
+	u8	phy_header_len;		/* of the capturing device */
+	u8	reserved;
+	u32	usec;			/* since the capture started */
+} ACX_PACKED acx_rxcap_rec_t;
+
 void acx_process_rxbuf(acx_device_t *adev, rxbuffer_t *rxbuf);
+int acx_rx_capture_start(acx_device_t *adev, size_t size);
+void acx_rx_capture_stop(acx_device_t *adev);
+void acx_rx_capture_free(acx_device_t *adev);
+int acx_rx_capture_output(struct seq_file *file, acx_device_t *adev);
 u8 acx_signal_determine_quality(u8 signal, u8 noise);
+int acx_plcp_to_rate_idx(struct ieee80211_supported_band *sband,
+			u8 plcp, int ofdm);
+
+#if ACX_DEBUG
+int acx_rx_rate_selftest(acx_device_t *adev);
+#else
+static inline int acx_rx_rate_selftest(acx_device_t *adev) { return OK; }
+#endif
 
 #if !ACX_DEBUG
 static inline const char *acx_get_packet_type_string(u16 fc) { return ""; }
@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2012
+ * The ACX100 Open Source Project <acx100-devel@lists.sourceforge.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hardware scan
+ *
+ * A hw_scan request from mac80211 names the channels, the SSIDs to probe
+ * for and possibly the dwell time.  The firmware scan takes a single
+ * probe request template and one set of timings, so the request is run
+ * as a series of firmware scans ("passes"):
+ *
+ * - one active pass per SSID, over the channels we may transmit on,
+ * - one passive pass over the channels we may only listen on, with a
+ *   dwell long enough for one beacon.
+ *
+ * The ACX111 takes the channel list of the pass.  The ACX100 only takes
+ * a start channel, so there the request is run one channel at a time,
+ * as it is while the channel survey is sampled (see survey.c).
+ *
+ * Each HOST_INT_SCAN_COMPLETE schedules the next pass, which needs
+ * commands, from the after-interrupt task; the last one completes the
+ * request.
+ *
+ * While associated, the scan is a background one: every pass covers a
+ * single channel and has ACX_SCAN_OPT_BACKGROUND set, so the firmware
+ * tells our AP we're dozing (with the null data template) before it
+ * leaves and wakes up again when back.  Between the passes we stay
+ * ACX_SCAN_HOME_DWELL ms on our channel for the frames the AP buffered,
+ * so the traffic keeps flowing during roaming scans.  A pass doesn't
+ * start while the null data frame of a power save change may still be
+ * pending (see acx_ps_settling()): it waits in the scan work.
+ */
+
+#include "acx_debug.h"
+
+#include <linux/seq_file.h>
+#include <net/mac80211.h>
+
+#include "acx.h"
+#include "cmd.h"
+#include "cardsetting.h"
+#include "survey.h"
+#include "scan.h"
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 14, 0)
+#define ACX_CHAN_NO_TX	IEEE80211_CHAN_NO_IR
+#else
+#define ACX_CHAN_NO_TX	IEEE80211_CHAN_PASSIVE_SCAN
+#endif
+
+static int acx_scan_set_probe(acx_device_t *adev, int ssid)
+{
+	struct cfg80211_scan_request *req = adev->scan.req;
+	struct sk_buff *skb;
+	int res;
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 1, 0)
+
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(3, 8, 0)
+	skb = ieee80211_probereq_get(adev->hw, adev->vif,
+		req->ssids[ssid].ssid, req->ssids[ssid].ssid_len,
+		req->ie, req->ie_len);
+	if (!skb)
+		return -ENOMEM;
+#else
+	skb = ieee80211_probereq_get(adev->hw, adev->vif,
+		req->ssids[ssid].ssid, req->ssids[ssid].ssid_len,
+		req->ie_len);
+	if (!skb)
+		return -ENOMEM;
+	if (req->ie_len)
+		memcpy(skb_put(skb, req->ie_len), req->ie, req->ie_len);
+#endif
+
+#else
+	return -EOPNOTSUPP;
+#endif
+
+	res = acx_set_probe_request_template(adev, skb->data, skb->len);
+	dev_kfree_skb(skb);
+
+	return res;
+}
+
+/* Picks the next pass of the request, 0 when there is none left */
+static int acx_scan_next_pass(acx_device_t *adev, struct acx_scan_pass *p)
+{
+	struct acx_scan *s = &adev->scan;
+	int n_ssids = s->req->n_ssids;
+	u16 bit;
+
+	if (!s->chunked) {
+		if (s->active && s->ssid < n_ssids) {
+			p->chans = s->active;
+			p->ssid = s->ssid++;
+			return 1;
+		}
+		s->active = 0;
+		if (!s->passive)
+			return 0;
+		p->chans = s->passive;
+		p->ssid = -1;
+		s->passive = 0;
+		return 1;
+	}
+
+	/* more probe requests on the current channel? */
+	if (s->chan) {
+		bit = BIT(s->chan - 1);
+		if ((s->active & bit) && s->ssid < n_ssids) {
+			p->chans = bit;
+			p->ssid = s->ssid++;
+			return 1;
+		}
+		s->active &= ~bit;
+		s->passive &= ~bit;
+	}
+
+	if (!(s->active | s->passive))
+		return 0;
+
+	s->chan = ffs(s->active | s->passive);
+	s->ssid = 0;
+	bit = BIT(s->chan - 1);
+
+	p->chans = bit;
+	if (s->passive & bit)
+		p->ssid = -1;
+	else
+		p->ssid = s->ssid++;
+	return 1;
+}
+
+static int acx_scan_run_pass(acx_device_t *adev, struct acx_scan_pass *p)
+{
+	struct acx_scan *s = &adev->scan;
+	u16 min_dwell = adev->scan_duration;
+	u16 max_dwell = adev->scan_probe_delay;
+	u8 options = ACX_SCAN_OPT_ACTIVE;
+	int res;
+
+	if (s->background)
+		options |= ACX_SCAN_OPT_BACKGROUND;
+
+	if (p->ssid < 0) {
+		options |= ACX_SCAN_OPT_PASSIVE;
+		max_dwell = ACX_SCAN_PASSIVE_DWELL;
+	} else {
+		res = acx_scan_set_probe(adev, p->ssid);
+		if (res)
+			return res;
+	}
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(4, 9, 0)
+	if (s->req->duration)
+		min_dwell = max_dwell = s->req->duration;
+#endif
+
+	log(L_INIT, "scan pass %u: channels 0x%04X, %s, dwell %u-%u TU\n",
+		s->passes, p->chans, p->ssid < 0 ? "passive" : "active",
+		min_dwell, max_dwell);
+
+	acx_survey_scan_start(adev, p->chans);
+	res = acx_cmd_scan(adev, p->chans, options, min_dwell, max_dwell);
+	if (res)
+		return -EIO;
+
+	s->passes++;
+	s->in_pass = 1;
+	s->pass_start = jiffies;
+	/* for the watchdog's scan timeout */
+	adev->scan_start = jiffies;
+
+	return 0;
+}
+
+/* time on our channel since the start, in percent */
+static unsigned int acx_scan_home_pct(struct acx_scan *s, unsigned long now)
+{
+	unsigned long total = now - s->start, off = s->off_channel;
+
+	if (s->in_pass)
+		off += now - s->pass_start;
+	if (!total || off >= total)
+		return 0;
+	return 100 - off * 100 / total;
+}
+
+static void acx_scan_done(acx_device_t *adev, bool aborted)
+{
+	struct acx_scan *s = &adev->scan;
+	unsigned long now = jiffies;
+
+	ieee80211_scan_completed(adev->hw, aborted);
+	clear_bit(ACX_FLAG_SCANNING, &adev->flags);
+
+	s->req = NULL;
+	s->in_pass = 0;
+	s->last_ms = jiffies_to_msecs(now - s->start);
+	s->last_passes = s->passes;
+	s->last_channels = s->channels;
+	if (aborted)
+		s->failed++;
+
+	log(L_INIT, "scan %s: %u channels, %u passes, %u ms\n",
+		aborted ? "aborted" : "completed", s->channels, s->passes,
+		s->last_ms);
+
+	if (s->background) {
+		s->last_home_pct = acx_scan_home_pct(s, now);
+		log(L_INIT, "background scan: %u%% on our channel\n",
+			s->last_home_pct);
+	}
+
+	/* back to the BSSID filter, if any */
+	acx_update_rx_filter(adev);
+}
+
+/* Holds a background pass back while a power save change settles */
+static int acx_scan_ps_wait(acx_device_t *adev)
+{
+	struct acx_scan *s = &adev->scan;
+	unsigned long wait;
+
+	if (!s->background)
+		return 0;
+	wait = acx_ps_settling(adev);
+	if (!wait)
+		return 0;
+
+	s->ps_waits++;
+	log(L_INIT, "background scan: waiting %u ms for power save\n",
+		jiffies_to_msecs(wait));
+	ieee80211_queue_delayed_work(adev->hw, &adev->scan_work, wait);
+	return 1;
+}
+
+/*
+ * acx_scan_continue
+ *
+ * Starts the pass picked in adev->scan.next, with the sem held.  Called
+ * from acx_scan_next(), or from the scan work after the time on our
+ * channel of a background scan.
+ */
+void acx_scan_continue(acx_device_t *adev)
+{
+	struct acx_scan *s = &adev->scan;
+
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags)
+	    || !test_bit(ACX_FLAG_SCANNING, &adev->flags) || !s->req
+	    || s->in_pass)
+		return;
+
+	if (acx_scan_ps_wait(adev))
+		return;
+
+	if (acx_scan_run_pass(adev, &s->next))
+		acx_scan_done(adev, true);
+}
+
+/*
+ * acx_scan_next
+ *
+ * Called with the sem held when a firmware scan completed: starts the
+ * next pass or completes the request.
+ */
+void acx_scan_next(acx_device_t *adev)
+{
+	struct acx_scan *s = &adev->scan;
+
+	if (!test_bit(ACX_FLAG_SCANNING, &adev->flags) || !s->req)
+		return;
+
+	if (s->in_pass) {
+		s->in_pass = 0;
+		acx_survey_scan_done(adev);
+		if (s->background)
+			s->off_channel += jiffies - s->pass_start;
+	}
+
+	if (!acx_scan_next_pass(adev, &s->next)) {
+		acx_scan_done(adev, false);
+		return;
+	}
+
+	if (s->background) {
+		ieee80211_queue_delayed_work(adev->hw, &adev->scan_work,
+			msecs_to_jiffies(ACX_SCAN_HOME_DWELL));
+		return;
+	}
+
+	acx_scan_continue(adev);
+}
+
+/*
+ * acx_scan_start
+ *
+ * Called from acx_op_hw_scan() with the sem held.  req stays valid until
+ * the scan is reported completed.
+ */
+int acx_scan_start(acx_device_t *adev, struct cfg80211_scan_request *req)
+{
+	struct acx_scan *s = &adev->scan;
+	struct ieee80211_channel *chan;
+	int i, res;
+
+	s->req = req;
+	s->active = s->passive = 0;
+	s->chan = 0;
+	s->ssid = 0;
+	s->passes = 0;
+	s->channels = 0;
+	s->in_pass = 0;
+	s->off_channel = 0;
+
+	/* the firmware sends the null data frames to our AP */
+	s->background = (adev->scan_mode & ACX_SCAN_OPT_BACKGROUND)
+		&& adev->mode == ACX_MODE_2_STA && adev->associated
+		&& OK == acx_set_null_data_template(adev);
+	/* a survey is sampled one channel at a time */
+	s->chunked = s->background || !IS_ACX111(adev)
+		|| acx_survey_active(adev);
+
+	for (i = 0; i < req->n_channels; i++) {
+		chan = req->channels[i];
+		if (chan->band != IEEE80211_BAND_2GHZ || !chan->hw_value
+		    || chan->hw_value > 14)
+			continue;
+		if (!req->n_ssids || (chan->flags & ACX_CHAN_NO_TX))
+			s->passive |= BIT(chan->hw_value - 1);
+		else
+			s->active |= BIT(chan->hw_value - 1);
+		s->channels++;
+	}
+
+	if (!s->channels) {
+		s->req = NULL;
+		return -EINVAL;
+	}
+
+	acx_scan_next_pass(adev, &s->next);
+
+	log(L_INIT, "%s scan start: %u channels, %d ssids\n",
+		s->background ? "background" : "foreground", s->channels,
+		req->n_ssids);
+	/* close the window on our channel */
+	acx_survey_sample(adev);
+	set_bit(ACX_FLAG_SCANNING, &adev->flags);
+	s->start = jiffies;
+	s->count++;
+	if (s->background)
+		s->background_count++;
+	/* let the other BSSs in, see acx_rx_config_filter() */
+	acx_update_rx_filter(adev);
+
+	if (acx_scan_ps_wait(adev))
+		return 0;
+
+	res = acx_scan_run_pass(adev, &s->next);
+	if (res) {
+		clear_bit(ACX_FLAG_SCANNING, &adev->flags);
+		s->req = NULL;
+		s->failed++;
+		acx_update_rx_filter(adev);
+	}
+
+	return res;
+}
+
+int acx_scan_dbgfs_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acx_scan *s = &adev->scan;
+
+	acx_sem_lock(adev);
+
+	seq_printf(file,
+		"state:\t%s\n"
+		"background scans:\t%s\n"
+		"scans:\t%lu\n"
+		"background:\t%lu\n"
+		"held for power save:\t%lu\n"
+		"failed:\t%lu\n"
+		"max ssids:\t%d\n"
+		"last scan:\t%u channels, %u passes, %u ms\n"
+		"last background scan:\t%u%% on our channel\n",
+		test_bit(ACX_FLAG_SCANNING, &adev->flags) ? "scanning" : "idle",
+		(adev->scan_mode & ACX_SCAN_OPT_BACKGROUND) ? "on" : "off",
+		s->count, s->background_count, s->ps_waits, s->failed,
+		ACX_SCAN_MAX_SSIDS,
+		s->last_channels, s->last_passes, s->last_ms,
+		s->last_home_pct);
+
+	if (test_bit(ACX_FLAG_SCANNING, &adev->flags)) {
+		seq_printf(file, "current scan:\t%u of %u channels left, "
+			"pass %u, %u ms\n",
+			hweight16(s->active | s->passive), s->channels,
+			s->passes, jiffies_to_msecs(jiffies - s->start));
+		if (s->background)
+			seq_printf(file, "on our channel:\t%u%%\n",
+				acx_scan_home_pct(s, jiffies));
+	}
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
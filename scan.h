@@ -0,0 +1,20 @@
+#ifndef _ACX_SCAN_H_
+#define _ACX_SCAN_H_
+
+struct seq_file;
+
+/* probe requests of a hw_scan, one firmware scan each */
+#define ACX_SCAN_MAX_SSIDS	4
+
+/* time on a passive channel, TU: catches one beacon at the usual 100 TU */
+#define ACX_SCAN_PASSIVE_DWELL	120
+
+/* time on our channel between background passes */
+#define ACX_SCAN_HOME_DWELL	100
+
+int acx_scan_start(acx_device_t *adev, struct cfg80211_scan_request *req);
+void acx_scan_next(acx_device_t *adev);
+void acx_scan_continue(acx_device_t *adev);
+int acx_scan_dbgfs_output(struct seq_file *file, acx_device_t *adev);
+
+#endif
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Record rx buffers on a live device and replay them on a simulated one
+# (see the "rx_capture" and "rx_replay" debugfs files, format in rx.h).
+#
+# usage: acx-rx-replay.sh capture <phy> <seconds> <file> [kbytes]
+#        acx-rx-replay.sh replay <phy> <file> [frames]
+#
+#   capture: records whatever <phy> receives for <seconds> (up to
+#            kbytes, default 1024) into <file>
+#   replay:  runs <file> through the rx path of the simulated device
+#            <phy> until at least [frames] (default 1000) records went
+#            through, and prints frames/s
+
+dbgfs=/sys/kernel/debug/acx_mac80211
+
+usage() {
+    sed -n '5,6p' $0 | sed 's/^# //'
+    exit 1
+}
+
+[ $# -ge 3 ] || usage
+cmd=$1
+dir=$dbgfs/$2
+if [ ! -d $dir ] ; then
+    echo "no $dir (module loaded, debugfs mounted?)"
+    exit 1
+fi
+
+case $cmd in
+capture)
+    [ $# -ge 4 ] || usage
+    echo ${5:-1024} > $dir/rx_capture || exit 1
+    echo "capturing rx on $2 for $3 seconds"
+    sleep $3
+    echo 0 > $dir/rx_capture
+    cat $dir/rx_capture > $4
+    echo "$(stat -c %s $4) bytes saved in $4"
+    ;;
+replay)
+    [ -n "$4" ] && echo $4 > $dir/bench
+    # the whole capture has to go through a single open
+    dd if=$3 of=$dir/rx_replay bs=4M 2>/dev/null || exit 1
+    cat $dir/rx_replay
+    ;;
+*)
+    usage
+    ;;
+esac
@@ -0,0 +1,100 @@
+#!/bin/bash
+# Record the acx tracepoints for a while and summarize latencies:
+#   - tx: acx_tx_submit -> acx_tx_complete, matched on the skb pointer
+#   - cmd: latency_us reported by acx_cmd_done, per command
+#   - irq / queue stop / queue wake counts
+#
+# usage: acx-trace-latency.sh [seconds] [tracefile]
+#   with a tracefile (a saved copy of tracing/trace), nothing is recorded
+
+secs=${1:-10}
+tracefile=$2
+tracing=/sys/kernel/debug/tracing
+[ -d $tracing ] || tracing=/sys/kernel/tracing
+
+if [ -z "$tracefile" ] ; then
+    if [ ! -d $tracing/events/acx ] ; then
+	echo "no acx tracepoints in $tracing (module loaded, debugfs mounted?)"
+	exit 1
+    fi
+    tracefile=$(mktemp /tmp/acx-trace.XXXXXX)
+    echo > $tracing/trace
+    echo 1 > $tracing/events/acx/enable
+    echo "recording acx events for $secs seconds"
+    sleep $secs
+    echo 0 > $tracing/events/acx/enable
+    cat $tracing/trace > $tracefile
+    echo "raw trace saved in $tracefile"
+fi
+
+latfile=$(mktemp /tmp/acx-lat.XXXXXX)
+
+# ftrace lines look like:
+#   <task>-<pid> [cpu] flags <timestamp>: acx_tx_submit: phy0 skb=... len=...
+awk -v latfile=$latfile '
+function field(name,   i) {
+    for (i = 1; i <= NF; i++)
+	if (index($i, name "=") == 1)
+	    return substr($i, length(name) + 2)
+    return ""
+}
+function stamp(   i) {
+    for (i = 1; i <= NF; i++)
+	if ($i ~ /^[0-9]+\.[0-9]+:$/)
+	    return substr($i, 1, length($i) - 1) * 1000000
+    return 0
+}
+/ acx_tx_submit: / {
+    pending[field("skb")] = stamp()
+    submitted++
+}
+/ acx_tx_complete: / {
+    skb = field("skb")
+    if (!(skb in pending)) {
+	unmatched++
+	next
+    }
+    us = stamp() - pending[skb]
+    delete pending[skb]
+    print us > latfile
+    ntx++
+    if (field("ack_failures") > 0)
+	retried++
+}
+/ acx_cmd_done: / {
+    cmd = field("cmd")
+    for (i = 1; i < NF; i++)
+	if ($i ~ /^\(/)
+	    cmd = substr($i, 2, length($i) - 2)
+    us = field("latency_us")
+    cmdcnt[cmd]++
+    cmdsum[cmd] += us
+    if (us > cmdmax[cmd])
+	cmdmax[cmd] = us
+    if (field("res") != 0)
+	cmderr[cmd]++
+}
+/ acx_irq: /		{ irqs++ }
+/ acx_queue_stop: /	{ stops++ }
+/ acx_queue_wake: /	{ wakes++ }
+END {
+    printf "tx: %d submitted, %d completed, %d retried, %d unmatched\n",
+	submitted, ntx, retried, unmatched
+    printf "irqs: %d, queue stops: %d, wakes: %d\n", irqs, stops, wakes
+    printf "\n%-16s %8s %10s %10s %6s\n", "cmd", "count", "avg_us", "max_us", "errors"
+    for (c in cmdcnt)
+	printf "%-16s %8d %10d %10d %6d\n", c, cmdcnt[c],
+	    cmdsum[c] / cmdcnt[c], cmdmax[c], cmderr[c]
+}
+' $tracefile
+
+sort -n $latfile | awk '
+{ lat[n++] = $1; sum += $1 }
+END {
+    if (n)
+	printf "\ntx latency us: min %d avg %d p50 %d p90 %d p99 %d max %d\n",
+	    lat[0], sum / n, lat[int(n * 0.5)], lat[int(n * 0.9)],
+	    lat[int(n * 0.99)], lat[n - 1]
+}
+'
+rm -f $latfile
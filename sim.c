@@ -0,0 +1,1737 @@
+/*
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2012
+ * The ACX100 Open Source Project <acx100-devel@lists.sourceforge.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulated ACX111 (DEVTYPE_SIM)
+ *
+ * A software model of an ACX111 PCI card, for exercising the driver
+ * (tx/rx paths, command mailbox, irq handling) without hardware.
+ * The device presents the PCI register, mailbox and descriptor
+ * interface, so everything above the register accessors runs the
+ * unmodified PCI code paths; read_reg*()/write_reg*() in inlines.h
+ * divert into acxsim_read_reg()/acxsim_write_reg() below.
+ *
+ * What the "firmware" does:
+ * - boot: firmware upload into a code memory (checksummed by the
+ *   driver as usual), eeprom and phy register access
+ * - commands complete synchronously when INT_TRIG_CMD is written;
+ *   configured IEs are stored and returned by INTERROGATE
+ * - tx: on INT_TRIG_TXPRC a tasklet completes all descriptors handed
+ *   over by the host, reports the highest rate of the set and no
+ *   retries, and raises HOST_INT_TX_COMPLETE
+ * - rx: there is no air, so unicast data frames are looped back as
+ *   if the peer echoed them (addr1/addr2 swapped) into the rx ring,
+ *   followed by HOST_INT_RX_COMPLETE
+ * - irqs are delivered from the tasklet by calling acx_interrupt()
+ *   whenever an unmasked reason is pending and FEMR enables them
+ * - ACX1xx_IE_MEDIUM_USAGE counts the airtime of the frames sent and
+ *   echoed, for the channel survey
+ * - frames longer than ACX111_IE_DOT11_FRAG_THRESH go on the air as
+ *   fragments, counted and timed as such, but are echoed whole
+ *
+ * Load with "sim=N" to create N devices.  Their "bench" and
+ * "rx_replay" debugfs files measure the driver's tx/rx paths, see
+ * below.
+ */
+
+#include "acx_debug.h"
+
+#define pr_acx	pr_info
+
+#include <linux/version.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/interrupt.h>
+#include <linux/dma-mapping.h>
+#include <linux/platform_device.h>
+#include <linux/etherdevice.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <net/mac80211.h>
+
+#include "acx.h"
+#include "pci.h"
+#include "merge.h"
+#include "debug.h"
+#include "io-acx.h"
+#include "cmd.h"
+#include "ie.h"
+#include "main.h"
+#include "cardsetting.h"
+#include "survey.h"
+#include "boot.h"
+#include "tx.h"
+#include "rx.h"
+#include "sim.h"
+
+/*
+ * BOM Config
+ * ==================================================
+ */
+
+#define ACXSIM_MAX_DEVICES	4
+
+/* layout of the simulated card memory (adev->iobase2) */
+#define ACXSIM_MEM_SIZE		0x4000
+#define ACXSIM_CMD_OFFS		0x0100
+#define ACXSIM_INFO_OFFS	0x1100
+#define ACXSIM_QUEUE_OFFS	0x1200
+
+#define ACXSIM_CODE_SIZE	0x8000	/* firmware code memory */
+#define ACXSIM_FW_SIZE		0x1000	/* synthetic firmware image */
+#define ACXSIM_EEPROM_SIZE	0x400
+#define ACXSIM_PHY_SIZE		0x100
+
+#define ACXSIM_FW_ID		"Rev 2.3.1.31"	/* >= 2.0: 8 byte phy header */
+#define ACXSIM_HW_ID		0x03010101	/* TNETW1130 */
+#define ACXSIM_PHY_HDR_LEN	8
+
+#define ACXSIM_IE_MAX		64
+#define ACXSIM_IE_LEN		0x200
+
+/* values reported in the rxbuffer of looped back frames */
+#define ACXSIM_RX_LEVEL		0x50
+#define ACXSIM_RX_SNR		0x30
+
+/* firmware answer in the cmd mailbox status field */
+#define ACXSIM_CMD_SUCCESS	1
+#define ACXSIM_CMD_UNKNOWN	2
+#define ACXSIM_CMD_INVALID_IE	3
+#define ACXSIM_CMD_MAX		0x21
+
+#define ACXSIM_TRIG_TX		0
+
+/* debugfs "bench": frames run per frame size, default and limit */
+#define ACXSIM_BENCH_FRAMES	1000
+#define ACXSIM_BENCH_FRAMES_MAX	1000000
+
+/* fragmentation threshold of the bench, the lowest mac80211 allows */
+#define ACXSIM_BENCH_FRAG_THRESH	256
+
+#define ACXSIM_REPLAY_SIZE	(sizeof(acx_rxcap_hdr_t) + ACX_RXCAP_MAX_KB * 1024)
+
+static int acxsim_devices;
+module_param_named(sim, acxsim_devices, int, 0444);
+MODULE_PARM_DESC(sim, "Number of simulated acx111 devices to create (default 0)");
+
+/*
+ * BOM Defines, static vars, etc.
+ * ==================================================
+ */
+
+struct acxsim_ie {
+	u16	type;
+	u16	len;
+	u8	data[ACXSIM_IE_LEN];
+};
+
+struct acxsim {
+	acx_device_t		*adev;
+	struct platform_device	*pdev;
+
+	/* protects everything below; taken by the register accessors,
+	 * so never held while calling into the driver */
+	spinlock_t		lock;
+	struct tasklet_struct	tasklet;
+	unsigned long		trig;
+
+	u32			regs[IO_ACX_ECPU_CTRL + 1];
+	u16			irq_status;
+	u32			slv_addr;
+	int			booted;
+
+	u8			*mem;		/* = adev->iobase2 */
+	u32			*code;
+	u8			eeprom[ACXSIM_EEPROM_SIZE];
+	u8			phy[ACXSIM_PHY_SIZE];
+
+	struct acxsim_ie	ies[ACXSIM_IE_MAX];
+	int			num_ies;
+
+	int			rx_enabled;
+	int			tx_enabled;
+	u8			channel;
+
+	int			num_tx_queues;
+	u32			tx_queue_offs[ACX111_NUM_HW_TX_QUEUES];
+	int			tx_queue_cnt[ACX111_NUM_HW_TX_QUEUES];
+	int			tx_tail[ACX111_NUM_HW_TX_QUEUES];
+	u32			rx_queue_offs;
+	acx_ptr			rx_next;	/* host rx desc, bus address */
+
+	unsigned long		tx_frames;
+	unsigned long		tx_frags;	/* MPDUs of the frames sent */
+	unsigned long		rx_frames;
+	unsigned long		rx_dropped;
+
+	/* ACX1xx_IE_MEDIUM_USAGE: airtime of what went through since
+	 * boot, the peer's echo included */
+	ktime_t			medium_start;
+	u32			medium_busy_us;
+
+	/* register accesses by the driver, for the bench */
+	unsigned long		reg_reads;
+	unsigned long		reg_writes;
+
+	unsigned long		bench_frames;
+	unsigned long		bench_skbs;	/* consumed while benching */
+
+	/* rx capture loaded through debugfs, see acxsim_replay_write() */
+	u8			*replay;
+	size_t			replay_len;
+};
+
+static struct platform_device *acxsim_pdevs[ACXSIM_MAX_DEVICES];
+
+/* rate111 bit position -> PLCP signal, see acx_plcp_to_rate_idx() */
+static const struct {
+	u8 plcp;
+	u8 phy_stat;
+} acxsim_plcp[] = {
+	{ 0x0A, 0 },			/* 1 */
+	{ 0x14, 0 },			/* 2 */
+	{ 0x37, 0 },			/* 5.5 */
+	{ 0x0B, RXBUF_PHY_STAT_OFDM },	/* 6 */
+	{ 0x0F, RXBUF_PHY_STAT_OFDM },	/* 9 */
+	{ 0x6E, 0 },			/* 11 */
+	{ 0x0A, RXBUF_PHY_STAT_OFDM },	/* 12 */
+	{ 0x0E, RXBUF_PHY_STAT_OFDM },	/* 18 */
+	{ 0xDC, RXBUF_PHY_STAT_PBCC },	/* 22 */
+	{ 0x09, RXBUF_PHY_STAT_OFDM },	/* 24 */
+	{ 0x0D, RXBUF_PHY_STAT_OFDM },	/* 36 */
+	{ 0x08, RXBUF_PHY_STAT_OFDM },	/* 48 */
+	{ 0x0C, RXBUF_PHY_STAT_OFDM },	/* 54 */
+};
+
+/* total frame lengths (header included) the bench runs */
+static const int acxsim_bench_sizes[] = {
+	64, 128, 256, 512, 1024, 1500, 2346
+};
+
+/* the bench talks to a made-up peer, locally administered */
+static const u8 acxsim_bench_peer[ETH_ALEN] = {
+	0x02, 0x00, 0x00, 0x5a, 0xff, 0xfe
+};
+
+/*
+ * BOM Helpers
+ * ==================================================
+ */
+
+/* DMA addresses handed to the "firmware" always point into one of the
+ * coherent areas of the descriptor queues, so translate through those
+ * instead of assuming a direct mapping */
+static void *acxsim_region(dma_addr_t addr, size_t len, void *start,
+			dma_addr_t phy, size_t size)
+{
+	if (!start || addr < phy || addr + len > phy + size)
+		return NULL;
+	return (u8 *) start + (addr - phy);
+}
+
+static void *acxsim_bus_to_virt(acx_device_t *adev, acx_ptr ptr, size_t len)
+{
+	dma_addr_t addr = acx2cpu(ptr);
+	struct hw_tx_queue *tx;
+	void *virt;
+	int i;
+
+	virt = acxsim_region(addr, len, adev->hw_rx_queue.hostdescinfo.start,
+			adev->hw_rx_queue.hostdescinfo.phy,
+			adev->hw_rx_queue.hostdescinfo.size);
+	if (!virt)
+		virt = acxsim_region(addr, len, adev->hw_rx_queue.bufinfo.start,
+				adev->hw_rx_queue.bufinfo.phy,
+				adev->hw_rx_queue.bufinfo.size);
+
+	for (i = 0; !virt && i < adev->num_hw_tx_queues; i++) {
+		tx = &adev->hw_tx_queue[i];
+		virt = acxsim_region(addr, len, tx->hostdescinfo.start,
+				tx->hostdescinfo.phy, tx->hostdescinfo.size);
+		if (!virt)
+			virt = acxsim_region(addr, len, tx->bufinfo.start,
+					tx->bufinfo.phy, tx->bufinfo.size);
+	}
+	return virt;
+}
+
+static struct acxsim_ie *acxsim_find_ie(struct acxsim *sim, u16 type)
+{
+	int i;
+
+	for (i = 0; i < sim->num_ies; i++)
+		if (sim->ies[i].type == type)
+			return &sim->ies[i];
+	return NULL;
+}
+
+static void acxsim_store_ie(struct acxsim *sim, u16 type, const u8 *data,
+			u16 len)
+{
+	struct acxsim_ie *ie = acxsim_find_ie(sim, type);
+
+	if (!ie) {
+		if (sim->num_ies >= ACXSIM_IE_MAX) {
+			log(L_ANY, "acxsim: IE store full, dropping 0x%04X\n",
+				type);
+			return;
+		}
+		ie = &sim->ies[sim->num_ies++];
+		ie->type = type;
+	}
+	ie->len = min_t(u16, len, ACXSIM_IE_LEN);
+	memcpy(ie->data, data, ie->len);
+}
+
+/* Ought to be called with sim->lock held.  Command completion is
+ * polled for by the issuer, so it never interrupts */
+static int acxsim_irq_pending(struct acxsim *sim)
+{
+	return (sim->irq_status & ~HOST_INT_CMD_COMPLETE
+			& ~sim->regs[IO_ACX_IRQ_MASK])
+		&& (sim->regs[IO_ACX_FEMR] & 0x8000);
+}
+
+static void acxsim_raise(struct acxsim *sim, u16 irq)
+{
+	sim->irq_status |= irq;
+	if (acxsim_irq_pending(sim))
+		tasklet_schedule(&sim->tasklet);
+}
+
+/*
+ * BOM Firmware model
+ * ==================================================
+ */
+
+static void acxsim_set_default_station_id(struct acxsim *sim)
+{
+	u8 mac[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x5a, 0x00, 0x00 };
+	u8 rev[ETH_ALEN];
+	int i;
+
+	/* locally administered, one per simulated device */
+	mac[5] = sim->pdev->id;
+	for (i = 0; i < ETH_ALEN; i++)
+		rev[ETH_ALEN - 1 - i] = mac[i];
+	acxsim_store_ie(sim, acx_ie_descs[ACX1xx_IE_DOT11_STATION_ID].val,
+			rev, ETH_ALEN);
+}
+
+static void acxsim_reset(struct acxsim *sim)
+{
+	sim->booted = 0;
+	sim->irq_status = 0;
+	sim->num_ies = 0;
+	sim->rx_enabled = sim->tx_enabled = 0;
+	sim->num_tx_queues = 0;
+	sim->rx_next = 0;
+	memset(sim->mem, 0, ACXSIM_MEM_SIZE);
+	acxsim_set_default_station_id(sim);
+}
+
+static void acxsim_boot(struct acxsim *sim)
+{
+	sim->booted = 1;
+	sim->medium_start = ktime_get();
+	sim->medium_busy_us = 0;
+	/* idle cmd mailbox, and tell acx_verify_init() we're up */
+	*(__le32 *) (sim->mem + ACXSIM_CMD_OFFS) = 0;
+	acxsim_raise(sim, HOST_INT_FCS_THRESHOLD);
+}
+
+/* Lay out the descriptor rings the way the acx111 firmware does for
+ * ACX111_IE_MEMORY_CONFIG_OPTIONS: tx queues first, then the rx ring
+ * chained through pNextDesc offsets */
+static int acxsim_config_memory(struct acxsim *sim,
+				const acx111_ie_memoryconfig_t *memconf)
+{
+	const int txdesc_size = sizeof(txacxdesc_t) + 4;
+	rxacxdesc_t *rxdesc;
+	u32 offs = ACXSIM_QUEUE_OFFS;
+	int i, cnt, num_tx;
+
+	num_tx = min_t(int, memconf->count_tx_queues, ACX111_NUM_HW_TX_QUEUES);
+	cnt = memconf->rx_queue1_count_descs;
+	for (i = 0; i < num_tx; i++)
+		offs += memconf->tx_queue[i].count_descs * txdesc_size;
+	if (offs + cnt * sizeof(*rxdesc) > ACXSIM_MEM_SIZE) {
+		pr_acx("acxsim: queues don't fit into the card memory\n");
+		return NOT_OK;
+	}
+
+	memset(sim->mem + ACXSIM_QUEUE_OFFS, 0,
+		ACXSIM_MEM_SIZE - ACXSIM_QUEUE_OFFS);
+
+	offs = ACXSIM_QUEUE_OFFS;
+	sim->num_tx_queues = num_tx;
+	for (i = 0; i < sim->num_tx_queues; i++) {
+		sim->tx_queue_offs[i] = offs;
+		sim->tx_queue_cnt[i] = memconf->tx_queue[i].count_descs;
+		sim->tx_tail[i] = 0;
+		offs += sim->tx_queue_cnt[i] * txdesc_size;
+	}
+
+	sim->rx_queue_offs = offs;
+	for (i = 0; i < cnt; i++) {
+		rxdesc = (rxacxdesc_t *) (sim->mem + offs);
+		offs += sizeof(*rxdesc);
+		rxdesc->pNextDesc = cpu2acx((i == cnt - 1) ?
+					sim->rx_queue_offs : offs);
+	}
+	sim->rx_next = memconf->rx_queue1_host_rx_start;
+
+	return OK;
+}
+
+static void acxsim_interrogate(struct acxsim *sim, u8 *ie, u16 type, u16 len)
+{
+	u8 *data = ie + 4;
+	struct acxsim_ie *stored;
+
+	len = min_t(u16, len, ACXSIM_IE_LEN);
+	memset(data, 0, len);
+
+	if (type == acx_ie_descs[ACX111_IE_QUEUE_CONFIG].val) {
+		acx111_ie_queueconfig_t *qc = (acx111_ie_queueconfig_t *) ie;
+		int i;
+
+		qc->tx_memory_block_address = cpu_to_le32(ACXSIM_QUEUE_OFFS);
+		qc->rx_memory_block_address = cpu_to_le32(sim->rx_queue_offs);
+		qc->rx1_queue_address = cpu_to_le32(sim->rx_queue_offs);
+		for (i = 0; i < sim->num_tx_queues; i++)
+			qc->tx_queue[i].address =
+				cpu_to_le32(sim->tx_queue_offs[i]);
+
+	} else if (type == acx_ie_descs[ACX111_IE_CONFIG_OPTIONS].val) {
+		static const char product[] = "acx-sim";
+		static const char manuf[] = "acx";
+		static const u8 rates[] = {
+			0x02, 0x04, 0x0b, 0x16, 0x0c, 0x12, 0x18, 0x24 };
+		static const u8 domains[] = {
+			0x10, 0x20, 0x30, 0x31, 0x32, 0x40 };
+		u8 *p = data;
+
+		memcpy(p, "SIM", 4);			/* NVSv */
+		p += 8;
+		p += 2;					/* NVS_vendor_offs */
+		*(__le16 *) p = cpu_to_le16(1);		/* unknown */
+		p += 2;
+		*(__le32 *) p = cpu_to_le32(ACXSIM_MEM_SIZE); /* eof_memory */
+		p += 4;
+		*p++ = 4;	/* CCAModes */
+		*p++ = 1;	/* Diversity */
+		*p++ = 1;	/* ShortPreambleOption */
+		*p++ = 1;	/* PBCCOption */
+		*p++ = 0;	/* ChannelAgility */
+		*p++ = 5;	/* PhyType */
+		*p++ = 1;	/* TempType */
+		*p++ = 6;	/* table_count */
+
+		*p++ = 0x01; *p++ = 1; *p++ = 0x01;	/* antennas */
+		*p++ = 0x02; *p++ = 1;			/* power levels */
+		*(__le16 *) p = cpu_to_le16(1);
+		p += 2;
+		*p++ = 0x03; *p++ = sizeof(rates);
+		memcpy(p, rates, sizeof(rates));
+		p += sizeof(rates);
+		*p++ = 0x04; *p++ = sizeof(domains);
+		memcpy(p, domains, sizeof(domains));
+		p += sizeof(domains);
+		*p++ = 0x05; *p++ = sizeof(product) - 1;
+		memcpy(p, product, sizeof(product) - 1);
+		p += sizeof(product) - 1;
+		*p++ = 0x06; *p++ = sizeof(manuf) - 1;
+		memcpy(p, manuf, sizeof(manuf) - 1);
+
+	} else if (type == acx_ie_descs[ACX1xx_IE_MEDIUM_USAGE].val) {
+		acx1xx_ie_medium_usage_t *mu = (acx1xx_ie_medium_usage_t *) ie;
+
+		mu->busy_us = cpu_to_le32(sim->medium_busy_us);
+		mu->total_us = cpu_to_le32((u32) ktime_to_us(
+				ktime_sub(ktime_get(), sim->medium_start)));
+
+	} else if (type == acx_ie_descs[ACX1xx_IE_FWREV].val) {
+		fw_ver_t *fw = (fw_ver_t *) ie;
+
+		strncpy(fw->fw_id, ACXSIM_FW_ID, FW_ID_SIZE);
+		fw->hw_id = cpu_to_le32(ACXSIM_HW_ID);
+
+	} else if ((stored = acxsim_find_ie(sim, type))) {
+		memcpy(data, stored->data, min(len, stored->len));
+	}
+	/* anything else (memory map, statistics, ...) reads as zeroes */
+}
+
+/* Ought to be called with sim->lock held */
+static void acxsim_do_cmd(struct acxsim *sim)
+{
+	u8 *cmd_area = sim->mem + ACXSIM_CMD_OFFS;
+	u8 *param = cmd_area + 4;
+	u16 cmd = le16_to_cpu(*(__le16 *) cmd_area);
+	u16 ie_type = le16_to_cpu(*(__le16 *) param);
+	u16 ie_len = le16_to_cpu(*(__le16 *) (param + 2));
+	u16 status = ACXSIM_CMD_SUCCESS;
+
+	if (cmd == acx_cmd_descs[ACX1xx_CMD_INTERROGATE].val) {
+		acxsim_interrogate(sim, param, ie_type, ie_len);
+
+	} else if (cmd == acx_cmd_descs[ACX1xx_CMD_CONFIGURE].val) {
+		if (ie_type == acx_ie_descs[ACX111_IE_MEMORY_CONFIG_OPTIONS].val
+		    && acxsim_config_memory(sim,
+				(acx111_ie_memoryconfig_t *) param))
+			status = ACXSIM_CMD_INVALID_IE;
+		else
+			acxsim_store_ie(sim, ie_type, param + 4, ie_len);
+
+	} else if (cmd == acx_cmd_descs[ACX1xx_CMD_ENABLE_RX].val) {
+		sim->channel = param[0];
+		sim->rx_enabled = 1;
+	} else if (cmd == acx_cmd_descs[ACX1xx_CMD_ENABLE_TX].val) {
+		sim->channel = param[0];
+		sim->tx_enabled = 1;
+	} else if (cmd == acx_cmd_descs[ACX1xx_CMD_DISABLE_RX].val) {
+		sim->rx_enabled = 0;
+	} else if (cmd == acx_cmd_descs[ACX1xx_CMD_DISABLE_TX].val) {
+		sim->tx_enabled = 0;
+	} else if (cmd == acx_cmd_descs[ACX1xx_CMD_SCAN].val) {
+		/* nothing out there, the scan is over right away */
+		acxsim_raise(sim, HOST_INT_SCAN_COMPLETE);
+	} else if (cmd > ACXSIM_CMD_MAX) {
+		status = ACXSIM_CMD_UNKNOWN;
+	}
+	/* everything else is simply acknowledged */
+
+	*(__le32 *) cmd_area = cpu_to_le32(cmd | (status << 16));
+
+	/* The issuer polls for this and acks it, don't let the irq
+	 * path race with it for IRQ_REASON */
+	sim->irq_status |= HOST_INT_CMD_COMPLETE;
+}
+
+/* Ought to be called with sim->lock held.  The host rx descriptor the
+ * next frame goes to, NULL if the host hasn't caught up yet */
+static rxhostdesc_t *acxsim_rx_next(struct acxsim *sim)
+{
+	rxhostdesc_t *hostdesc;
+
+	hostdesc = acxsim_bus_to_virt(sim->adev, sim->rx_next,
+				sizeof(*hostdesc));
+	if (!hostdesc
+	    || (hostdesc->hd.Ctl_16 & cpu_to_le16(DESC_CTL_HOSTOWN)))
+		return NULL;
+	return hostdesc;
+}
+
+/* The rx buffer of hostdesc, if it holds a frame of len bytes */
+static rxbuffer_t *acxsim_rx_buf(struct acxsim *sim, rxhostdesc_t *hostdesc,
+				int len)
+{
+	if (offsetof(rxbuffer_t, hdr_a3) + ACXSIM_PHY_HDR_LEN + len
+	    > le16_to_cpu(hostdesc->hd.length))
+		return NULL;
+	return acxsim_bus_to_virt(sim->adev, hostdesc->hd.data_phy,
+				le16_to_cpu(hostdesc->hd.length));
+}
+
+/* Hands the filled rx buffer of hostdesc over to the host */
+static void acxsim_rx_commit(struct acxsim *sim, rxhostdesc_t *hostdesc)
+{
+	hostdesc->hd.Status = cpu_to_le32(DESC_STATUS_FULL);
+	wmb();
+	hostdesc->hd.Ctl_16 |= cpu_to_le16(DESC_CTL_HOSTOWN);
+
+	sim->rx_next = hostdesc->hd.desc_phy_next;
+	sim->rx_frames++;
+}
+
+/* Put a copy of a transmitted frame into the rx ring, as if the peer
+ * had sent it back.  Returns 1 if the frame was queued. */
+static int acxsim_loopback(struct acxsim *sim, const u8 *frame, int len,
+			u16 rate111)
+{
+	const struct ieee80211_hdr *txhdr = (const void *) frame;
+	struct ieee80211_hdr *hdr;
+	rxhostdesc_t *hostdesc;
+	rxbuffer_t *rxbuf;
+	unsigned int bit;
+	u16 fc;
+
+	if (len < 24 || !ieee80211_is_data(txhdr->frame_control)
+	    || is_multicast_ether_addr(txhdr->addr1))
+		return 0;
+
+	hostdesc = acxsim_rx_next(sim);
+	rxbuf = hostdesc ? acxsim_rx_buf(sim, hostdesc, len) : NULL;
+	if (!rxbuf) {
+		sim->rx_dropped++;
+		return 0;
+	}
+
+	bit = highest_bit(rate111 & RATE111_ALL);
+	if (bit >= ARRAY_SIZE(acxsim_plcp))
+		bit = 0;
+
+	memset(rxbuf, 0, offsetof(rxbuffer_t, hdr_a3) + ACXSIM_PHY_HDR_LEN);
+	rxbuf->mac_cnt_rcvd = cpu_to_le16(len + ACXSIM_PHY_HDR_LEN);
+	rxbuf->phy_stat_baseband = acxsim_plcp[bit].phy_stat;
+	rxbuf->phy_plcp_signal = acxsim_plcp[bit].plcp;
+	rxbuf->phy_level = ACXSIM_RX_LEVEL;
+	rxbuf->phy_snr = ACXSIM_RX_SNR;
+	rxbuf->time = cpu_to_le32((u32) ktime_to_us(ktime_get()));
+
+	hdr = (struct ieee80211_hdr *) ((u8 *) &rxbuf->hdr_a3
+					+ ACXSIM_PHY_HDR_LEN);
+	memcpy(hdr, frame, len);
+	memcpy(hdr->addr1, txhdr->addr2, ETH_ALEN);
+	memcpy(hdr->addr2, txhdr->addr1, ETH_ALEN);
+	fc = le16_to_cpu(hdr->frame_control);
+	if ((fc & IEEE80211_FCTL_TODS) && !(fc & IEEE80211_FCTL_FROMDS))
+		fc ^= IEEE80211_FCTL_TODS | IEEE80211_FCTL_FROMDS;
+	hdr->frame_control = cpu_to_le16(fc);
+
+	acxsim_rx_commit(sim, hostdesc);
+	return 1;
+}
+
+/* Ought to be called with sim->lock held */
+/* Long preamble and PLCP header, then the frame at rate111 */
+static u32 acxsim_airtime(u16 rate111, u16 len)
+{
+	int bit = (rate111 & RATE111_ALL) ? highest_bit(rate111 & RATE111_ALL)
+		: 0;
+
+	if (bit >= acx111_rates_sizeof)
+		bit = 0;
+
+	return 192 + len * 80 / acx111_rates[bit].bitrate;
+}
+
+/* Ought to be called with sim->lock held */
+/* MPDUs a frame of len (FCS excluded) goes out as, the header being
+ * repeated in each */
+static int acxsim_fragments(struct acxsim *sim, u16 len)
+{
+	struct acxsim_ie *ie = acxsim_find_ie(sim,
+			acx_ie_descs[ACX111_IE_DOT11_FRAG_THRESH].val);
+	const int hdrlen = sizeof(struct ieee80211_hdr_3addr);
+	u16 thresh;
+
+	if (!ie || ie->len < 2)
+		return 1;
+
+	thresh = le16_to_cpu(*(__le16 *) ie->data);
+	if (len + FCS_LEN <= thresh || thresh <= hdrlen + FCS_LEN
+	    || len <= hdrlen)
+		return 1;
+
+	return DIV_ROUND_UP(len - hdrlen, thresh - hdrlen - FCS_LEN);
+}
+
+static void acxsim_process_tx(struct acxsim *sim)
+{
+	acx_device_t *adev = sim->adev;
+	const int txdesc_size = sizeof(txacxdesc_t) + 4;
+	txacxdesc_t *txdesc;
+	txhostdesc_t *hostdesc;
+	const u8 *frame;
+	u16 rate111, len;
+	int q, n, n_looped, frags, done = 0, looped = 0;
+
+	for (q = 0; q < sim->num_tx_queues; q++) {
+		for (n = 0; n < sim->tx_queue_cnt[q]; n++) {
+			txdesc = (txacxdesc_t *) (sim->mem
+				+ sim->tx_queue_offs[q]
+				+ sim->tx_tail[q] * txdesc_size);
+
+			/* still (or again) owned by the host */
+			if (txdesc->Ctl_8 & DESC_CTL_HOSTOWN)
+				break;
+
+			rate111 = le16_to_cpu(txdesc->u.r2.rate111);
+			len = le16_to_cpu(txdesc->total_length);
+			hostdesc = acxsim_bus_to_virt(adev,
+					txdesc->HostMemPtr, sizeof(*hostdesc));
+			frame = hostdesc ? acxsim_bus_to_virt(adev,
+					hostdesc->hd.data_phy, len) : NULL;
+
+			frags = acxsim_fragments(sim, len);
+
+			/* the bench feeds the rx ring itself */
+			if (frame && sim->rx_enabled && sim->tx_enabled
+			    && !test_bit(ACX_FLAG_BENCH, &adev->flags)) {
+				n_looped = acxsim_loopback(sim, frame, len,
+							rate111);
+				sim->medium_busy_us += (1 + n_looped)
+					* acxsim_airtime(rate111, len)
+					+ (frags - 1) * acxsim_airtime(rate111,
+					sizeof(struct ieee80211_hdr_3addr));
+				looped += n_looped;
+			}
+
+			/* first try of the set went through */
+			txdesc->error = 0;
+			txdesc->ack_failures = 0;
+			txdesc->rts_failures = 0;
+			txdesc->rts_ok = 0;
+			if (rate111 & RATE111_ALL)
+				rate111 = (rate111 & ~RATE111_ALL)
+					| (1 << highest_bit(rate111
+							& RATE111_ALL));
+			txdesc->u.r2.rate111 = cpu_to_le16(rate111);
+
+			wmb();
+			txdesc->Ctl_8 |= DESC_CTL_ACXDONE_HOSTOWN;
+
+			sim->tx_tail[q] = (sim->tx_tail[q] + 1)
+					% sim->tx_queue_cnt[q];
+			sim->tx_frames++;
+			sim->tx_frags += frags;
+			done++;
+		}
+	}
+
+	if (done)
+		acxsim_raise(sim, HOST_INT_TX_COMPLETE);
+	if (looped)
+		acxsim_raise(sim, HOST_INT_RX_COMPLETE);
+}
+
+/* The "eCPU": runs tx processing and delivers interrupts */
+static void acxsim_tasklet(unsigned long data)
+{
+	struct acxsim *sim = (struct acxsim *) data;
+	unsigned long flags;
+	int pending;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	if (test_and_clear_bit(ACXSIM_TRIG_TX, &sim->trig))
+		acxsim_process_tx(sim);
+	pending = acxsim_irq_pending(sim);
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	/* acx_interrupt() masks everything and defers to irq_work,
+	 * which reenables the mask and thereby reschedules us.  A
+	 * running bench reschedules us when it's done */
+	if (pending && !test_bit(ACX_FLAG_BENCH, &sim->adev->flags))
+		acx_interrupt(0, sim->adev);
+}
+
+/*
+ * BOM Register access
+ * ==================================================
+ */
+
+u32 acxsim_read_reg(acx_device_t *adev, unsigned int offset)
+{
+	struct acxsim *sim = adev->sim;
+	unsigned long flags;
+	u32 val;
+
+	if (offset > IO_ACX_ECPU_CTRL)
+		return 0;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->reg_reads++;
+	switch (offset) {
+	case IO_ACX_IRQ_STATUS_NON_DES:
+		val = sim->irq_status;
+		break;
+	case IO_ACX_IRQ_REASON:
+		/* clear on read, except for the polled cmd completion */
+		val = sim->irq_status;
+		sim->irq_status &= HOST_INT_CMD_COMPLETE;
+		break;
+	case IO_ACX_EEPROM_CTL:
+	case IO_ACX_PHY_CTL:
+		val = 0;	/* accesses complete immediately */
+		break;
+	case IO_ACX_SLV_MEM_DATA:
+		val = sim->code[(sim->slv_addr % ACXSIM_CODE_SIZE) / 4];
+		if (sim->regs[IO_ACX_SLV_MEM_CTL] & 1)
+			sim->slv_addr += 4;
+		break;
+	case IO_ACX_CMD_MAILBOX_OFFS:
+		val = sim->booted ? ACXSIM_CMD_OFFS : 0;
+		break;
+	case IO_ACX_INFO_MAILBOX_OFFS:
+		val = sim->booted ? ACXSIM_INFO_OFFS : 0;
+		break;
+	default:
+		val = sim->regs[offset];
+	}
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	return val;
+}
+
+void acxsim_write_reg(acx_device_t *adev, unsigned int offset, u32 val)
+{
+	struct acxsim *sim = adev->sim;
+	unsigned long flags;
+	u32 old;
+
+	if (offset > IO_ACX_ECPU_CTRL)
+		return;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->reg_writes++;
+	old = sim->regs[offset];
+	sim->regs[offset] = val;
+
+	switch (offset) {
+	case IO_ACX_SOFT_RESET:
+		if ((val & 1) && !(old & 1))
+			acxsim_reset(sim);
+		break;
+	case IO_ACX_ECPU_CTRL:
+		/* clearing the halt bit starts the uploaded firmware */
+		if ((old & 1) && !(val & 1))
+			acxsim_boot(sim);
+		break;
+	case IO_ACX_EE_START:
+		if (val & 1)
+			sim->regs[IO_ACX_EEPROM_INFORMATION] =
+				(RADIO_16_RADIA_RC2422 << 8) | 0x00;
+		break;
+	case IO_ACX_EEPROM_CTL:
+		old = sim->regs[IO_ACX_EEPROM_ADDR] % ACXSIM_EEPROM_SIZE;
+		if (val & 2)
+			sim->regs[IO_ACX_EEPROM_DATA] = sim->eeprom[old];
+		else if (val & 1)
+			sim->eeprom[old] = sim->regs[IO_ACX_EEPROM_DATA];
+		sim->regs[offset] = 0;
+		break;
+	case IO_ACX_PHY_CTL:
+		old = sim->regs[IO_ACX_PHY_ADDR] % ACXSIM_PHY_SIZE;
+		if (val & 2)
+			sim->regs[IO_ACX_PHY_DATA] = sim->phy[old];
+		else if (val & 1)
+			sim->phy[old] = sim->regs[IO_ACX_PHY_DATA];
+		sim->regs[offset] = 0;
+		break;
+	case IO_ACX_SLV_MEM_ADDR:
+		sim->slv_addr = val;
+		break;
+	case IO_ACX_SLV_MEM_DATA:
+		sim->code[(sim->slv_addr % ACXSIM_CODE_SIZE) / 4] = val;
+		if (sim->regs[IO_ACX_SLV_MEM_CTL] & 1)
+			sim->slv_addr += 4;
+		break;
+	case IO_ACX_IRQ_ACK:
+		sim->irq_status &= ~val;
+		break;
+	case IO_ACX_IRQ_MASK:
+	case IO_ACX_FEMR:
+		if (acxsim_irq_pending(sim))
+			tasklet_schedule(&sim->tasklet);
+		break;
+	case IO_ACX_INT_TRIG:
+		if ((val & INT_TRIG_CMD) && sim->booted)
+			acxsim_do_cmd(sim);
+		if (val & INT_TRIG_TXPRC) {
+			set_bit(ACXSIM_TRIG_TX, &sim->trig);
+			tasklet_schedule(&sim->tasklet);
+		}
+		sim->regs[offset] = 0;
+		break;
+	}
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+void acxsim_synchronize_irq(acx_device_t *adev)
+{
+	tasklet_kill(&adev->sim->tasklet);
+}
+
+/*
+ * BOM Bench
+ * ==================================================
+ */
+
+/*
+ * Per-frame cost of the driver's tx and rx paths, run by reading the
+ * "bench" debugfs file of a simulated device.
+ *
+ * Frames go through acx_tx_frame() and acx_tx_clean_txdesc() one at a
+ * time and are then looped back through acxpci_process_rxdesc().  The
+ * "firmware" work in between isn't timed, and neither is the irq
+ * path, since the descriptors are processed directly.  While
+ * ACX_FLAG_BENCH is set, the skbs that would go to mac80211 end up in
+ * acxsim_bench_consume() instead.
+ *
+ * The frames longer than ACXSIM_BENCH_FRAG_THRESH are then sent once
+ * as mac80211 fragments them, one descriptor pair each, and once
+ * whole, fragmented by the firmware, to compare the host's cost per
+ * MSDU.  The retries of a fragment are up to the firmware either way,
+ * so a noisy medium costs the host nothing more.
+ */
+
+struct acxsim_bench_result {
+	u64		tx_ns;
+	u64		rx_ns;
+	unsigned long	tx_regs;
+	unsigned long	rx_regs;
+	unsigned long	rx_skbs;
+};
+
+void acxsim_bench_consume(acx_device_t *adev, struct sk_buff *skb)
+{
+	adev->sim->bench_skbs++;
+	dev_kfree_skb_any(skb);
+}
+
+/* Ought to be called with acx_sem held */
+int acxsim_set_bench_frames(acx_device_t *adev, unsigned long frames)
+{
+	if (!frames || frames > ACXSIM_BENCH_FRAMES_MAX)
+		return -EINVAL;
+	adev->sim->bench_frames = frames;
+	return 0;
+}
+
+static unsigned long acxsim_reg_accesses(struct acxsim *sim)
+{
+	unsigned long flags, n;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	n = sim->reg_reads + sim->reg_writes;
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	return n;
+}
+
+/* A unicast data frame to the bench peer, as mac80211 would hand it
+ * to acx_op_tx() */
+static struct sk_buff *acxsim_bench_skb(acx_device_t *adev, int len)
+{
+	struct ieee80211_tx_info *info;
+	struct ieee80211_hdr *hdr;
+	struct sk_buff *skb;
+	int i;
+
+	skb = dev_alloc_skb(len);
+	if (!skb)
+		return NULL;
+
+	hdr = (struct ieee80211_hdr *) skb_put(skb, len);
+	memset(hdr, 0, len);
+	hdr->frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA
+				| IEEE80211_STYPE_DATA | IEEE80211_FCTL_TODS);
+	memcpy(hdr->addr1, acxsim_bench_peer, ETH_ALEN);
+	memcpy(hdr->addr2, adev->dev_addr, ETH_ALEN);
+	memcpy(hdr->addr3, acxsim_bench_peer, ETH_ALEN);
+
+	info = IEEE80211_SKB_CB(skb);
+	memset(info, 0, sizeof(*info));
+	info->band = adev->rx_status.band;
+	info->control.rates[0].idx = 0;
+	info->control.rates[0].count = 1;
+	for (i = 1; i < IEEE80211_TX_MAX_RATES; i++)
+		info->control.rates[i].idx = -1;
+
+	return skb;
+}
+
+/* Ought to be called with acx_sem held and ACX_FLAG_BENCH set */
+static int acxsim_bench_size(acx_device_t *adev, int len,
+			unsigned long frames, struct acxsim_bench_result *r)
+{
+	struct acxsim *sim = adev->sim;
+	struct sk_buff *skb;
+	unsigned long i, flags, regs, skbs;
+	ktime_t t;
+	int looped;
+
+	memset(r, 0, sizeof(*r));
+
+	for (i = 0; i < frames; i++) {
+		skb = acxsim_bench_skb(adev, len);
+		if (!skb)
+			return -ENOMEM;
+
+		regs = acxsim_reg_accesses(sim);
+		t = ktime_get();
+		if (acx_tx_frame(adev, skb)) {
+			dev_kfree_skb(skb);
+			return -EBUSY;
+		}
+		r->tx_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+		r->tx_regs += acxsim_reg_accesses(sim) - regs;
+
+		/* send it, and have the peer echo it right away */
+		spin_lock_irqsave(&sim->lock, flags);
+		clear_bit(ACXSIM_TRIG_TX, &sim->trig);
+		acxsim_process_tx(sim);
+		looped = acxsim_loopback(sim, skb->data, len, RATE111_1);
+		spin_unlock_irqrestore(&sim->lock, flags);
+
+		skbs = sim->bench_skbs;
+		regs = acxsim_reg_accesses(sim);
+		t = ktime_get();
+		acx_tx_clean_txdesc(adev, NOENC_QUEUE_ID);
+		r->tx_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+		r->tx_regs += acxsim_reg_accesses(sim) - regs;
+		if (sim->bench_skbs == skbs)
+			return -EIO;
+
+		if (!looped)
+			return -EIO;
+
+		skbs = sim->bench_skbs;
+		regs = acxsim_reg_accesses(sim);
+		t = ktime_get();
+		acxpci_process_rxdesc(adev);
+		r->rx_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+		r->rx_regs += acxsim_reg_accesses(sim) - regs;
+		r->rx_skbs += sim->bench_skbs - skbs;
+
+		cond_resched();
+	}
+	return 0;
+}
+
+struct acxsim_bench_frag_result {
+	u64		ns;
+	unsigned long	regs;
+	unsigned long	descs;
+	unsigned long	mpdus;		/* sent on the air */
+};
+
+/* Ought to be called with acx_sem held and ACX_FLAG_BENCH set */
+/* Sends one MSDU of len, in fragments of thresh if not 0, as
+ * mac80211 would, and reclaims it */
+static int acxsim_bench_frag_msdu(acx_device_t *adev, int len, int thresh,
+			struct acxsim_bench_frag_result *r)
+{
+	struct acxsim *sim = adev->sim;
+	const int hdrlen = sizeof(struct ieee80211_hdr_3addr);
+	struct ieee80211_hdr *hdr;
+	struct sk_buff *skb;
+	unsigned long flags, regs, skbs, mpdus;
+	int payload = len - hdrlen, per, n, i;
+	ktime_t t;
+
+	per = thresh ? thresh - hdrlen - FCS_LEN : payload;
+	n = DIV_ROUND_UP(payload, per);
+
+	skbs = sim->bench_skbs;
+	for (i = 0; i < n; i++) {
+		skb = acxsim_bench_skb(adev,
+				hdrlen + min(per, payload - i * per));
+		if (!skb)
+			return -ENOMEM;
+		hdr = (struct ieee80211_hdr *) skb->data;
+		hdr->seq_ctrl = cpu_to_le16(i);
+		if (i < n - 1)
+			hdr->frame_control |=
+				cpu_to_le16(IEEE80211_FCTL_MOREFRAGS);
+
+		regs = acxsim_reg_accesses(sim);
+		t = ktime_get();
+		if (acx_tx_frame(adev, skb)) {
+			dev_kfree_skb(skb);
+			return -EBUSY;
+		}
+		r->ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+		r->regs += acxsim_reg_accesses(sim) - regs;
+		r->descs++;
+	}
+
+	spin_lock_irqsave(&sim->lock, flags);
+	clear_bit(ACXSIM_TRIG_TX, &sim->trig);
+	mpdus = sim->tx_frags;
+	acxsim_process_tx(sim);
+	r->mpdus += sim->tx_frags - mpdus;
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	regs = acxsim_reg_accesses(sim);
+	t = ktime_get();
+	acx_tx_clean_txdesc(adev, NOENC_QUEUE_ID);
+	r->ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+	r->regs += acxsim_reg_accesses(sim) - regs;
+	if (sim->bench_skbs - skbs != n)
+		return -EIO;
+
+	return 0;
+}
+
+/* Ought to be called with acx_sem held and ACX_FLAG_BENCH set */
+static int acxsim_bench_frag(acx_device_t *adev, int len, int thresh,
+			unsigned long frames, struct acxsim_bench_frag_result *r)
+{
+	unsigned long i;
+	int res;
+
+	memset(r, 0, sizeof(*r));
+
+	/* the firmware fragments only when the host doesn't */
+	adev->frag_threshold = thresh ? 2346 : ACXSIM_BENCH_FRAG_THRESH;
+	if (OK != acx111_update_frag_threshold(adev))
+		return -EIO;
+
+	for (i = 0; i < frames; i++) {
+		res = acxsim_bench_frag_msdu(adev, len, thresh, r);
+		if (res)
+			return res;
+		cond_resched();
+	}
+	return 0;
+}
+
+/* per frame, with two decimals */
+static void acxsim_bench_print_avg(struct seq_file *file, unsigned long sum,
+				unsigned long frames)
+{
+	unsigned long avg100 = sum * 100 / frames;
+
+	seq_printf(file, " %7lu.%02lu", avg100 / 100, avg100 % 100);
+}
+
+int acxsim_dbgfs_bench_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acxsim *sim = adev->sim;
+	struct acxsim_bench_result r;
+	struct net_device_stats stats;
+	struct acx_tx_rate_stat tx_rate_stats[ACX_TX_RATE_STATS_CNT];
+	u32 rx_rate_hist[ACX_RX_RATE_STATS_CNT + 1];
+	struct acxsim_bench_frag_result host, fw;
+	unsigned long frames;
+	u16 frag_threshold;
+	int i, res = 0;
+
+	acx_sem_lock(adev);
+
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags)) {
+		seq_printf(file, "interface is down\n");
+		goto out;
+	}
+	frames = sim->bench_frames;
+
+	/* the bench frames shouldn't show up in the statistics */
+	stats = adev->stats;
+	memcpy(tx_rate_stats, adev->tx_rate_stats, sizeof(tx_rate_stats));
+	memcpy(rx_rate_hist, adev->rx_rate_hist, sizeof(rx_rate_hist));
+	set_bit(ACX_FLAG_BENCH, &adev->flags);
+
+	seq_printf(file, "%lu frames per size, ns and register accesses "
+		"per frame, rx skbs allocated per frame\n", frames);
+	seq_printf(file, "%6s %10s %10s %10s %10s %10s\n",
+		"size", "tx_ns", "tx_regs", "rx_ns", "rx_regs", "rx_skbs");
+
+	for (i = 0; i < ARRAY_SIZE(acxsim_bench_sizes); i++) {
+		res = acxsim_bench_size(adev, acxsim_bench_sizes[i], frames,
+					&r);
+		if (res) {
+			seq_printf(file, "%6d FAILED: %d\n",
+				acxsim_bench_sizes[i], res);
+			break;
+		}
+		seq_printf(file, "%6d %10llu", acxsim_bench_sizes[i],
+			(unsigned long long) div_u64(r.tx_ns, frames));
+		acxsim_bench_print_avg(file, r.tx_regs, frames);
+		seq_printf(file, " %10llu",
+			(unsigned long long) div_u64(r.rx_ns, frames));
+		acxsim_bench_print_avg(file, r.rx_regs, frames);
+		acxsim_bench_print_avg(file, r.rx_skbs, frames);
+		seq_printf(file, "\n");
+	}
+
+	seq_printf(file, "\nfragmented at %d bytes by mac80211 (host) or "
+		"the firmware (fw), per MSDU\n", ACXSIM_BENCH_FRAG_THRESH);
+	seq_printf(file, "%6s %10s %10s %10s %10s %10s %10s %10s\n",
+		"size", "mpdus", "host_descs", "host_ns", "host_regs",
+		"fw_descs", "fw_ns", "fw_regs");
+
+	frag_threshold = adev->frag_threshold;
+	for (i = 0; !res && i < ARRAY_SIZE(acxsim_bench_sizes); i++) {
+		if (acxsim_bench_sizes[i] <= ACXSIM_BENCH_FRAG_THRESH)
+			continue;
+
+		res = acxsim_bench_frag(adev, acxsim_bench_sizes[i],
+				ACXSIM_BENCH_FRAG_THRESH, frames, &host);
+		if (!res)
+			res = acxsim_bench_frag(adev, acxsim_bench_sizes[i], 0,
+					frames, &fw);
+		if (!res && fw.mpdus != host.mpdus)
+			res = -EIO;
+		if (res) {
+			seq_printf(file, "%6d FAILED: %d\n",
+				acxsim_bench_sizes[i], res);
+			break;
+		}
+		seq_printf(file, "%6d", acxsim_bench_sizes[i]);
+		acxsim_bench_print_avg(file, host.mpdus, frames);
+		acxsim_bench_print_avg(file, host.descs, frames);
+		seq_printf(file, " %10llu",
+			(unsigned long long) div_u64(host.ns, frames));
+		acxsim_bench_print_avg(file, host.regs, frames);
+		acxsim_bench_print_avg(file, fw.descs, frames);
+		seq_printf(file, " %10llu",
+			(unsigned long long) div_u64(fw.ns, frames));
+		acxsim_bench_print_avg(file, fw.regs, frames);
+		seq_printf(file, "\n");
+	}
+	adev->frag_threshold = frag_threshold;
+	acx111_update_frag_threshold(adev);
+
+	clear_bit(ACX_FLAG_BENCH, &adev->flags);
+	adev->stats = stats;
+	memcpy(adev->tx_rate_stats, tx_rate_stats, sizeof(tx_rate_stats));
+	memcpy(adev->rx_rate_hist, rx_rate_hist, sizeof(rx_rate_hist));
+
+	/* deliver whatever the bench left pending */
+	tasklet_schedule(&sim->tasklet);
+
+out:
+	acx_sem_unlock(adev);
+
+	return res;
+}
+
+/*
+ * BOM Rx replay
+ * ==================================================
+ */
+
+/*
+ * A capture from the "rx_capture" debugfs file of any acx device (see
+ * rx.h) is written to "rx_replay" of a simulated device, and reading
+ * "rx_replay" feeds its records through the rx ring into
+ * acxpci_process_rxdesc() as fast as it takes them.  The capture is
+ * replayed until at least bench_frames records went through.  Like
+ * for the bench, nothing reaches mac80211.
+ */
+
+/* Ought to be called with acx_sem held */
+ssize_t acxsim_replay_write(acx_device_t *adev, const char __user *ubuf,
+			size_t count, loff_t *ppos)
+{
+	struct acxsim *sim = adev->sim;
+
+	/* a new open starts a new capture */
+	if (*ppos == 0)
+		sim->replay_len = 0;
+	if (*ppos != sim->replay_len)
+		return -EINVAL;
+	if (sim->replay_len + count > ACXSIM_REPLAY_SIZE)
+		return -EFBIG;
+
+	if (!sim->replay) {
+		sim->replay = vmalloc(ACXSIM_REPLAY_SIZE);
+		if (!sim->replay)
+			return -ENOMEM;
+	}
+	if (copy_from_user(sim->replay + sim->replay_len, ubuf, count))
+		return -EFAULT;
+
+	sim->replay_len += count;
+	*ppos += count;
+
+	return count;
+}
+
+/* Ought to be called with sim->lock held.  Returns 1 if the record was
+ * queued, 0 if the rx ring is full, -EINVAL if it can't be replayed.
+ * The phy header is converted to the one of the simulated firmware */
+static int acxsim_replay_rec(struct acxsim *sim, const acx_rxcap_rec_t *rec,
+			unsigned int *frame_len)
+{
+	const rxbuffer_t *cap = (const void *) (rec + 1);
+	unsigned int len = le16_to_cpu(rec->len);
+	rxhostdesc_t *hostdesc;
+	rxbuffer_t *rxbuf;
+	int flen;
+
+	if (len < RXBUF_HDRSIZE)
+		return -EINVAL;
+	flen = (le16_to_cpu(cap->mac_cnt_rcvd) & 0xfff) - rec->phy_header_len;
+	if (flen < 10 || RXBUF_HDRSIZE + rec->phy_header_len + flen > len)
+		return -EINVAL;
+
+	hostdesc = acxsim_rx_next(sim);
+	if (!hostdesc)
+		return 0;
+	rxbuf = acxsim_rx_buf(sim, hostdesc, flen);
+	if (!rxbuf)
+		return -EINVAL;
+
+	memcpy(rxbuf, cap, RXBUF_HDRSIZE);
+	memset(&rxbuf->hdr_a3, 0, ACXSIM_PHY_HDR_LEN);
+	rxbuf->mac_cnt_rcvd = cpu_to_le16(flen + ACXSIM_PHY_HDR_LEN);
+	memcpy((u8 *) &rxbuf->hdr_a3 + ACXSIM_PHY_HDR_LEN,
+		(const u8 *) &cap->hdr_a3 + rec->phy_header_len, flen);
+
+	acxsim_rx_commit(sim, hostdesc);
+	*frame_len = flen;
+	return 1;
+}
+
+/* Number of records in the loaded capture, or -EINVAL if it isn't one */
+static int acxsim_replay_count(struct acxsim *sim)
+{
+	const acx_rxcap_hdr_t *hdr = (const void *) sim->replay;
+	const acx_rxcap_rec_t *rec;
+	size_t offs = sizeof(*hdr);
+	int n = 0;
+
+	if (sim->replay_len < sizeof(*hdr)
+	    || memcmp(hdr->magic, ACX_RXCAP_MAGIC, sizeof(hdr->magic))
+	    || le16_to_cpu(hdr->version) != ACX_RXCAP_VERSION)
+		return -EINVAL;
+
+	while (offs + sizeof(*rec) <= sim->replay_len) {
+		rec = (const void *) (sim->replay + offs);
+		offs += sizeof(*rec) + le16_to_cpu(rec->len);
+		if (offs > sim->replay_len)
+			return -EINVAL;
+		n++;
+	}
+	return (offs == sim->replay_len) ? n : -EINVAL;
+}
+
+int acxsim_dbgfs_replay_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acxsim *sim = adev->sim;
+	const acx_rxcap_rec_t *rec;
+	struct net_device_stats stats;
+	u32 rx_rate_hist[ACX_RX_RATE_STATS_CNT + 1];
+	unsigned long flags, pass, passes, skbs;
+	unsigned long queued = 0, skipped = 0;
+	unsigned int flen, progress;
+	u64 bytes = 0, ns = 0;
+	size_t offs;
+	ktime_t t;
+	int n, res = 0;
+
+	acx_sem_lock(adev);
+
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags)) {
+		seq_printf(file, "interface is down\n");
+		goto out;
+	}
+	n = acxsim_replay_count(sim);
+	if (n <= 0) {
+		seq_printf(file, "no capture loaded\n");
+		goto out;
+	}
+	passes = DIV_ROUND_UP(sim->bench_frames, n);
+
+	stats = adev->stats;
+	memcpy(rx_rate_hist, adev->rx_rate_hist, sizeof(rx_rate_hist));
+	skbs = sim->bench_skbs;
+	set_bit(ACX_FLAG_BENCH, &adev->flags);
+
+	for (pass = 0; pass < passes && !res; pass++) {
+		offs = sizeof(acx_rxcap_hdr_t);
+		while (offs < sim->replay_len) {
+			/* fill the ring, then let the driver drain it */
+			progress = 0;
+			spin_lock_irqsave(&sim->lock, flags);
+			while (offs < sim->replay_len) {
+				rec = (const void *) (sim->replay + offs);
+				res = acxsim_replay_rec(sim, rec, &flen);
+				if (!res)
+					break;
+				if (res < 0) {
+					skipped++;
+				} else {
+					queued++;
+					bytes += flen;
+				}
+				res = 0;
+				offs += sizeof(*rec) + le16_to_cpu(rec->len);
+				progress++;
+			}
+			spin_unlock_irqrestore(&sim->lock, flags);
+
+			/* the driver didn't take anything last time */
+			if (!progress) {
+				res = -EIO;
+				break;
+			}
+
+			t = ktime_get();
+			acxpci_process_rxdesc(adev);
+			ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+
+			cond_resched();
+		}
+	}
+	skbs = sim->bench_skbs - skbs;
+
+	clear_bit(ACX_FLAG_BENCH, &adev->flags);
+	adev->stats = stats;
+	memcpy(adev->rx_rate_hist, rx_rate_hist, sizeof(rx_rate_hist));
+	tasklet_schedule(&sim->tasklet);
+
+	if (res)
+		seq_printf(file, "replay FAILED: %d\n", res);
+	seq_printf(file, "records %d, passes %lu, replayed %lu, skipped %lu\n",
+		n, passes, queued, skipped);
+	seq_printf(file, "frames %lu, bytes %llu, time %llu us\n", skbs,
+		(unsigned long long) bytes,
+		(unsigned long long) div_u64(ns, NSEC_PER_USEC));
+	if (skbs && ns)
+		seq_printf(file, "ns/frame %llu, frames/s %llu\n",
+			(unsigned long long) div_u64(ns, skbs),
+			(unsigned long long) div64_u64((u64) skbs * NSEC_PER_SEC,
+						ns));
+
+out:
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+/*
+ * BOM Firmware image
+ * ==================================================
+ */
+
+/* A made-up image, only so that the upload/validate and checksum code
+ * in merge.c runs like for a real card */
+static firmware_image_t *acxsim_make_fw_image(void)
+{
+	firmware_image_t *img;
+	u8 *p;
+	u32 sum, size = ACXSIM_FW_SIZE;
+	int i;
+
+	img = vmalloc(offsetof(firmware_image_t, data) + size);
+	if (!img)
+		return NULL;
+
+	img->size = cpu_to_le32(size);
+	p = (u8 *) &img->size;
+	sum = p[0] + p[1] + p[2] + p[3];
+	for (i = 0; i < size; i++) {
+		img->data[i] = (u8) (i * 7 + 1);
+		sum += img->data[i];
+	}
+	img->chksum = cpu_to_le32(sum);
+
+	return img;
+}
+
+/*
+ * BOM Mac80211 Ops
+ * ==================================================
+ */
+
+static const struct ieee80211_ops acxsim_hw_ops = {
+	.tx		= acx_op_tx,
+#if ACX_TXQ
+	.wake_tx_queue	= acx_op_wake_tx_queue,
+#endif
+	.conf_tx	= acx_conf_tx,
+	.start		= acx_op_start,
+	.stop		= acx_op_stop,
+	.config		= acx_op_config,
+	.set_key	= acx_op_set_key,
+	.get_stats	= acx_op_get_stats,
+	.set_frag_threshold	= acx_op_set_frag_threshold,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+	.get_survey	= acx_op_get_survey,
+#endif
+
+	.add_interface		= acx_op_add_interface,
+	.remove_interface	= acx_op_remove_interface,
+	.prepare_multicast	= acx_op_prepare_multicast,
+	.configure_filter	= acx_op_configure_filter,
+	.bss_info_changed	= acx_op_bss_info_changed,
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 1, 0)
+	.hw_scan		= acx_op_hw_scan,
+#endif
+
+#if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 34)
+	.get_tx_stats = acx_e_op_get_tx_stats,
+#endif
+	.set_tim = acx_op_set_tim,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+	.channel_switch	= acx_op_channel_switch,
+#endif
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 34)
+	.sta_add	= acx_op_sta_add,
+	.sta_remove	= acx_op_sta_remove,
+	.sta_notify	= acx_op_sta_notify,
+#endif
+};
+
+/*
+ * BOM Driver, Module
+ * ==================================================
+ */
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 8, 0)
+static int __devinit acxsim_probe(struct platform_device *pdev)
+#else
+static int acxsim_probe(struct platform_device *pdev)
+#endif
+{
+	acx_device_t *adev = NULL;
+	struct ieee80211_hw *hw;
+	struct acxsim *sim;
+	int result = -EIO;
+	int err;
+
+	/* Alloc ieee80211_hw  */
+	hw = acx_alloc_hw(&acxsim_hw_ops);
+	if (!hw)
+		goto fail_ieee80211_alloc_hw;
+	adev = hw2adev(hw);
+
+	/* Driver locking and queue mechanics */
+	if (acx_init_mechanics(adev))
+		goto fail_init_mechanics;
+
+	sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+	if (!sim) {
+		result = -ENOMEM;
+		goto fail_alloc_sim;
+	}
+	sim->mem = vzalloc(ACXSIM_MEM_SIZE);
+	sim->code = vzalloc(ACXSIM_CODE_SIZE);
+	if (!sim->mem || !sim->code) {
+		result = -ENOMEM;
+		goto fail_alloc_mem;
+	}
+	sim->adev = adev;
+	sim->pdev = pdev;
+	spin_lock_init(&sim->lock);
+	tasklet_init(&sim->tasklet, acxsim_tasklet, (unsigned long) sim);
+	sim->eeprom[0x05] = 5;	/* eeprom_version, see acx_parse_configoption() */
+	sim->bench_frames = ACXSIM_BENCH_FRAMES;
+	adev->sim = sim;
+
+	SET_IEEE80211_DEV(hw, &pdev->dev);
+	adev->bus_dev = &pdev->dev;
+	adev->dev_type = DEVTYPE_SIM;
+	platform_set_drvdata(pdev, hw);
+
+	/* the descriptor queues are allocated with dma_alloc_coherent()
+	 * like on PCI */
+	if (!pdev->dev.dma_mask)
+		pdev->dev.dma_mask = &pdev->dev.coherent_dma_mask;
+	adev->bus_dev->coherent_dma_mask = DMA_BIT_MASK(32);
+
+	adev->chip_type = CHIPTYPE_ACX111;
+	adev->chip_name = "ACX111";
+	adev->io = IO_ACX111;
+	/* iobase is only dereferenced by acxpci_adev_present(), which
+	 * must not see 0xffffffff */
+	adev->iobase = (void __iomem *) sim->regs;
+	adev->iobase2 = (void __iomem *) sim->mem;
+	adev->irq = 0;
+
+	pr_acx("simulated %s-based wireless network card %s\n",
+		adev->chip_name, dev_name(&pdev->dev));
+	log(L_ANY, "the initial debug setting is 0x%04X\n", acx_debug);
+
+	/* Acx irqs shall be off and are enabled later in acx_up */
+	acx_irq_disable(adev);
+
+	if (acx_get_hardware_info(adev))
+		goto fail_hardware_info;
+
+	adev->fw_image = acxsim_make_fw_image();
+	if (!adev->fw_image)
+		goto fail_load_firmware;
+
+	if (acx_reset_on_probe(adev))
+		goto fail_reset_on_probe;
+
+	/* Debugfs */
+	if (acx_debugfs_add_adev(adev))
+		goto fail_debugfs;
+
+	/* Init ieee80211_hw  */
+	if (acx_init_ieee80211(adev, hw))
+		goto fail_ieee80211_register_hw;
+	hw->wiphy->interface_modes =
+			BIT(NL80211_IFTYPE_STATION) |
+			BIT(NL80211_IFTYPE_ADHOC) |
+			BIT(NL80211_IFTYPE_AP);
+
+	if ((err = ieee80211_register_hw(hw))) {
+		pr_acx("ieee80211_register_hw() FAILED: %d\n", err);
+		goto fail_ieee80211_register_hw;
+	}
+
+	result = OK;
+	goto done;
+
+	/* error paths: undo everything in reverse order... */
+	fail_ieee80211_register_hw:
+	acx_debugfs_remove_adev(adev);
+
+	fail_debugfs:
+
+	fail_reset_on_probe:
+	acx_delete_dma_regions(adev);
+
+	fail_load_firmware:
+	acx_free_firmware(adev);
+
+	fail_hardware_info:
+	tasklet_kill(&sim->tasklet);
+	platform_set_drvdata(pdev, NULL);
+
+	fail_alloc_mem:
+	vfree(sim->code);
+	vfree(sim->mem);
+	kfree(sim);
+
+	fail_alloc_sim:
+	acx_free_mechanics(adev);
+
+	fail_init_mechanics:
+	acx_free_hw(hw);
+
+	fail_ieee80211_alloc_hw:
+
+	done:
+	return result;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 8, 0)
+static int __devexit acxsim_remove(struct platform_device *pdev)
+#else
+static int acxsim_remove(struct platform_device *pdev)
+#endif
+{
+	struct ieee80211_hw *hw = platform_get_drvdata(pdev);
+	acx_device_t *adev;
+	struct acxsim *sim;
+
+	if (!hw) {
+		log(L_DEBUG, "card is unused. Skipping any release code\n");
+		return 0;
+	}
+	adev = hw2adev(hw);
+	sim = adev->sim;
+
+	log(L_INIT, "removing device %s\n", wiphy_name(adev->hw->wiphy));
+	ieee80211_unregister_hw(adev->hw);
+
+	if (test_bit(ACX_FLAG_HW_UP, &adev->flags)) {
+		acx_issue_cmd(adev, ACX1xx_CMD_DISABLE_TX, NULL, 0);
+		acx_issue_cmd(adev, ACX1xx_CMD_DISABLE_RX, NULL, 0);
+		clear_bit(ACX_FLAG_HW_UP, &adev->flags);
+	}
+	acxpci_reset_mac(adev);
+
+	acx_debugfs_remove_adev(adev);
+
+	acx_irq_disable(adev);
+	tasklet_kill(&sim->tasklet);
+
+	log(L_INIT, "acxsim: tx_frames=%lu tx_frags=%lu rx_frames=%lu "
+		"rx_dropped=%lu\n", sim->tx_frames, sim->tx_frags,
+		sim->rx_frames, sim->rx_dropped);
+
+	acx_free_firmware(adev);
+	acx_delete_dma_regions(adev);
+	platform_set_drvdata(pdev, NULL);
+
+	vfree(sim->replay);
+	vfree(sim->code);
+	vfree(sim->mem);
+	kfree(sim);
+	adev->sim = NULL;
+
+	acx_free_mechanics(adev);
+	acx_free_hw(adev->hw);
+
+	return 0;
+}
+
+static struct platform_driver acxsim_driver = {
+	.driver = {
+		.name = "acx-sim",
+	},
+	.probe = acxsim_probe,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 8, 0)
+	.remove = __devexit_p(acxsim_remove),
+#else
+	.remove = acxsim_remove,
+#endif
+};
+
+/*
+ * acxsim_init_module
+ *
+ * Registers the driver and creates the number of devices asked for
+ * with the "sim" module parameter.
+ */
+int __init acxsim_init_module(void)
+{
+	struct platform_device *pdev;
+	int res, i;
+
+	pr_info("built with CONFIG_ACX_MAC80211_SIM\n");
+
+	res = platform_driver_register(&acxsim_driver);
+	if (res) {
+		pr_err("can't register sim driver\n");
+		return res;
+	}
+
+	if (acxsim_devices > ACXSIM_MAX_DEVICES) {
+		pr_info("sim=%d: limiting to %d devices\n",
+			acxsim_devices, ACXSIM_MAX_DEVICES);
+		acxsim_devices = ACXSIM_MAX_DEVICES;
+	}
+
+	for (i = 0; i < acxsim_devices; i++) {
+		pdev = platform_device_register_simple("acx-sim", i, NULL, 0);
+		if (IS_ERR(pdev)) {
+			pr_err("can't create simulated device %d: %ld\n",
+				i, PTR_ERR(pdev));
+			break;
+		}
+		acxsim_pdevs[i] = pdev;
+	}
+
+	return 0;
+}
+
+/*
+ * acxsim_cleanup_module
+ *
+ * Called at module unload time.
+ */
+void __exit acxsim_cleanup_module(void)
+{
+	int i;
+
+	for (i = 0; i < ACXSIM_MAX_DEVICES; i++) {
+		if (acxsim_pdevs[i])
+			platform_device_unregister(acxsim_pdevs[i]);
+		acxsim_pdevs[i] = NULL;
+	}
+	platform_driver_unregister(&acxsim_driver);
+
+	log(L_INIT, "acxsim: module unloaded\n");
+}
@@ -0,0 +1,62 @@
+/* this file provides prototypes for functions defined in sim.c, the
+ * software model of an ACX111 PCI card; see sim.c for what it
+ * implements.  The register hooks are called from inlines.h for
+ * DEVTYPE_SIM devices.
+ */
+#ifndef _SIM_H_
+#define _SIM_H_
+
+struct seq_file;
+
+#if defined(CONFIG_ACX_MAC80211_SIM)
+
+u32 acxsim_read_reg(acx_device_t *adev, unsigned int offset);
+void acxsim_write_reg(acx_device_t *adev, unsigned int offset, u32 val);
+void acxsim_synchronize_irq(acx_device_t *adev);
+
+void acxsim_bench_consume(acx_device_t *adev, struct sk_buff *skb);
+int acxsim_dbgfs_bench_output(struct seq_file *file, acx_device_t *adev);
+int acxsim_set_bench_frames(acx_device_t *adev, unsigned long frames);
+ssize_t acxsim_replay_write(acx_device_t *adev, const char __user *ubuf,
+		size_t count, loff_t *ppos);
+int acxsim_dbgfs_replay_output(struct seq_file *file, acx_device_t *adev);
+
+int __init acxsim_init_module(void);
+void __exit acxsim_cleanup_module(void);
+
+#else /* !CONFIG_ACX_MAC80211_SIM */
+
+static inline u32 acxsim_read_reg(acx_device_t *adev, unsigned int offset)
+{ return 0; }
+
+static inline void acxsim_write_reg(acx_device_t *adev, unsigned int offset,
+		u32 val)
+{ }
+
+static inline void acxsim_synchronize_irq(acx_device_t *adev) { }
+
+static inline void acxsim_bench_consume(acx_device_t *adev,
+		struct sk_buff *skb)
+{ dev_kfree_skb_any(skb); }
+
+static inline int acxsim_dbgfs_bench_output(struct seq_file *file,
+		acx_device_t *adev)
+{ return 0; }
+
+static inline int acxsim_set_bench_frames(acx_device_t *adev,
+		unsigned long frames)
+{ return -ENODEV; }
+
+static inline ssize_t acxsim_replay_write(acx_device_t *adev,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{ return -ENODEV; }
+
+static inline int acxsim_dbgfs_replay_output(struct seq_file *file,
+		acx_device_t *adev)
+{ return 0; }
+
+static inline int __init acxsim_init_module(void) { return 0; }
+static inline void __exit acxsim_cleanup_module(void) { }
+
+#endif /* CONFIG_ACX_MAC80211_SIM */
+#endif /* _SIM_H_ */
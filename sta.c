@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2012
+ * The ACX100 Open Source Project <acx100-devel@lists.sourceforge.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Station table
+ *
+ * The ACX111 firmware keeps per station state, keys in particular, in
+ * station contexts, whose number is part of its memory configuration
+ * (acx_stations, see acx111_create_dma_regions()), 1 unless asked for
+ * more.  The firmware finds the context of a frame by the station's
+ * address, so on our side each station mac80211 adds only needs to be
+ * given one of them; when all are in use the station still works, with
+ * its state on the host.
+ *
+ * So by default only the first station gets a context, and with it a
+ * pairwise key in the firmware (see key.c); the others do their crypto
+ * in software.  An AP with more clients wants stations=16 or so, which
+ * changes the firmware's memory split and isn't verified yet, hence
+ * not the default.
+ *
+ * Our per station state lives in ieee80211_sta.drv_priv.  The table in
+ * adev->sta lists them all for debugfs and indexes them by AID: an AP
+ * hands out the lowest free AIDs, so the first ACX_STA_MAX of them
+ * cover its stations, and higher ones are found in the list.  The
+ * datapath doesn't look stations up: tx takes the one mac80211 hands
+ * over with the frame and notes its slot in the tx info for the
+ * status, rx keeps the last transmitter.
+ */
+
+#include "acx_debug.h"
+
+#include <linux/seq_file.h>
+#include <net/mac80211.h>
+
+#include "acx.h"
+#include "sta.h"
+#include "key.h"
+
+/* Called with the sem held, from the sta_add op */
+int acx_sta_add(acx_device_t *adev, struct ieee80211_sta *sta)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct acx_sta *as = acx_sta_priv(sta);
+	unsigned long flags;
+	unsigned int i;
+
+	memset(as, 0, sizeof(*as));
+	MAC_COPY(as->addr, sta->addr);
+	as->aid = sta->aid;
+	as->ctx = -1;
+	as->slot = -1;
+
+	for (i = 0; i < t->contexts; i++)
+		if (!t->ctx[i]) {
+			t->ctx[i] = as;
+			as->ctx = i;
+			break;
+		}
+	if (as->ctx < 0)
+		t->no_ctx++;
+
+	if (as->aid && as->aid <= ACX_STA_MAX && !t->aid[as->aid - 1])
+		t->aid[as->aid - 1] = as;
+
+	spin_lock_irqsave(&t->lock, flags);
+	for (i = 0; i < ACX_STA_MAX; i++)
+		if (!t->slot[i]) {
+			t->slot[i] = as;
+			as->slot = i;
+			break;
+		}
+	spin_unlock_irqrestore(&t->lock, flags);
+
+	list_add_tail(&as->list, &t->list);
+	t->count++;
+
+	log(L_ASSOC, "station " MACSTR " aid %u added, context %d\n",
+		MAC(as->addr), as->aid, as->ctx);
+
+	return 0;
+}
+
+/* Called with the sem held, from the sta_remove op */
+void acx_sta_remove(acx_device_t *adev, struct ieee80211_sta *sta)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct acx_sta *as = acx_sta_priv(sta);
+	unsigned long flags;
+
+	/* already gone with acx_sta_reset() */
+	if (list_empty(&as->list))
+		return;
+
+	acx_key_sta_remove(adev, as);
+	if (as->ctx >= 0)
+		t->ctx[as->ctx] = NULL;
+	if (as->aid && as->aid <= ACX_STA_MAX && t->aid[as->aid - 1] == as)
+		t->aid[as->aid - 1] = NULL;
+
+	spin_lock_irqsave(&t->lock, flags);
+	if (as->slot >= 0)
+		t->slot[as->slot] = NULL;
+	if (t->rx_last == as)
+		t->rx_last = NULL;
+	spin_unlock_irqrestore(&t->lock, flags);
+	list_del_init(&as->list);
+	t->count--;
+
+	log(L_ASSOC, "station " MACSTR " aid %u removed\n",
+		MAC(as->addr), as->aid);
+}
+
+/* From the sta_notify op, in atomic context */
+void acx_sta_notify(acx_device_t *adev, struct ieee80211_sta *sta, int ps)
+{
+	struct acx_sta *as = acx_sta_priv(sta);
+
+	as->ps = ps;
+	log(L_BUFT, "station " MACSTR " %s\n", MAC(as->addr),
+		ps ? "dozing" : "awake");
+}
+
+/* Forgets all stations when the firmware goes down: on a restart
+ * mac80211 adds them again */
+void acx_sta_reset(acx_device_t *adev)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct acx_sta *as, *tmp;
+	unsigned long flags;
+
+	list_for_each_entry_safe(as, tmp, &t->list, list) {
+		as->key = NULL;
+		list_del_init(&as->list);
+	}
+	memset(t->ctx, 0, sizeof(t->ctx));
+	memset(t->aid, 0, sizeof(t->aid));
+	t->count = 0;
+
+	spin_lock_irqsave(&t->lock, flags);
+	memset(t->slot, 0, sizeof(t->slot));
+	t->rx_last = NULL;
+	spin_unlock_irqrestore(&t->lock, flags);
+}
+
+/* With the sem held */
+struct acx_sta *acx_sta_find_aid(acx_device_t *adev, u16 aid)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct acx_sta *as;
+
+	if (!aid)
+		return NULL;
+	if (aid <= ACX_STA_MAX && t->aid[aid - 1])
+		return t->aid[aid - 1];
+
+	list_for_each_entry(as, &t->list, list)
+		if (as->aid == aid)
+			return as;
+
+	return NULL;
+}
+
+/*
+ * acx_sta_rx
+ *
+ * Counts an rx frame for its transmitter.  Frames mostly come in runs
+ * from the same station, so the last one is kept and mac80211's table
+ * only searched when the transmitter changes.
+ */
+void acx_sta_rx(acx_device_t *adev, struct ieee80211_hdr *hdr, int len)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct ieee80211_sta *sta;
+	struct acx_sta *as;
+	unsigned long flags;
+
+	if (!adev->vif || ieee80211_is_ctl(hdr->frame_control))
+		return;
+
+	spin_lock_irqsave(&t->lock, flags);
+	as = t->rx_last;
+	if (as && mac_is_equal(as->addr, hdr->addr2)) {
+		as->rx_frames++;
+		as->rx_bytes += len;
+		spin_unlock_irqrestore(&t->lock, flags);
+		return;
+	}
+	spin_unlock_irqrestore(&t->lock, flags);
+
+	/* mac80211 only removes the station after an rcu grace period,
+	 * so acx_sta_remove() comes after we cached it */
+	rcu_read_lock();
+	sta = ieee80211_find_sta(adev->vif, hdr->addr2);
+	if (sta) {
+		as = acx_sta_priv(sta);
+		spin_lock_irqsave(&t->lock, flags);
+		t->rx_last = as;
+		as->rx_frames++;
+		as->rx_bytes += len;
+		spin_unlock_irqrestore(&t->lock, flags);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * acx_sta_rx_key
+ *
+ * The pairwise key state of addr, for the frame acx_sta_rx() just
+ * counted.  Returns 0 if addr isn't a station of ours.
+ */
+int acx_sta_rx_key(acx_device_t *adev, const u8 *addr,
+		struct ieee80211_key_conf **key, int *sw_key)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct acx_sta *as;
+	unsigned long flags;
+	int found = 0;
+
+	spin_lock_irqsave(&t->lock, flags);
+	as = t->rx_last;
+	if (as && mac_is_equal(as->addr, addr)) {
+		*key = as->key;
+		*sw_key = as->sw_key;
+		found = 1;
+	}
+	spin_unlock_irqrestore(&t->lock, flags);
+
+	return found;
+}
+
+/*
+ * acx_sta_tx
+ *
+ * From the tx op or the txq pull, with the station mac80211 handed
+ * over the frame for, NULL if none.  Its slot goes along in the tx
+ * info for acx_sta_tx_status(): the station may be gone by then.
+ */
+void acx_sta_tx(acx_device_t *adev, struct ieee80211_sta *sta,
+		struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct acx_sta *as;
+
+	info->rate_driver_data[0] = NULL;
+	if (!sta)
+		return;
+
+	as = acx_sta_priv(sta);
+	as->tx_frames++;
+	as->tx_bytes += skb->len;
+	info->rate_driver_data[0] = (void *) (long) (as->slot + 1);
+}
+
+/* Before the tx status goes up */
+void acx_sta_tx_status(acx_device_t *adev, struct sk_buff *skb)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	long slot = (long) info->rate_driver_data[0];
+	struct acx_sta *as;
+	unsigned long flags;
+
+	/* shared with the status fields mac80211 reads */
+	info->rate_driver_data[0] = NULL;
+
+	if (slot <= 0 || (info->flags & IEEE80211_TX_STAT_ACK)
+	    || (info->flags & IEEE80211_TX_CTL_NO_ACK))
+		return;
+
+	spin_lock_irqsave(&t->lock, flags);
+	as = t->slot[slot - 1];
+	if (as)
+		as->tx_failed++;
+	spin_unlock_irqrestore(&t->lock, flags);
+}
+
+int acx_sta_dbgfs_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acx_sta_table *t = &adev->sta;
+	struct acx_sta *as;
+
+	acx_sem_lock(adev);
+
+	seq_printf(file,
+		"contexts:\t%u\n"
+		"stations:\t%u\n"
+		"without context:\t%lu\n"
+		"aid,addr,context,ps,tx_frames,tx_bytes,tx_failed,"
+		"rx_frames,rx_bytes\n",
+		t->contexts, t->count, t->no_ctx);
+
+	list_for_each_entry(as, &t->list, list)
+		seq_printf(file, "%u," MACSTR ",%d,%d,%lu,%lu,%lu,%lu,%lu\n",
+			as->aid, MAC(as->addr), as->ctx, as->ps,
+			as->tx_frames, as->tx_bytes, as->tx_failed,
+			as->rx_frames, as->rx_bytes);
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
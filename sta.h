@@ -0,0 +1,26 @@
+#ifndef _ACX_STA_H_
+#define _ACX_STA_H_
+
+struct seq_file;
+
+static inline struct acx_sta *acx_sta_priv(struct ieee80211_sta *sta)
+{
+	return (struct acx_sta *) sta->drv_priv;
+}
+
+int acx_sta_add(acx_device_t *adev, struct ieee80211_sta *sta);
+void acx_sta_remove(acx_device_t *adev, struct ieee80211_sta *sta);
+void acx_sta_notify(acx_device_t *adev, struct ieee80211_sta *sta, int ps);
+void acx_sta_reset(acx_device_t *adev);
+struct acx_sta *acx_sta_find_aid(acx_device_t *adev, u16 aid);
+
+void acx_sta_rx(acx_device_t *adev, struct ieee80211_hdr *hdr, int len);
+int acx_sta_rx_key(acx_device_t *adev, const u8 *addr,
+		struct ieee80211_key_conf **key, int *sw_key);
+void acx_sta_tx(acx_device_t *adev, struct ieee80211_sta *sta,
+		struct sk_buff *skb);
+void acx_sta_tx_status(acx_device_t *adev, struct sk_buff *skb);
+
+int acx_sta_dbgfs_output(struct seq_file *file, acx_device_t *adev);
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2012
+ * The ACX100 Open Source Project <acx100-devel@lists.sourceforge.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Channel survey
+ *
+ * The firmware counts the time the medium was sensed busy
+ * (ACX1xx_IE_MEDIUM_USAGE) and the frames received with a bad FCS
+ * (ACX1xx_IE_FCS_ERROR_COUNT), but it doesn't know about channels:
+ * these are free running counters.  We read them from the watchdog,
+ * when mac80211 asks for a survey and right before changing channel,
+ * and add what they moved to the channel we were on.  So the totals
+ * in adev->survey only cover time actually spent on each channel.
+ *
+ * The other channels are sampled as the scans visit them: the counters
+ * are read around each firmware scan over a single channel, and while
+ * sampling the scans are run one channel at a time (see
+ * acx_scan_start()).  The firmware gives no noise floor (the layout of
+ * its noise histogram is unknown), so with the busy time goes a
+ * nominal one, ACX_SURVEY_NOISE_DBM, the same for every channel:
+ * hostapd's ACS wants one, and then ranks the channels by busy time.
+ *
+ * The reads cost two commands, so sampling only goes on for
+ * ACX_SURVEY_HOLD seconds after the survey was last read through
+ * mac80211 or debugfs.
+ */
+
+#include "acx_debug.h"
+
+#include <linux/seq_file.h>
+#include <net/mac80211.h>
+
+#include "acx.h"
+#include "cmd.h"
+#include "ie.h"
+#include "survey.h"
+
+/* watchdog sampling period, in seconds */
+#define ACX_SURVEY_INTERVAL	1
+
+/* sampling after a survey read, in seconds */
+#define ACX_SURVEY_HOLD		300
+
+/* windows shorter than this don't go into the busy history */
+#define ACX_SURVEY_HIST_MIN_US	(USEC_PER_SEC / 10)
+
+/* a window longer than twice the wall clock (plus the time for the
+ * commands) means the firmware restarted its counters */
+#define ACX_SURVEY_SLACK_US	20000
+
+/* nominal noise floor: thermal noise over 20 MHz (-101 dBm) plus a
+ * typical 6 dB receiver noise figure */
+#define ACX_SURVEY_NOISE_DBM	(-95)
+
+static int acx_survey_read(acx_device_t *adev, u32 *busy_us, u32 *total_us,
+			u32 *fcs)
+{
+	acx1xx_ie_medium_usage_t usage;
+	acx1xx_ie_fcs_error_count_t fcs_err;
+
+	memset(&usage, 0, sizeof(usage));
+	memset(&fcs_err, 0, sizeof(fcs_err));
+
+	if (OK != acx_interrogate(adev, &usage, ACX1xx_IE_MEDIUM_USAGE))
+		return NOT_OK;
+	if (OK != acx_interrogate(adev, &fcs_err, ACX1xx_IE_FCS_ERROR_COUNT))
+		return NOT_OK;
+
+	*busy_us = le32_to_cpu(usage.busy_us);
+	*total_us = le32_to_cpu(usage.total_us);
+	*fcs = le32_to_cpu(fcs_err.count);
+
+	return OK;
+}
+
+/* Newer (TNETW1450?) firmware only: read with each sample until the
+ * firmware rejects it once, kept raw for debugfs */
+static void acx_survey_read_noise_hist(acx_device_t *adev)
+{
+	struct acx_survey *s = &adev->survey;
+	acx1ff_ie_noise_histogram_t hist;
+
+	if (!IS_ACX111(adev) || s->noise_hist < 0)
+		return;
+
+	memset(&hist, 0, sizeof(hist));
+	if (OK != acx_interrogate(adev, &hist,
+				ACX1FF_IE_NOISE_HISTOGRAM_RESULTS)) {
+		log(L_INIT, "no noise histogram in this firmware\n");
+		s->noise_hist = -1;
+		return;
+	}
+	memcpy(s->noise_hist_bins, hist.bins, sizeof(s->noise_hist_bins));
+	s->noise_hist = 1;
+}
+
+/* Whether someone read the survey lately, with the sem held */
+int acx_survey_active(acx_device_t *adev)
+{
+	struct acx_survey *s = &adev->survey;
+
+	return s->consumer && time_before(jiffies,
+				s->consumer_last + ACX_SURVEY_HOLD * HZ);
+}
+
+static void acx_survey_used(acx_device_t *adev)
+{
+	adev->survey.consumer = 1;
+	adev->survey.consumer_last = jiffies;
+}
+
+/* Adds the counters' increase over a window on channel ch, which took
+ * elapsed_us of wall clock, to its totals.  u32 arithmetic copes with
+ * the counters wrapping */
+static void acx_survey_account(acx_device_t *adev, u8 ch, u32 d_busy,
+			u32 d_total, u32 d_fcs, u32 elapsed_us)
+{
+	struct acx_survey_chan *chan = &adev->survey.chan[ch - 1];
+
+	d_busy = min(d_busy, d_total);
+	if (d_total / 2 > elapsed_us + ACX_SURVEY_SLACK_US)
+		return;
+
+	chan->time_us += d_total;
+	chan->busy_us += d_busy;
+	chan->fcs_errors += d_fcs;
+
+	if (d_total >= ACX_SURVEY_HIST_MIN_US) {
+		chan->hist[chan->hist_head] = (u8) div_u64(
+			(u64) d_busy * 100, d_total);
+		chan->hist_head = (chan->hist_head + 1) % ACX_SURVEY_HIST;
+		if (chan->hist_count < ACX_SURVEY_HIST)
+			chan->hist_count++;
+	}
+}
+
+/*
+ * acx_survey_sample
+ *
+ * Closes the current window: accounts the increase of the counters
+ * since the previous read to the channel the window was on, and starts
+ * the next one.  Called with the sem held.
+ */
+void acx_survey_sample(acx_device_t *adev)
+{
+	struct acx_survey *s = &adev->survey;
+	u32 busy, total, fcs;
+	unsigned long now = jiffies;
+
+	if (!test_bit(ACX_FLAG_HW_UP, &adev->flags)
+	    || test_bit(ACX_FLAG_SCANNING, &adev->flags)
+	    || !adev->channel || adev->channel > ACX_SURVEY_CHANNELS
+	    || !acx_survey_active(adev)
+	    || OK != acx_survey_read(adev, &busy, &total, &fcs)) {
+		s->have_prev = 0;
+		return;
+	}
+
+	if (s->have_prev && s->channel == adev->channel)
+		acx_survey_account(adev, s->channel, busy - s->prev_busy_us,
+			total - s->prev_total_us, fcs - s->prev_fcs,
+			jiffies_to_usecs(now - s->last));
+
+	s->prev_busy_us = busy;
+	s->prev_total_us = total;
+	s->prev_fcs = fcs;
+	s->last = now;
+	s->channel = adev->channel;
+	s->have_prev = 1;
+}
+
+/* Called from the watchdog every second, with the sem held */
+void acx_survey_watchdog(acx_device_t *adev)
+{
+	struct acx_survey *s = &adev->survey;
+
+	if (!acx_survey_active(adev)) {
+		s->have_prev = 0;
+		return;
+	}
+
+	if (!s->have_prev
+	    || time_after_eq(jiffies, s->last + ACX_SURVEY_INTERVAL * HZ)) {
+		acx_survey_sample(adev);
+		acx_survey_read_noise_hist(adev);
+	}
+}
+
+/*
+ * acx_survey_set_channel
+ *
+ * Called with the sem held before the firmware is told to change to
+ * channel, so the windows don't straddle two channels.
+ */
+void acx_survey_set_channel(acx_device_t *adev, u8 channel)
+{
+	if (channel == adev->channel)
+		return;
+
+	acx_survey_sample(adev);
+	/* the counters go on, only the channel changes */
+	adev->survey.channel = channel;
+}
+
+/*
+ * acx_survey_scan_start
+ *
+ * Called with the sem held right before a firmware scan over chans.
+ * Only a scan over a single channel can be accounted to it.
+ */
+void acx_survey_scan_start(acx_device_t *adev, u16 chans)
+{
+	struct acx_survey *s = &adev->survey;
+
+	s->scan_chan = 0;
+	if (!acx_survey_active(adev) || hweight16(chans) != 1
+	    || OK != acx_survey_read(adev, &s->scan_busy_us,
+				&s->scan_total_us, &s->scan_fcs))
+		return;
+
+	s->scan_chan = ffs(chans);
+	s->scan_start = jiffies;
+}
+
+/* Called with the sem held when the firmware scan completed */
+void acx_survey_scan_done(acx_device_t *adev)
+{
+	struct acx_survey *s = &adev->survey;
+	u32 busy, total, fcs;
+	u8 ch = s->scan_chan;
+
+	s->scan_chan = 0;
+	if (!ch || OK != acx_survey_read(adev, &busy, &total, &fcs))
+		return;
+
+	acx_survey_account(adev, ch, busy - s->scan_busy_us,
+		total - s->scan_total_us, fcs - s->scan_fcs,
+		jiffies_to_usecs(jiffies - s->scan_start));
+}
+
+/* Forgets the totals and history, with the sem held */
+void acx_survey_reset(acx_device_t *adev)
+{
+	struct acx_survey *s = &adev->survey;
+
+	memset(s->chan, 0, sizeof(s->chan));
+	s->have_prev = 0;
+}
+
+int acx_survey_dbgfs_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct acx_survey *s = &adev->survey;
+	struct acx_survey_chan *chan;
+	unsigned int ch, i;
+
+	acx_sem_lock(adev);
+
+	acx_survey_used(adev);
+	acx_survey_sample(adev);
+
+	seq_printf(file, "sampling on for %u s after a read\n",
+		ACX_SURVEY_HOLD);
+	seq_printf(file, "channel time_ms busy_ms busy%% fcs_errors"
+		" history (busy%%, oldest first)\n");
+	for (ch = 1; ch <= ACX_SURVEY_CHANNELS; ch++) {
+		chan = &s->chan[ch - 1];
+		if (!chan->time_us && ch != adev->channel)
+			continue;
+
+		seq_printf(file, "%c%2u %llu %llu %u %u ",
+			(ch == adev->channel) ? '*' : ' ', ch,
+			(unsigned long long) div_u64(chan->time_us, 1000),
+			(unsigned long long) div_u64(chan->busy_us, 1000),
+			chan->time_us ? (unsigned int) div64_u64(
+				chan->busy_us * 100, chan->time_us) : 0,
+			chan->fcs_errors);
+		for (i = 0; i < chan->hist_count; i++)
+			seq_printf(file, " %u", chan->hist[(chan->hist_head
+				+ ACX_SURVEY_HIST - chan->hist_count + i)
+				% ACX_SURVEY_HIST]);
+		seq_printf(file, "\n");
+	}
+
+	seq_printf(file, "noise histogram:");
+	if (s->noise_hist > 0) {
+		for (i = 0; i < ACX_NOISE_HIST_LEN; i++)
+			seq_printf(file, " %02x", s->noise_hist_bins[i]);
+		seq_printf(file, "\n");
+	} else {
+		seq_printf(file, " %s\n", s->noise_hist ?
+			"not supported by the firmware" : "not read yet");
+	}
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+
+/*
+ * BOM Mac80211 Ops
+ * ==================================================
+ */
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+int acx_op_get_survey(struct ieee80211_hw *hw, int idx,
+		struct survey_info *survey)
+{
+	acx_device_t *adev = hw2adev(hw);
+	struct ieee80211_supported_band *sband;
+	struct acx_survey_chan *chan;
+	u8 ch;
+
+	sband = hw->wiphy->bands[IEEE80211_BAND_2GHZ];
+	if (idx < 0 || idx >= sband->n_channels)
+		return -ENOENT;
+	ch = sband->channels[idx].hw_value;
+	if (!ch || ch > ACX_SURVEY_CHANNELS)
+		return -ENOENT;
+
+	acx_sem_lock(adev);
+
+	acx_survey_used(adev);
+	/* bring the channel we're on up to date */
+	if (ch == adev->channel)
+		acx_survey_sample(adev);
+	chan = &adev->survey.chan[ch - 1];
+
+	memset(survey, 0, sizeof(*survey));
+	survey->channel = &sband->channels[idx];
+	/* not sampled yet: no claim of an idle channel */
+	if (chan->time_us) {
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(4, 0, 0)
+		survey->filled = SURVEY_INFO_TIME | SURVEY_INFO_TIME_BUSY;
+		survey->time = div_u64(chan->time_us, 1000);
+		survey->time_busy = div_u64(chan->busy_us, 1000);
+#else
+		survey->filled = SURVEY_INFO_CHANNEL_TIME
+			| SURVEY_INFO_CHANNEL_TIME_BUSY;
+		survey->channel_time = div_u64(chan->time_us, 1000);
+		survey->channel_time_busy = div_u64(chan->busy_us, 1000);
+#endif
+		survey->filled |= SURVEY_INFO_NOISE_DBM;
+		survey->noise = ACX_SURVEY_NOISE_DBM;
+	}
+	if (ch == adev->channel)
+		survey->filled |= SURVEY_INFO_IN_USE;
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,20 @@
+#ifndef _ACX_SURVEY_H_
+#define _ACX_SURVEY_H_
+
+struct seq_file;
+
+int acx_survey_active(acx_device_t *adev);
+void acx_survey_sample(acx_device_t *adev);
+void acx_survey_watchdog(acx_device_t *adev);
+void acx_survey_set_channel(acx_device_t *adev, u8 channel);
+void acx_survey_scan_start(acx_device_t *adev, u16 chans);
+void acx_survey_scan_done(acx_device_t *adev);
+void acx_survey_reset(acx_device_t *adev);
+int acx_survey_dbgfs_output(struct seq_file *file, acx_device_t *adev);
+
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+int acx_op_get_survey(struct ieee80211_hw *hw, int idx,
+		struct survey_info *survey);
+#endif
+
+#endif
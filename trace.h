@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2012
+ * The ACX100 Open Source Project <acx100-devel@lists.sourceforge.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tracepoints for the hot paths (tx submit/complete, rx, commands,
+ * irqs, queue flow control). Unlike log(), these stay compiled in
+ * with ACX_DEBUG=0 and cost a patched-out branch when disabled.
+ *
+ * Enable with e.g.:
+ *   echo 1 > /sys/kernel/debug/tracing/events/acx/enable
+ * scripts/acx-trace-latency.sh turns the raw events into latencies.
+ */
+
+#if !defined(_ACX_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _ACX_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM acx
+
+/* Strings are copied into the entry, so the trace tools can read
+ * them and they outlive the device */
+#define ACX_TRACE_DEV_ENTRY	__string(dev, wiphy_name(adev->hw->wiphy))
+#define ACX_TRACE_DEV_ASSIGN(adev)	\
+	__assign_str(dev, wiphy_name((adev)->hw->wiphy))
+
+TRACE_EVENT(acx_tx_submit,
+	TP_PROTO(acx_device_t *adev, struct sk_buff *skb, int queue_id),
+	TP_ARGS(adev, skb, queue_id),
+	TP_STRUCT__entry(
+		ACX_TRACE_DEV_ENTRY
+		__field(const void *, skb)
+		__field(unsigned int, len)
+		__field(int, queue_id)
+	),
+	TP_fast_assign(
+		ACX_TRACE_DEV_ASSIGN(adev);
+		__entry->skb = skb;
+		__entry->len = skb->len;
+		__entry->queue_id = queue_id;
+	),
+	TP_printk("%s skb=%p len=%u queue=%d", __get_str(dev), __entry->skb,
+		__entry->len, __entry->queue_id)
+);
+
+TRACE_EVENT(acx_tx_complete,
+	TP_PROTO(acx_device_t *adev, struct sk_buff *skb, u8 error,
+		u8 ack_failures, u8 rts_failures, u8 rts_ok),
+	TP_ARGS(adev, skb, error, ack_failures, rts_failures, rts_ok),
+	TP_STRUCT__entry(
+		ACX_TRACE_DEV_ENTRY
+		__field(const void *, skb)
+		__field(u8, error)
+		__field(u8, ack_failures)
+		__field(u8, rts_failures)
+		__field(u8, rts_ok)
+	),
+	TP_fast_assign(
+		ACX_TRACE_DEV_ASSIGN(adev);
+		__entry->skb = skb;
+		__entry->error = error;
+		__entry->ack_failures = ack_failures;
+		__entry->rts_failures = rts_failures;
+		__entry->rts_ok = rts_ok;
+	),
+	TP_printk("%s skb=%p error=0x%02x ack_failures=%u rts_failures=%u "
+		"rts_ok=%u", __get_str(dev), __entry->skb, __entry->error,
+		__entry->ack_failures, __entry->rts_failures, __entry->rts_ok)
+);
+
+TRACE_EVENT(acx_rx,
+	TP_PROTO(acx_device_t *adev, unsigned int len, int signal,
+		int rate_idx, u8 plcp, u8 phy_stat),
+	TP_ARGS(adev, len, signal, rate_idx, plcp, phy_stat),
+	TP_STRUCT__entry(
+		ACX_TRACE_DEV_ENTRY
+		__field(unsigned int, len)
+		__field(int, signal)
+		__field(int, rate_idx)
+		__field(u8, plcp)
+		__field(u8, phy_stat)
+	),
+	TP_fast_assign(
+		ACX_TRACE_DEV_ASSIGN(adev);
+		__entry->len = len;
+		__entry->signal = signal;
+		__entry->rate_idx = rate_idx;
+		__entry->plcp = plcp;
+		__entry->phy_stat = phy_stat;
+	),
+	TP_printk("%s len=%u signal=%d rate_idx=%d plcp=0x%02x phy_stat=0x%02x",
+		__get_str(dev), __entry->len, __entry->signal, __entry->rate_idx,
+		__entry->plcp, __entry->phy_stat)
+);
+
+TRACE_EVENT(acx_cmd_issue,
+	TP_PROTO(acx_device_t *adev, unsigned int cmd, const char *cmdstr,
+		unsigned int len),
+	TP_ARGS(adev, cmd, cmdstr, len),
+	TP_STRUCT__entry(
+		ACX_TRACE_DEV_ENTRY
+		__field(unsigned int, cmd)
+		__string(cmdstr, cmdstr)
+		__field(unsigned int, len)
+	),
+	TP_fast_assign(
+		ACX_TRACE_DEV_ASSIGN(adev);
+		__entry->cmd = cmd;
+		__assign_str(cmdstr, cmdstr);
+		__entry->len = len;
+	),
+	TP_printk("%s cmd=0x%04x (%s) len=%u", __get_str(dev), __entry->cmd,
+		__get_str(cmdstr), __entry->len)
+);
+
+TRACE_EVENT(acx_cmd_done,
+	TP_PROTO(acx_device_t *adev, unsigned int cmd, const char *cmdstr,
+		int res, s64 latency_us),
+	TP_ARGS(adev, cmd, cmdstr, res, latency_us),
+	TP_STRUCT__entry(
+		ACX_TRACE_DEV_ENTRY
+		__field(unsigned int, cmd)
+		__string(cmdstr, cmdstr)
+		__field(int, res)
+		__field(s64, latency_us)
+	),
+	TP_fast_assign(
+		ACX_TRACE_DEV_ASSIGN(adev);
+		__entry->cmd = cmd;
+		__assign_str(cmdstr, cmdstr);
+		__entry->res = res;
+		__entry->latency_us = latency_us;
+	),
+	TP_printk("%s cmd=0x%04x (%s) res=%d latency_us=%lld", __get_str(dev),
+		__entry->cmd, __get_str(cmdstr), __entry->res,
+		(long long)__entry->latency_us)
+);
+
+TRACE_EVENT(acx_irq,
+	TP_PROTO(acx_device_t *adev, u16 irqreason, u16 irqmasked),
+	TP_ARGS(adev, irqreason, irqmasked),
+	TP_STRUCT__entry(
+		ACX_TRACE_DEV_ENTRY
+		__field(u16, irqreason)
+		__field(u16, irqmasked)
+	),
+	TP_fast_assign(
+		ACX_TRACE_DEV_ASSIGN(adev);
+		__entry->irqreason = irqreason;
+		__entry->irqmasked = irqmasked;
+	),
+	TP_printk("%s irqreason=0x%04x irqmasked=0x%04x", __get_str(dev),
+		__entry->irqreason, __entry->irqmasked)
+);
+
+DECLARE_EVENT_CLASS(acx_queue_class,
+	TP_PROTO(acx_device_t *adev, const char *msg),
+	TP_ARGS(adev, msg),
+	TP_STRUCT__entry(
+		ACX_TRACE_DEV_ENTRY
+		__string(msg, msg ? msg : "")
+	),
+	TP_fast_assign(
+		ACX_TRACE_DEV_ASSIGN(adev);
+		__assign_str(msg, msg ? msg : "");
+	),
+	TP_printk("%s %s", __get_str(dev), __get_str(msg))
+);
+
+DEFINE_EVENT(acx_queue_class, acx_queue_stop,
+	TP_PROTO(acx_device_t *adev, const char *msg),
+	TP_ARGS(adev, msg)
+);
+
+DEFINE_EVENT(acx_queue_class, acx_queue_wake,
+	TP_PROTO(acx_device_t *adev, const char *msg),
+	TP_ARGS(adev, msg)
+);
+
+#endif /* _ACX_TRACE_H_ */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+#include <trace/define_trace.h>
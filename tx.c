@@ -18,13 +18,285 @@
 
 #include "acx_debug.h"
 
+#include <linux/seq_file.h>
+
 #include "acx.h"
 #include "pci.h"
 #include "mem.h"
 #include "merge.h"
 #include "usb.h"
 #include "main.h"
+#include "cardsetting.h"
 #include "tx.h"
+#include "sta.h"
+#include "key.h"
+#include "trace.h"
+
+/*
+ * Byte queue limits of the tx rings
+ *
+ * The descriptor count alone lets a ring hold TX_CNT full frames, a
+ * quarter second of queueing at 1 Mbit/s.  So a ring also stops at a
+ * byte limit, which, as BQL does, grows when the ring ran dry while
+ * frames were held back by it, and shrinks by the part of it which
+ * stayed unused over ACX_TX_DQL_HOLD.  It's capped to ACX_TX_DQL_MAX_US
+ * of airtime, at the average airtime per byte of the completions.
+ *
+ * Only PCI has a ring per queue_id, mem and USB use ring 0.  The state
+ * has its own lock, as the mem tx status already runs under
+ * adev->spinlock.
+ */
+static int acx_tx_ring(acx_device_t *adev, int queue_id)
+{
+	return IS_PCI(adev) ? queue_id : 0;
+}
+
+void acx_tx_dql_reset(acx_device_t *adev, int ring)
+{
+	struct hw_tx_queue *tx = &adev->hw_tx_queue[ring];
+	unsigned long flags;
+
+	spin_lock_irqsave(&tx->dql.lock, flags);
+	tx->dql.inflight = 0;
+	tx->dql.limit = ACX_TX_DQL_INIT;
+	tx->dql.completed = 0;
+	tx->dql.lowest = UINT_MAX;
+	tx->dql.slack_start = jiffies;
+	tx->dql.limited = 0;
+	spin_unlock_irqrestore(&tx->dql.lock, flags);
+}
+
+int acx_tx_dql_full(acx_device_t *adev, int ring)
+{
+	struct hw_tx_queue *tx = &adev->hw_tx_queue[ring];
+	unsigned long flags;
+	int full;
+
+	spin_lock_irqsave(&tx->dql.lock, flags);
+	full = tx->dql.inflight >= tx->dql.limit;
+	spin_unlock_irqrestore(&tx->dql.lock, flags);
+
+	return full;
+}
+
+/* From the tx path: whether the limit stops the ring, noting that it
+ * held frames back */
+static int acx_tx_dql_stop(acx_device_t *adev, int ring)
+{
+	struct hw_tx_queue *tx = &adev->hw_tx_queue[ring];
+	unsigned long flags;
+	int full;
+
+	spin_lock_irqsave(&tx->dql.lock, flags);
+	full = tx->dql.inflight >= tx->dql.limit;
+	if (full) {
+		tx->dql.limited = 1;
+		tx->dql.stops++;
+	}
+	spin_unlock_irqrestore(&tx->dql.lock, flags);
+
+	return full;
+}
+
+/* Before a frame of len bytes goes to ring, so before its status */
+static void acx_tx_dql_queued(acx_device_t *adev, int ring, unsigned int len)
+{
+	struct hw_tx_queue *tx = &adev->hw_tx_queue[ring];
+	unsigned long flags;
+
+	spin_lock_irqsave(&tx->dql.lock, flags);
+	tx->dql.inflight += len;
+	spin_unlock_irqrestore(&tx->dql.lock, flags);
+}
+
+/* Airtime of a sent frame, from its tx status, in us */
+static unsigned int acx_tx_status_airtime(acx_device_t *adev,
+			struct ieee80211_tx_info *info, int len)
+{
+	struct ieee80211_supported_band *sband =
+		adev->hw->wiphy->bands[IEEE80211_BAND_2GHZ];
+	struct ieee80211_tx_rate *r;
+	unsigned int us = 0;
+	int i;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		r = &info->status.rates[i];
+		if (r->idx < 0 || r->idx >= sband->n_bitrates || !r->count)
+			break;
+		/* bitrate is in 100 kbit/s */
+		us += r->count * (ACX_TX_OVERHEAD_US
+			+ len * 80 / sband->bitrates[r->idx].bitrate);
+	}
+
+	return us;
+}
+
+/* Called for each tx status, before the skb goes up */
+void acx_tx_dql_completed(acx_device_t *adev, int ring, struct sk_buff *skb)
+{
+	struct hw_tx_queue *tx = &adev->hw_tx_queue[ring];
+	unsigned int us, len = skb->len;
+	unsigned long flags;
+
+	us = acx_tx_status_airtime(adev, IEEE80211_SKB_CB(skb), len);
+
+	spin_lock_irqsave(&tx->dql.lock, flags);
+	tx->dql.inflight -= min(len, tx->dql.inflight);
+	tx->dql.completed += len;
+
+	if (us && len) {
+		if (!tx->dql.byte_ns)
+			tx->dql.byte_ns = us * 1000 / len;
+		else
+			tx->dql.byte_ns += ((int) (us * 1000 / len)
+				- (int) tx->dql.byte_ns) / 8;
+	}
+	spin_unlock_irqrestore(&tx->dql.lock, flags);
+}
+
+/*
+ * acx_tx_dql_update
+ *
+ * Adapts the limit of a ring after a batch of tx status, see above.
+ */
+void acx_tx_dql_update(acx_device_t *adev, int ring)
+{
+	struct hw_tx_queue *tx = &adev->hw_tx_queue[ring];
+	unsigned int slack, cap;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tx->dql.lock, flags);
+	if (!tx->dql.completed)
+		goto out;
+
+	if (!tx->dql.inflight && tx->dql.limited) {
+		/* the limit kept back frames the ring could have sent */
+		tx->dql.limit += tx->dql.completed;
+		tx->dql.starved++;
+		tx->dql.limited = 0;
+		tx->dql.lowest = UINT_MAX;
+		tx->dql.slack_start = jiffies;
+	} else {
+		slack = tx->dql.limit > tx->dql.inflight
+			? tx->dql.limit - tx->dql.inflight : 0;
+		tx->dql.lowest = min(tx->dql.lowest, slack);
+
+		if (time_after(jiffies,
+				tx->dql.slack_start + ACX_TX_DQL_HOLD)) {
+			if (tx->dql.lowest && !tx->dql.limited) {
+				tx->dql.limit -= tx->dql.lowest;
+				tx->dql.shrunk++;
+			}
+			tx->dql.limited = 0;
+			tx->dql.lowest = UINT_MAX;
+			tx->dql.slack_start = jiffies;
+		}
+	}
+
+	cap = ACX_TX_DQL_MAX_US * 1000;
+	if (tx->dql.byte_ns)
+		cap /= tx->dql.byte_ns;
+	tx->dql.limit = clamp_t(unsigned int, tx->dql.limit,
+			ACX_TX_DQL_MIN, max_t(unsigned int, cap, ACX_TX_DQL_MIN));
+	tx->dql.completed = 0;
+out:
+	spin_unlock_irqrestore(&tx->dql.lock, flags);
+}
+
+/*
+ * Whether mac80211 has any use for the status of skb: frames without
+ * an ACK don't feed the rate control, so unless the status was asked
+ * for, or a monitor wants to see it, they are just freed.
+ */
+static int acx_tx_status_wanted(acx_device_t *adev, struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+
+	return (info->flags & IEEE80211_TX_CTL_REQ_TX_STATUS)
+		|| !(info->flags & IEEE80211_TX_CTL_NO_ACK)
+		|| adev->mode == ACX_MODE_MONITOR;
+}
+
+/*
+ * acx_tx_status_report
+ *
+ * Reports the tx status a clean pass collected in done, under a single
+ * local_bh_disable(), in process context.
+ */
+void acx_tx_status_report(acx_device_t *adev, struct sk_buff_head *done)
+{
+	struct sk_buff *skb;
+	unsigned int n = skb_queue_len(done);
+
+	if (!n)
+		return;
+
+	adev->tx_status_stats.passes++;
+	adev->tx_status_stats.frames += n;
+	if (n > adev->tx_status_stats.max_batch)
+		adev->tx_status_stats.max_batch = n;
+
+	local_bh_disable();
+	while ((skb = __skb_dequeue(done))) {
+		if (acx_tx_status_wanted(adev, skb)) {
+			ieee80211_tx_status(adev->hw, skb);
+			adev->tx_status_stats.reported++;
+		} else {
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 5, 0)
+			ieee80211_free_txskb(adev->hw, skb);
+#else
+			dev_kfree_skb_any(skb);
+#endif
+			adev->tx_status_stats.skipped++;
+		}
+	}
+	local_bh_enable();
+}
+
+int acx_tx_dql_dbgfs_output(struct seq_file *file, acx_device_t *adev)
+{
+	struct hw_tx_queue *tx;
+	int i;
+
+	acx_sem_lock(adev);
+
+	for (i = 0; i < adev->num_hw_tx_queues; i++) {
+		tx = &adev->hw_tx_queue[i];
+		seq_printf(file,
+			"ring %d:\n"
+			"  free descs:\t%u\n"
+			"  in flight:\t%u bytes, ~%u us\n"
+			"  limit:\t%u bytes\n"
+			"  airtime/byte:\t%u ns\n"
+			"  stops:\t%lu\n"
+			"  starved:\t%lu\n"
+			"  shrunk:\t%lu\n",
+			i, tx->free, tx->dql.inflight,
+			tx->dql.inflight * tx->dql.byte_ns / 1000,
+			tx->dql.limit, tx->dql.byte_ns, tx->dql.stops,
+			tx->dql.starved, tx->dql.shrunk);
+	}
+
+	seq_printf(file,
+		"tx status:\n"
+		"  clean passes:\t%lu\n"
+		"  frames:\t%lu, max %u per pass\n"
+		"  reported:\t%lu\n"
+		"  skipped:\t%lu\n",
+		adev->tx_status_stats.passes, adev->tx_status_stats.frames,
+		adev->tx_status_stats.max_batch,
+		adev->tx_status_stats.reported, adev->tx_status_stats.skipped);
+	if (adev->tx_status_stats.passes)
+		seq_printf(file, "  per pass:\t%lu.%02lu\n",
+			adev->tx_status_stats.frames
+				/ adev->tx_status_stats.passes,
+			adev->tx_status_stats.frames * 100
+				/ adev->tx_status_stats.passes % 100);
+
+	acx_sem_unlock(adev);
+
+	return 0;
+}
 
 static int acx_is_hw_tx_queue_stop_limit(acx_device_t *adev)
 {
@@ -37,6 +309,13 @@ static int acx_is_hw_tx_queue_stop_limit(acx_device_t *adev)
 				" Stop queue.\n", i, adev->hw_tx_queue[i].free);
 			return 1;
 		}
+		if (acx_tx_dql_stop(adev, i))
+		{
+			logf1(L_BUF, "queue_id=%d: %u bytes in flight, limit %u:"
+				" Stop queue.\n", i, adev->hw_tx_queue[i].dql.inflight,
+				adev->hw_tx_queue[i].dql.limit);
+			return 1;
+		}
 	}
 
 	return 0;
@@ -96,7 +375,7 @@ static tx_t* acx_alloc_tx(acx_device_t *adev, unsigned int len, int q)
 	return (NULL);
 }
 
-static int acx_tx_frame(acx_device_t *adev, struct sk_buff *skb)
+int acx_tx_frame(acx_device_t *adev, struct sk_buff *skb)
 {
 	tx_t *tx;
 	void *txbuf;
@@ -112,6 +391,14 @@ static int acx_tx_frame(acx_device_t *adev, struct sk_buff *skb)
 	/* Sent unencrypted frames (e.g. mgmt- and eapol-frames) on NOENC_QUEUE_ID */
 	if (!(hdr->frame_control & IEEE80211_FCTL_PROTECTED))
 		queue_id=NOENC_QUEUE_ID;
+	else if (ctl->control.hw_key)
+		adev->keys.tx_hw++;
+	else {
+		/* Encrypted by mac80211 with a key which is not in the
+		 * firmware, see key.c */
+		queue_id=NOENC_QUEUE_ID;
+		adev->keys.tx_sw++;
+	}
 
 	/* With hw-encyption disabled, sent all on the NOENC queue.
 	 * This is required, if the was previously used using hw-encyption:
@@ -144,10 +431,14 @@ static int acx_tx_frame(acx_device_t *adev, struct sk_buff *skb)
 	 */
 	memcpy(txbuf, skb->data, skb->len);
 
+	/* before the tx status can come */
+	acx_tx_dql_queued(adev, acx_tx_ring(adev, queue_id), skb->len);
+	trace_acx_tx_submit(adev, skb, queue_id);
 	acx_tx_data(adev, tx, skb->len, ctl, skb, queue_id);
 
 	adev->stats.tx_packets++;
 	adev->stats.tx_bytes += skb->len;
+	acx_ps_account_tx(adev);
 
 	return 0;
 }
@@ -173,6 +464,7 @@ void acx_stop_queue(struct ieee80211_hw *hw, const char *msg)
 {
 
 	ieee80211_stop_queues(hw);
+	trace_acx_queue_stop(hw->priv, msg);
 	if (msg)
 		log(L_BUFT, "tx: stop queue %s\n", msg);
 
@@ -187,21 +479,41 @@ void acx_wake_queue(struct ieee80211_hw *hw, const char *msg)
 {
 
 	ieee80211_wake_queues(hw);
+	trace_acx_queue_wake(hw->priv, msg);
 	if (msg)
 		log(L_BUFT, "tx: wake queue %s\n", msg);
 
+#if ACX_TXQ
+	/* mac80211 doesn't wake the txqs it saw while we were stopped */
+	ieee80211_queue_work(hw, &hw2adev(hw)->tx_work);
+#endif
 }
 
 
 /*
  * maps acx111 tx descr rate field to acx100 one
+ *
+ * Used by TNETW1450 USB, whose tx buffer only has the 8bit acx100 rate
+ * field. There is no acx100 code for OFDM, so those go out at the
+ * fastest CCK rate below and are reported back as such.
  */
-/*
-static u8 acx_rate111to100(u16 r)
+u8 acx_rate111to100(u16 r)
 {
-	return acx_bitpos2rate100[highest_bit(r)];
+	switch (1 << highest_bit(r & RATE111_ALL)) {
+	case RATE111_1:
+		return RATE100_1;
+	case RATE111_2:
+		return RATE100_2;
+	case RATE111_5:
+	case RATE111_6:
+	case RATE111_9:
+		return RATE100_5;
+	case RATE111_22:
+		return RATE100_22;
+	default:
+		return RATE100_11;
+	}
 }
-*/
 
 
 int acx_rate111_hwvalue_to_rateindex(u16 hw_value)
@@ -231,21 +543,17 @@ u16 acx_rate111_hwvalue_to_bitrate(u16 hw_value)
 
 
 
-u16 acx111_tx_build_rateset(acx_device_t *adev, txacxdesc_t *txdesc,
-			struct ieee80211_tx_info *info)
+/* Out of line, so the string buffer only hits the stack while
+ * L_BUFT logging is on */
+static noinline void acx111_tx_log_rateset(acx_device_t *adev,
+			struct ieee80211_tx_info *info, u16 rateset)
 {
 	int i;
 
 	char tmpstr[256];
 	struct ieee80211_rate *tmpbitrate;
-	int tmpcount;
 
-	u16 rateset = 0;
-
-	int debug = acx_debug & L_BUFT;
-
-	if (debug)
-		sprintf(tmpstr, "rates in info [bitrate,hw_value,count]: ");
+	sprintf(tmpstr, "rates in info [bitrate,hw_value,count]: ");
 
 	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
 		if (info->control.rates[i].idx < 0)
@@ -253,23 +561,61 @@ u16 acx111_tx_build_rateset(acx_device_t *adev, txacxdesc_t *txdesc,
 
 		tmpbitrate = &adev->hw->wiphy->bands[info->band]
 			->bitrates[info->control.rates[i].idx];
-		tmpcount = info->control.rates[i].count;
 
-		rateset |= tmpbitrate->hw_value;
+		sprintf(tmpstr + strlen(tmpstr), "%i=[%i,0x%04X,%i]%s",
+			i, tmpbitrate->bitrate, tmpbitrate->hw_value,
+			info->control.rates[i].count,
+			(i < IEEE80211_TX_MAX_RATES - 1)
+			? ", " : "");
+	}
+	logf1(L_ANY, "%s: rateset=0x%04X\n", tmpstr, rateset);
+}
+
+u16 acx111_tx_build_rateset(acx_device_t *adev, txacxdesc_t *txdesc,
+			struct ieee80211_tx_info *info)
+{
+	int i;
+	struct ieee80211_rate *bitrates;
+
+	u16 rateset = 0;
 
-		if (debug)
-			sprintf(tmpstr + strlen(tmpstr), "%i=[%i,0x%04X,%i]%s",
-				i, tmpbitrate->bitrate, tmpbitrate->hw_value,
-				tmpcount,
-				(i < IEEE80211_TX_MAX_RATES - 1)
-				? ", " : "");
+	bitrates = adev->hw->wiphy->bands[info->band]->bitrates;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		if (info->control.rates[i].idx < 0)
+			break;
+
+		rateset |= bitrates[info->control.rates[i].idx].hw_value;
 	}
-	if (debug)
-		logf1(L_ANY, "%s: rateset=0x%04X\n", tmpstr, rateset);
+	if (acx_debug_on(L_BUFT))
+		acx111_tx_log_rateset(adev, info, rateset);
 
 	return (rateset);
 }
 
+/*
+ * Accounts the attempts reported in info->status.rates[] and the final
+ * success per rate index, for the debugfs tx_rates table.
+ */
+void acx_tx_rate_stats_update(acx_device_t *adev,
+			struct ieee80211_tx_info *info)
+{
+	int i, idx = -1;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		if (info->status.rates[i].idx < 0)
+			break;
+		if (info->status.rates[i].idx >= ACX_TX_RATE_STATS_CNT
+		    || !info->status.rates[i].count)
+			continue;
+		idx = info->status.rates[i].idx;
+		adev->tx_rate_stats[idx].attempts +=
+			info->status.rates[i].count;
+	}
+	if (idx >= 0 && (info->flags & IEEE80211_TX_STAT_ACK))
+		adev->tx_rate_stats[idx].success++;
+}
+
 void acx111_tx_build_txstatus(acx_device_t *adev,
 			struct ieee80211_tx_info *txstatus, u16 r111,
 			u8 ack_failures)
@@ -289,7 +635,7 @@ void acx111_tx_build_txstatus(acx_device_t *adev,
 		}
 	}
 
-	if ((acx_debug & L_BUFT) && (ack_failures > 0)) {
+	if (acx_debug_on(L_BUFT) && (ack_failures > 0)) {
 
 		rate_bitrate = acx_rate111_hwvalue_to_bitrate(rate_hwvalue);
 		logf1(L_ANY,
@@ -341,7 +687,7 @@ void acxpcimem_handle_tx_error(acx_device_t *adev, u8 error,
 		    "too high or unable to Tx or Tx frame error - "
 		    "try changing 'iwconfig txpower XXX' or "
 		    "'sens'itivity or 'retry'";
-		log_level = acx_debug & L_DEBUG;
+		log_level = L_DEBUG;
 		/* adev->wstats.discard.retries++; */
 		/* Tx error 0x20 also seems to occur on
 		 * overheating, so I'm not sure whether we
@@ -443,9 +789,13 @@ void acxpcimem_handle_tx_error(acx_device_t *adev, u8 error,
  * 22Mbit, of course, is PBCC always.
  */
 
-/* maps acx100 tx descr rate field to acx111 one */
 /*
-static u16 rate100to111(u8 r)
+ * maps acx100 tx descr rate field to acx111 one
+ *
+ * Returns 0 for codes without acx111 equivalent, so the caller can
+ * fall back to the rate it asked for.
+ */
+u16 acx_rate100to111(u8 r)
 {
 	switch (r) {
 	case RATE100_1:
@@ -461,12 +811,31 @@ static u16 rate100to111(u8 r)
 	case RATE100_22:
 		return RATE111_22;
 	default:
-		pr_info("unexpected acx100 txrate: %u! "
-		       "Please report\n", r);
-		return RATE111_1;
+		log(L_BUFT, "unexpected acx100 txrate: %u\n", r);
+		return 0;
+	}
+}
+
+/* The acx100 rate code without the PBCC modulation bit, which only
+ * 5.5 and 11 Mbps have: RATE100_22 has that bit set in its value */
+u8 acx_rate100_plain(u8 r)
+{
+	switch (r) {
+	case RATE100_1:
+	case RATE100_2:
+	case RATE100_5:
+	case RATE100_11:
+	case RATE100_22:
+		return r;
+	case (RATE100_5 | RATE100_PBCC511):
+		return RATE100_5;
+	case (RATE100_11 | RATE100_PBCC511):
+		return RATE100_11;
+	default:
+		log(L_BUFT, "unexpected acx100 txrate: %u\n", r);
+		return 0;
 	}
 }
-*/
 
 void acx_tx_work(struct work_struct *work)
 {
@@ -486,6 +855,162 @@ void acx_tx_work(struct work_struct *work)
 }
 
 
+#if ACX_TXQ
+/* Queues txq for acx_tx_pull_txqs(), if it isn't yet */
+void acx_txq_wake(acx_device_t *adev, struct ieee80211_txq *txq)
+{
+	struct acx_txq *atxq = (struct acx_txq *) txq->drv_priv;
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->txq_lock, flags);
+	if (!atxq->queued) {
+		atxq->txq = txq;
+		atxq->queued = 1;
+		list_add_tail(&atxq->list, &adev->txq_list);
+	}
+	spin_unlock_irqrestore(&adev->txq_lock, flags);
+}
+
+/* Before mac80211 frees txq, with its station or vif */
+void acx_txq_remove(acx_device_t *adev, struct ieee80211_txq *txq)
+{
+	struct acx_txq *atxq;
+	unsigned long flags;
+
+	if (!txq)
+		return;
+
+	atxq = (struct acx_txq *) txq->drv_priv;
+	spin_lock_irqsave(&adev->txq_lock, flags);
+	if (atxq->queued) {
+		list_del(&atxq->list);
+		atxq->queued = 0;
+	}
+	spin_unlock_irqrestore(&adev->txq_lock, flags);
+}
+
+static struct acx_txq *acx_txq_next(acx_device_t *adev)
+{
+	struct acx_txq *atxq = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->txq_lock, flags);
+	if (!list_empty(&adev->txq_list)) {
+		atxq = list_first_entry(&adev->txq_list, struct acx_txq, list);
+		list_del(&atxq->list);
+		atxq->queued = 0;
+	}
+	spin_unlock_irqrestore(&adev->txq_lock, flags);
+
+	return atxq;
+}
+
+/* Puts atxq back, at the tail for the others' turn, or at the head
+ * when it was interrupted by a full ring */
+static void acx_txq_requeue(acx_device_t *adev, struct acx_txq *atxq,
+			int head)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->txq_lock, flags);
+	if (!atxq->queued) {
+		atxq->queued = 1;
+		if (head)
+			list_add(&atxq->list, &adev->txq_list);
+		else
+			list_add_tail(&atxq->list, &adev->txq_list);
+	}
+	spin_unlock_irqrestore(&adev->txq_lock, flags);
+}
+
+/*
+ * acx_tx_pull_txqs
+ *
+ * Pulls the frames of the queued txqs, ACX_TXQ_QUANTUM at a time from
+ * each, as long as we have tx descs.  A txq found empty stays off the
+ * list until mac80211 wakes it again.  Nothing is pulled while the
+ * queues are stopped, for a full ring, the dql limit or a channel
+ * switch: acx_wake_queue() brings us back.  Returns < 0 when the ring
+ * is full.
+ *
+ * mac80211 wants the dequeue with BHs off, and the frame's key (read
+ * by acx_tx_frame()) only lives under rcu: both are held until the
+ * frame is on the ring.
+ */
+static int acx_tx_pull_txqs(acx_device_t *adev)
+{
+	struct acx_txq *atxq;
+	struct sk_buff *skb;
+	int n, ret;
+
+	while (!acx_queue_stopped(adev->hw)
+	       && (atxq = acx_txq_next(adev))) {
+		for (n = 0; n < ACX_TXQ_QUANTUM; n++) {
+			if (acx_is_hw_tx_queue_stop_limit(adev)) {
+				acx_stop_queue(adev->hw, NULL);
+				acx_txq_requeue(adev, atxq, 1);
+				return -EBUSY;
+			}
+
+			local_bh_disable();
+			rcu_read_lock();
+			skb = ieee80211_tx_dequeue(adev->hw, atxq->txq);
+			if (!skb) {
+				rcu_read_unlock();
+				local_bh_enable();
+				break;
+			}
+			acx_sta_tx(adev, atxq->txq->sta, skb);
+
+			ret = acx_tx_frame(adev, skb);
+			if (ret == -EBUSY) {
+				/* first out next time */
+				acx_stop_queue(adev->hw, NULL);
+				skb_queue_head(&adev->tx_queue, skb);
+				acx_txq_requeue(adev, atxq, 1);
+			} else if (ret < 0) {
+				acx_stop_queue(adev->hw, NULL);
+				ieee80211_free_txskb(adev->hw, skb);
+			}
+			rcu_read_unlock();
+			local_bh_enable();
+			if (ret < 0)
+				return ret;
+		}
+
+		if (n == ACX_TXQ_QUANTUM)
+			acx_txq_requeue(adev, atxq, 0);
+	}
+
+	return 0;
+}
+#endif
+
+void acx_txq_remove_sta(acx_device_t *adev, struct ieee80211_sta *sta)
+{
+#if ACX_TXQ
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sta->txq); i++)
+		acx_txq_remove(adev, sta->txq[i]);
+#endif
+}
+
+/* Forgets the queued txqs, when going down: mac80211 drops their
+ * frames itself */
+void acx_txq_reset(acx_device_t *adev)
+{
+	struct acx_txq *atxq, *tmp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&adev->txq_lock, flags);
+	list_for_each_entry_safe(atxq, tmp, &adev->txq_list, list) {
+		list_del(&atxq->list);
+		atxq->queued = 0;
+	}
+	spin_unlock_irqrestore(&adev->txq_lock, flags);
+}
+
 void acx_tx_queue_go(acx_device_t *adev)
 {
 	struct sk_buff *skb;
@@ -517,6 +1042,10 @@ void acx_tx_queue_go(acx_device_t *adev)
 			goto out;
 		}
 	}
+
+#if ACX_TXQ
+	acx_tx_pull_txqs(adev);
+#endif
 out:
 	return;
 }
@@ -1,16 +1,23 @@
 #ifndef _ACX_TX_H_
 #define _ACX_TX_H_
 
+struct seq_file;
+
 void acx_tx_queue_flush(acx_device_t *adev);
 void acx_stop_queue(struct ieee80211_hw *hw, const char *msg);
 int acx_queue_stopped(struct ieee80211_hw *ieee);
 void acx_wake_queue(struct ieee80211_hw *hw, const char *msg);
 
+u16 acx_rate100to111(u8 r);
+u8 acx_rate100_plain(u8 r);
+u8 acx_rate111to100(u16 r);
 int acx_rate111_hwvalue_to_rateindex(u16 hw_value);
 u16 acx_rate111_hwvalue_to_bitrate(u16 hw_value);
 u16 acx111_tx_build_rateset(acx_device_t *adev, txacxdesc_t *txdesc,
 			struct ieee80211_tx_info *info);
 
+void acx_tx_rate_stats_update(acx_device_t *adev,
+			struct ieee80211_tx_info *info);
 void acx111_tx_build_txstatus(acx_device_t *adev,
 			struct ieee80211_tx_info *txstatus, u16 r111,
 			u8 ack_failures);
@@ -18,7 +25,22 @@ void acxpcimem_handle_tx_error(acx_device_t *adev, u8 error,
 			unsigned int finger,
 			struct ieee80211_tx_info *info);
 
+void acx_tx_dql_reset(acx_device_t *adev, int ring);
+int acx_tx_dql_full(acx_device_t *adev, int ring);
+void acx_tx_dql_completed(acx_device_t *adev, int ring, struct sk_buff *skb);
+void acx_tx_dql_update(acx_device_t *adev, int ring);
+int acx_tx_dql_dbgfs_output(struct seq_file *file, acx_device_t *adev);
+void acx_tx_status_report(acx_device_t *adev, struct sk_buff_head *done);
+
+int acx_tx_frame(acx_device_t *adev, struct sk_buff *skb);
 void acx_tx_work(struct work_struct *work);
 void acx_tx_queue_go(acx_device_t *adev);
 
+#if ACX_TXQ
+void acx_txq_wake(acx_device_t *adev, struct ieee80211_txq *txq);
+void acx_txq_remove(acx_device_t *adev, struct ieee80211_txq *txq);
+#endif
+void acx_txq_remove_sta(acx_device_t *adev, struct ieee80211_sta *sta);
+void acx_txq_reset(acx_device_t *adev);
+
 #endif
@@ -48,6 +48,7 @@
 #include <linux/ethtool.h>
 #include <linux/workqueue.h>
 #include <linux/nl80211.h>
+#include <linux/seq_file.h>
 
 #include <net/iw_handler.h>
 #include <net/mac80211.h>
@@ -63,7 +64,11 @@
 #include "rx.h"
 #include "tx.h"
 #include "main.h"
+#include "survey.h"
 #include "boot.h"
+#include "trace.h"
+#include "sta.h"
+#include "key.h"
 
 /* OW, 20091205, TODO, Info on TNETW1450 support:
  * Firmware loads, device shows activity, however RX and TX paths are broken.
@@ -499,6 +504,182 @@ acxusb_boot(struct usb_device *usbdev, int is_tnetw1450, int *radio_type)
  * ==================================================
  */
 
+/*
+ * Commands which don't return data are posted when the caller said it
+ * won't look at the result (adev->cmd_post): the OUT stage is
+ * submitted and we return without reading back the mailbox status, so
+ * a firmware error goes unnoticed.  Anything whose result matters, a
+ * fallback on an unsupported IE for example, stays synchronous.
+ * Control transfers on ep0 are processed in submission order, so a
+ * following command can't overtake them.
+ */
+static int acxusb_cmd_is_posted(acx_device_t *adev, unsigned cmd)
+{
+	if (!adev->cmd_post)
+		return 0;
+
+	return cmd == acx_cmd_descs[ACX1xx_CMD_CONFIGURE].val
+		|| cmd == acx_cmd_descs[ACX1xx_CMD_CONFIG_TIM].val
+		|| cmd == acx_cmd_descs[ACX1xx_CMD_CONFIG_BEACON].val
+		|| cmd == acx_cmd_descs[ACX1xx_CMD_CONFIG_PROBE_RESPONSE].val
+		|| cmd == acx_cmd_descs[ACX1xx_CMD_CONFIG_NULL_DATA].val
+		|| cmd == acx_cmd_descs[ACX1xx_CMD_CONFIG_PROBE_REQUEST].val;
+}
+
+static void acxusb_cmd_account(acx_device_t *adev, usb_cmd_t *uc, int err)
+{
+	usb_cmd_stat_t *st;
+	unsigned long flags;
+	u32 us;
+
+	if (uc->cmd >= ACX_USB_CMD_STAT_CNT)
+		return;
+
+	us = (u32) ktime_to_us(ktime_sub(ktime_get(), uc->start));
+	st = &adev->usb_cmd_stats[uc->cmd];
+
+	spin_lock_irqsave(&adev->spinlock, flags);
+	st->cmdstr = uc->cmdstr;
+	st->count++;
+	if (uc->posted)
+		st->posted++;
+	if (err)
+		st->errors++;
+	st->last_us = us;
+	if (us > st->max_us)
+		st->max_us = us;
+	st->total_us += us;
+	spin_unlock_irqrestore(&adev->spinlock, flags);
+}
+
+static void acxusb_complete_cmd(struct urb *urb)
+{
+	usb_cmd_t *uc = urb->context;
+
+	if (uc->posted) {
+		acxusb_cmd_account(uc->adev, uc, urb->status);
+		if (urb->status && urb->status != -ENOENT
+		    && urb->status != -ENODEV)
+			pr_acx("posted cmd %s failed: %d\n",
+				uc->cmdstr, urb->status);
+		uc->busy = 0;
+	}
+	complete(&uc->done);
+}
+
+static int acxusb_submit_cmd(acx_device_t *adev, usb_cmd_t *uc,
+			void *data, int len, int dir_in)
+{
+	struct usb_device *usbdev = adev->usbdev;
+
+	uc->setup.bRequestType = USB_TYPE_VENDOR
+		| (dir_in ? USB_DIR_IN : USB_DIR_OUT);
+	uc->setup.bRequest = ACX_USB_REQ_CMD;
+	uc->setup.wValue = 0;
+	uc->setup.wIndex = 0;
+	uc->setup.wLength = cpu_to_le16(len);
+
+	usb_fill_control_urb(uc->urb, usbdev,
+			dir_in ? usb_rcvctrlpipe(usbdev, 0)
+				: usb_sndctrlpipe(usbdev, 0),
+			(unsigned char *) &uc->setup, data, len,
+			acxusb_complete_cmd, uc);
+	init_completion(&uc->done);
+
+	return usb_submit_urb(uc->urb, GFP_KERNEL);
+}
+
+/* Returns bytes transferred or negative error */
+static int acxusb_wait_cmd(usb_cmd_t *uc)
+{
+	if (!wait_for_completion_timeout(&uc->done,
+			msecs_to_jiffies(ACX_USB_CTRL_TIMEOUT))) {
+		usb_kill_urb(uc->urb);
+		return -ETIMEDOUT;
+	}
+	if (uc->urb->status)
+		return uc->urb->status;
+
+	return uc->urb->actual_length;
+}
+
+/* Next pool entry, waiting for a posted command still using it */
+static usb_cmd_t *acxusb_get_cmd(acx_device_t *adev)
+{
+	usb_cmd_t *uc = &adev->usb_cmd[adev->usb_cmd_next];
+
+	adev->usb_cmd_next = (adev->usb_cmd_next + 1) % ACX_USB_CMD_CNT;
+
+	if (uc->busy && acxusb_wait_cmd(uc) == -ETIMEDOUT)
+		pr_acx("posted cmd %s timed out\n", uc->cmdstr);
+	uc->busy = 0;
+
+	return uc;
+}
+
+/*
+ * acxusb_flush_cmd
+ *
+ * Waits until all posted commands have completed.
+ */
+static void acxusb_flush_cmd(acx_device_t *adev)
+{
+	int i;
+
+	if (!adev->usb_cmd)
+		return;
+
+	for (i = 0; i < ACX_USB_CMD_CNT; i++) {
+		usb_cmd_t *uc = &adev->usb_cmd[i];
+
+		if (uc->busy && acxusb_wait_cmd(uc) == -ETIMEDOUT)
+			pr_acx("posted cmd %s timed out\n", uc->cmdstr);
+		uc->busy = 0;
+	}
+}
+
+static void acxusb_free_cmd(acx_device_t *adev)
+{
+	int i;
+
+	if (!adev->usb_cmd)
+		return;
+
+	for (i = 0; i < ACX_USB_CMD_CNT; i++) {
+		usb_kill_urb(adev->usb_cmd[i].urb);
+		usb_free_urb(adev->usb_cmd[i].urb);
+		kfree(adev->usb_cmd[i].buf);
+	}
+	kfree(adev->usb_cmd);
+	adev->usb_cmd = NULL;
+}
+
+static int acxusb_alloc_cmd(acx_device_t *adev)
+{
+	int i;
+
+	adev->usb_cmd = kzalloc(sizeof(usb_cmd_t) * ACX_USB_CMD_CNT,
+				GFP_KERNEL);
+	if (!adev->usb_cmd)
+		return -ENOMEM;
+
+	for (i = 0; i < ACX_USB_CMD_CNT; i++) {
+		usb_cmd_t *uc = &adev->usb_cmd[i];
+
+		uc->adev = adev;
+		uc->urb = usb_alloc_urb(0, GFP_KERNEL);
+		uc->buf = kmalloc(ACX_USB_CMD_BUFSIZE, GFP_KERNEL);
+		init_completion(&uc->done);
+		if (!uc->urb || !uc->buf) {
+			acxusb_free_cmd(adev);
+			return -ENOMEM;
+		}
+	}
+	adev->usb_cmd_next = 0;
+
+	return 0;
+}
+
 /*
  * acxusb_issue_cmd_timeo_debug
  * Excecutes a command in the command mailbox
@@ -520,16 +701,17 @@ acxusb_issue_cmd_timeo_debug(acx_device_t * adev,
 
 	/* USB ignores timeout param */
 
-	struct usb_device *usbdev;
 	struct {
 		u16 cmd;
 		u16 status;
 		u8 data[1];
 	} ACX_PACKED *loc;
+	usb_cmd_t *uc;
 	const char *devname;
-	int acklen, blocklen, inpipe, outpipe;
+	int acklen, blocklen;
 	int cmd_status;
 	int result;
+	u8 *bigbuf = NULL;
 
 
 
@@ -542,15 +724,28 @@ acxusb_issue_cmd_timeo_debug(acx_device_t * adev,
 	    cmdstr, buflen,
 	    buffer ? le16_to_cpu(((acx_ie_generic_t *) buffer)->type) : -1);
 
-	loc = kmalloc(buflen + 4 + BOGUS_SAFETY_PADDING, GFP_KERNEL);
-	if (!loc) {
-		pr_acx("%s: no memory for data buffer\n", devname);
-		goto bad;
+	/* Anything waiting for an answer needs the posted ones done
+	 * first, so errors are reported in order */
+	if (!acxusb_cmd_is_posted(adev, cmd))
+		acxusb_flush_cmd(adev);
+
+	uc = acxusb_get_cmd(adev);
+	uc->cmd = cmd;
+	uc->cmdstr = cmdstr;
+	uc->posted = 0;
+	uc->start = ktime_get();
+
+	loc = (void *) uc->buf;
+	if (buflen + 4 + BOGUS_SAFETY_PADDING > ACX_USB_CMD_BUFSIZE) {
+		/* rare, e.g. big interrogates: don't size the pool for it */
+		bigbuf = kmalloc(buflen + 4 + BOGUS_SAFETY_PADDING, GFP_KERNEL);
+		if (!bigbuf) {
+			pr_acx("%s: no memory for data buffer\n", devname);
+			goto bad;
+		}
+		loc = (void *) bigbuf;
 	}
 
-	/* get context from acx_device */
-	usbdev = adev->usbdev;
-
 	/* check which kind of command was issued */
 	loc->cmd = cpu_to_le16(cmd);
 	loc->status = 0;
@@ -579,22 +774,23 @@ acxusb_issue_cmd_timeo_debug(acx_device_t * adev,
 	}
 	blocklen += 4;		/* account for cmd,status */
 
-	/* obtain the I/O pipes */
-	outpipe = usb_sndctrlpipe(usbdev, 0);
-	inpipe = usb_rcvctrlpipe(usbdev, 0);
-	log(L_CTL, "trl inpipe=0x%X outpipe=0x%X\n", inpipe, outpipe);
 	log(L_CTL, "sending USB control msg (out) (blocklen=%d)\n", blocklen);
-	if (acx_debug & L_DATA)
+	if (acx_debug_on(L_DATA))
 		acx_dump_bytes(loc, blocklen);
 
-	result = usb_control_msg(usbdev, outpipe, ACX_USB_REQ_CMD,	/* request */
-				 USB_TYPE_VENDOR | USB_DIR_OUT,	/* requesttype */
-				 0,	/* value */
-				 0,	/* index */
-				 loc,	/* dataptr */
-				 blocklen,	/* size */
-				 ACX_USB_CTRL_TIMEOUT	/* timeout in ms */
-	    );
+	if (acxusb_cmd_is_posted(adev, cmd) && !bigbuf) {
+		uc->posted = 1;
+		uc->busy = 1;
+		result = acxusb_submit_cmd(adev, uc, loc, blocklen, 0);
+		if (result == 0)
+			return OK;
+		uc->busy = 0;
+		uc->posted = 0;
+	} else {
+		result = acxusb_submit_cmd(adev, uc, loc, blocklen, 0);
+		if (result == 0)
+			result = acxusb_wait_cmd(uc);
+	}
 
 	if (result == -ENODEV) {
 		log(L_CTL, "no device present (unplug?)\n");
@@ -610,19 +806,14 @@ acxusb_issue_cmd_timeo_debug(acx_device_t * adev,
 	log(L_CTL, "sending USB control msg (in) (acklen=%d)\n", acklen);
 	loc->status = 0;	/* delete old status flag -> set to IDLE */
 	/* shall we zero out the rest? */
-	result = usb_control_msg(usbdev, inpipe, ACX_USB_REQ_CMD,	/* request */
-				 USB_TYPE_VENDOR | USB_DIR_IN,	/* requesttype */
-				 0,	/* value */
-				 0,	/* index */
-				 loc,	/* dataptr */
-				 acklen,	/* size */
-				 ACX_USB_CTRL_TIMEOUT	/* timeout in ms */
-	    );
+	result = acxusb_submit_cmd(adev, uc, loc, acklen, 1);
+	if (result == 0)
+		result = acxusb_wait_cmd(uc);
 	if (result < 0) {
 		pr_acx("%s: USB read error %d\n", devname, result);
 		goto bad;
 	}
-	if (acx_debug & L_CTL) {
+	if (acx_debug_on(L_CTL)) {
 		pr_acx("read %d bytes: ", result);
 		acx_dump_bytes(loc, result);
 	}
@@ -654,7 +845,8 @@ acxusb_issue_cmd_timeo_debug(acx_device_t * adev,
 	}
 
   good:
-	kfree(loc);
+	acxusb_cmd_account(adev, uc, 0);
+	kfree(bigbuf);
 
 	return OK;
 
@@ -663,7 +855,8 @@ acxusb_issue_cmd_timeo_debug(acx_device_t * adev,
 	 ** printing their own diagnostic messages */
 
 	//dump_stack();
-	kfree(loc);
+	acxusb_cmd_account(adev, uc, 1);
+	kfree(bigbuf);
 
 	return NOT_OK;
 }
@@ -705,6 +898,31 @@ static int acxusb_fill_configoption(acx_device_t * adev)
  * ==================================================
  */
 
+int acxusb_dbgfs_cmd_output(struct seq_file *file, acx_device_t *adev)
+{
+	usb_cmd_stat_t st;
+	unsigned long flags;
+	int i;
+
+	seq_printf(file, "%-34s %8s %8s %6s %8s %8s %8s\n",
+		"cmd", "count", "posted", "errors",
+		"avg_us", "max_us", "last_us");
+
+	for (i = 0; i < ACX_USB_CMD_STAT_CNT; i++) {
+		spin_lock_irqsave(&adev->spinlock, flags);
+		st = adev->usb_cmd_stats[i];
+		spin_unlock_irqrestore(&adev->spinlock, flags);
+
+		if (!st.count)
+			continue;
+		seq_printf(file, "%-34s %8u %8u %6u %8u %8u %8u\n",
+			st.cmdstr, st.count, st.posted, st.errors,
+			(u32) div_u64(st.total_us, st.count),
+			st.max_us, st.last_us);
+	}
+	return 0;
+}
+
 // OW TODO Could perhaps go into the proc-debug info for usb ?
 #if ACX_DEBUG
 
@@ -827,6 +1045,64 @@ static void dump_device_descriptor(struct usb_device_descriptor *dd)
  * USB receive is triggered.
  */
 static void acxusb_poll_rx(acx_device_t * adev, usb_rx_t * rx);
+
+/*
+ * acxusb_tx_build_txstatus
+ *
+ * The firmware reports the acx100 rate code the frame finally went out
+ * at, and its retries at that rate. Map this back onto the rate table,
+ * so rate control sees the rate actually used. r111 is the rate we
+ * asked for (TNETW1450 only), used when the reported code has no
+ * acx111 equivalent.
+ */
+static void acxusb_tx_build_txstatus(acx_device_t *adev,
+				struct ieee80211_tx_info *info,
+				usb_txstatus_t *stat, u16 r111)
+{
+	struct ieee80211_supported_band *sband;
+	u16 hw_value;
+	int i, idx = -1;
+
+	/* 0x10: excessive RTS failures, 0x20: excessive retries */
+	if (!(info->flags & IEEE80211_TX_CTL_NO_ACK)
+	    && !(stat->mac_status & 0x30))
+		info->flags |= IEEE80211_TX_STAT_ACK;
+
+	if (IS_ACX111(adev)) {
+		hw_value = acx_rate100to111(stat->rate);
+		if (!hw_value)
+			hw_value = r111;
+	} else
+		hw_value = acx_rate100_plain(stat->rate);
+
+	sband = adev->hw->wiphy->bands[info->band];
+	for (i = 0; i < sband->n_bitrates; i++) {
+		if (sband->bitrates[i].hw_value == hw_value) {
+			idx = i;
+			break;
+		}
+	}
+
+	/* Only one rate per tx buffer: report it as the first and only
+	 * entry, keeping the flags mac80211 set for it */
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		if (info->status.rates[i].idx < 0)
+			break;
+		if (info->status.rates[i].idx == idx) {
+			info->status.rates[0] = info->status.rates[i];
+			break;
+		}
+	}
+	if (idx >= 0)
+		info->status.rates[0].idx = idx;
+	info->status.rates[0].count = stat->ack_failures + 1;
+	for (i = 1; i < IEEE80211_TX_MAX_RATES; i++)
+		info->status.rates[i].idx = -1;
+
+	log(L_BUFT, "tx status: rate %u (idx %d) !ACK=%u mac_status=%02X\n",
+		stat->rate, idx, stat->ack_failures, stat->mac_status);
+}
+
 static void acxusb_complete_rx(struct urb *urb)
 {
 	acx_device_t *adev;
@@ -913,7 +1189,7 @@ static void acxusb_complete_rx(struct urb *urb)
 		ptr = &adev->rxtruncbuf;
 		packetsize = RXBUF_BYTES_USED(ptr);
 
-		if (acx_debug & (L_USBRXTX)) {
+		if (acx_debug_on(L_USBRXTX)) {
 			pr_acx("handling truncated frame (truncsize=%d, size=%d, "
 			       "packetsize(from trunc)=%d)\n",
 			       adev->rxtruncsize, size, packetsize);
@@ -944,7 +1220,7 @@ static void acxusb_complete_rx(struct urb *urb)
 			memcpy(((char *)ptr) + adev->rxtruncsize, inbuf,
 			       tail_size);
 
-			if (acx_debug & (L_USBRXTX)) {
+			if (acx_debug_on(L_USBRXTX)) {
 				pr_acxusb("full trailing packet + 12 bytes:\n");
 				acx_dump_bytes(inbuf, tail_size + RXBUF_HDRSIZE);
 			}
@@ -953,7 +1229,7 @@ static void acxusb_complete_rx(struct urb *urb)
 			ptr = (rxbuffer_t *) (((char *)inbuf) + tail_size);
 			remsize -= tail_size;
 		}
-		if (acx_debug & (L_USBRXTX))
+		if (acx_debug_on(L_USBRXTX))
 				pr_acxusb("post-merge size=%d remsize=%d\n", size, remsize);
 	}
 
@@ -976,10 +1252,8 @@ static void acxusb_complete_rx(struct urb *urb)
 			"acxusb: packet with packetsize=%d\n", packetsize);
 
 		if (RXBUF_IS_TXSTAT(ptr)) {
-
-			/* do rate handling */
-			// OW TODO rate handling done by mac80211
 			usb_txstatus_t *stat = (void *)ptr;
+			u32 hostdata = le32_to_cpu(stat->hostdata);
 
 			log(L_USBRXTX,
 					"acx: tx: stat: mac_cnt_rcvd:%04X "
@@ -987,31 +1261,45 @@ static void acxusb_complete_rx(struct urb *urb)
 					"hostdata:%08X rate:%u ack_failures:%02X "
 					"rts_failures:%02X rts_ok:%02X\n",
 					stat->mac_cnt_rcvd, stat->queue_index,
-					stat->mac_status, stat->hostdata, stat->rate,
+					stat->mac_status, hostdata, stat->rate,
 					stat->ack_failures, stat->rts_failures,
 					stat->rts_ok);
 
-            tx = (usb_tx_t*) (adev->usb_tx + stat->hostdata);
-            skb = tx->skb;
-		txstatus = IEEE80211_SKB_CB(skb);
-
-            if (!(txstatus->flags & IEEE80211_TX_CTL_NO_ACK))
-			txstatus->flags |= IEEE80211_TX_STAT_ACK;
-
-		txstatus->status.rates[0].count = stat->ack_failures + 1;
+			if (unlikely((hostdata & 0xffff) >= ACX_TX_URB_CNT)) {
+				pr_acxusb("tx status for bogus urb %u\n",
+					hostdata & 0xffff);
+				goto next;
+			}
 
-		// report upstream
-		ieee80211_tx_status(adev->hw, skb);
+			tx = adev->usb_tx + (hostdata & 0xffff);
+			skb = tx->skb;
+			txstatus = IEEE80211_SKB_CB(skb);
 
-		tx->busy = 0;
-		adev->hw_tx_queue[0].free++;
+			acxusb_tx_build_txstatus(adev, txstatus, stat,
+						hostdata >> 16);
+			acx_tx_rate_stats_update(adev, txstatus);
+			acx_sta_tx_status(adev, skb);
+			acx_tx_dql_completed(adev, 0, skb);
+			trace_acx_tx_complete(adev, skb, stat->mac_status,
+					stat->ack_failures, stat->rts_failures,
+					stat->rts_ok);
 
-		if ((adev->hw_tx_queue[0].free >= TX_START_QUEUE) && acx_queue_stopped(adev->hw)) {
-			log(L_BUF, "tx: wake queue (avail. Tx desc %u)\n",
-				adev->hw_tx_queue[0].free);
-			acx_wake_queue(adev->hw, NULL);
-			ieee80211_queue_work(adev->hw, &adev->tx_work);
-		}
+			// report upstream
+			ieee80211_tx_status(adev->hw, skb);
+
+			tx->busy = 0;
+			adev->hw_tx_queue[0].free++;
+			acx_tx_dql_update(adev, 0);
+
+			if ((adev->hw_tx_queue[0].free >= TX_START_QUEUE)
+			    && !acx_tx_dql_full(adev, 0)
+			    && acx_queue_stopped(adev->hw)
+			    && !adev->chan_switch.csa_block_tx) {
+				log(L_BUF, "tx: wake queue (avail. Tx desc %u)\n",
+					adev->hw_tx_queue[0].free);
+				acx_wake_queue(adev->hw, NULL);
+				ieee80211_queue_work(adev->hw, &adev->tx_work);
+			}
 
 			goto next;
 		}
@@ -1028,7 +1316,7 @@ static void acxusb_complete_rx(struct urb *urb)
 
 		if (packetsize > remsize) {
 			/* frame truncation handling */
-			if (acx_debug & (L_USBRXTX)) {
+			if (acx_debug_on(L_USBRXTX)) {
 				pr_acxusb("need to truncate packet, "
 				       "packetsize=%d remsize=%d "
 				       "size=%d bytes:",
@@ -1047,7 +1335,7 @@ static void acxusb_complete_rx(struct urb *urb)
 		next:
 		ptr = (rxbuffer_t *) (((char *)ptr) + packetsize);
 		remsize -= packetsize;
-		if ((acx_debug & (L_USBRXTX)) && remsize) {
+		if (acx_debug_on(L_USBRXTX) && remsize) {
 			pr_acx("more than one packet in buffer, "
 			       "second packet hdr:");
 			acx_dump_bytes(ptr, RXBUF_HDRSIZE);
@@ -1233,7 +1521,7 @@ void acxusb_tx_data(acx_device_t *adev, tx_t *tx_opaque, int wlanpkt_len,
 	// FIXME Cleanup ?: struct ieee80211_hdr *whdr;
 	unsigned int outpipe;
 	int ucode, txnum;
-	u8 rate_100;
+	struct ieee80211_rate *rate;
 
 
 
@@ -1254,11 +1542,17 @@ void acxusb_tx_data(acx_device_t *adev, tx_t *tx_opaque, int wlanpkt_len,
 	txbuf->mpdu_len = cpu_to_le16(wlanpkt_len);
 	txbuf->queue_index = 1;
 
-	// FIXME OW 20100619 acx111 handling missing here
-	rate_100 = ieee80211_get_tx_rate(adev->hw, ieeectl)->bitrate;
-	txbuf->rate = rate_100 ;
-
-	txbuf->hostdata = (u32) txnum;
+	/* The tx buffer only has the 8bit acx100 rate code, also on
+	 * TNETW1450. Keep the rate111 we were asked for in the upper
+	 * half of hostdata, the tx status echoes it back. */
+	rate = ieee80211_get_tx_rate(adev->hw, ieeectl);
+	if (IS_ACX111(adev)) {
+		txbuf->rate = acx_rate111to100(rate->hw_value);
+		txbuf->hostdata = cpu_to_le32(txnum | (rate->hw_value << 16));
+	} else {
+		txbuf->rate = (u8) rate->hw_value;
+		txbuf->hostdata = cpu_to_le32(txnum);
+	}
 
 	txbuf->ctrl1 = DESC_CTL_FIRSTFRAG;
 	if (1 == adev->preamble_cur)
@@ -1266,7 +1560,7 @@ void acxusb_tx_data(acx_device_t *adev, tx_t *tx_opaque, int wlanpkt_len,
 	txbuf->ctrl2 = 0;
 	txbuf->data_len = cpu_to_le16(wlanpkt_len);
 
-	if (unlikely(acx_debug & L_DATA)) {
+	if (unlikely(acx_debug_on(L_DATA))) {
 		pr_acx("dump of bulk out urb:\n");
 		acx_dump_bytes(txbuf, wlanpkt_len + USB_TXBUF_HDRSIZE);
 	}
@@ -1420,12 +1714,15 @@ static int acxusb_op_start(struct ieee80211_hw *hw)
 		adev->usb_tx[i].busy = 0;
 	}
 	adev->hw_tx_queue[0].free = ACX_TX_URB_CNT;
+	acx_tx_dql_reset(adev, 0);
 
 	/* put the ACX100 out of sleep mode */
 	acx_issue_cmd(adev, ACX1xx_CMD_WAKE, NULL, 0);
 
-	/* acx_start needs it */
+	/* acx_start needs it. Part of the configure burst is posted,
+	 * wait for it before enabling rx */
 	acx_update_settings(adev);
+	acxusb_flush_cmd(adev);
 
 	acxusb_poll_rx(adev, &adev->usb_rx[0]);
 
@@ -1464,10 +1761,14 @@ static void acxusb_op_stop(struct ieee80211_hw *hw)
 
 	/* Power down the device */
 	acx_issue_cmd(adev, ACX1xx_CMD_SLEEP, NULL, 0);
+	acxusb_flush_cmd(adev);
 
 	acx_sem_unlock(adev);
 	cancel_work_sync(&adev->irq_work);
 	cancel_work_sync(&adev->tx_work);
+	cancel_delayed_work_sync(&adev->tim_work);
+	cancel_delayed_work_sync(&adev->scan_work);
+	cancel_delayed_work_sync(&adev->chan_switch_work);
 	acx_sem_lock(adev);
 
 	acx_tx_queue_flush(adev);
@@ -1483,8 +1784,15 @@ static void acxusb_op_stop(struct ieee80211_hw *hw)
 		adev->usb_rx[i].busy = 0;
 	}
 	adev->hw_tx_queue[0].free = ACX_TX_URB_CNT;
+	acx_tx_dql_reset(adev, 0);
 
 	adev->channel = 1;
+	adev->chan_switch.tx_chan = adev->chan_switch.rx_chan = 0;
+	/* a pending switch went with chan_switch_work */
+	adev->chan_switch.csa_block_tx = 0;
+	acx_sta_reset(adev);
+	acx_key_reset(adev);
+	acx_txq_reset(adev);
 
 	log(L_INIT, "acxusb: closed device\n");
 
@@ -1495,18 +1803,35 @@ static void acxusb_op_stop(struct ieee80211_hw *hw)
 
 static const struct ieee80211_ops acxusb_hw_ops = {
 	.tx = acx_op_tx,
+#if ACX_TXQ
+	.wake_tx_queue = acx_op_wake_tx_queue,
+#endif
 	.conf_tx = acx_conf_tx,
 	.add_interface = acx_op_add_interface,
 	.remove_interface = acx_op_remove_interface,
 	.start = acxusb_op_start,
+	.prepare_multicast = acx_op_prepare_multicast,
 	.configure_filter = acx_op_configure_filter,
 	.stop = acxusb_op_stop,
 	.config = acx_op_config,
 	.bss_info_changed = acx_op_bss_info_changed,
 	.set_key = acx_op_set_key,
 	.get_stats = acx_op_get_stats,
+	.set_frag_threshold = acx_op_set_frag_threshold,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(3, 0, 0)
+	.get_survey = acx_op_get_survey,
+#endif
 #if CONFIG_ACX_MAC80211_VERSION < KERNEL_VERSION(2, 6, 34)
 	.get_tx_stats = acx_e_op_get_tx_stats,
+#endif
+	.set_tim = acx_op_set_tim,
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 37)
+	.channel_switch = acx_op_channel_switch,
+#endif
+#if CONFIG_ACX_MAC80211_VERSION >= KERNEL_VERSION(2, 6, 34)
+	.sta_add = acx_op_sta_add,
+	.sta_remove = acx_op_sta_remove,
+	.sta_notify = acx_op_sta_notify,
 #endif
 };
 
@@ -1711,6 +2036,12 @@ acxusb_probe(struct usb_interface *intf, const struct usb_device_id *devID)
 		adev->usb_tx[i].busy = 0;
 	}
 	adev->hw_tx_queue[0].free = ACX_TX_URB_CNT;
+	acx_tx_dql_reset(adev, 0);
+
+	if (acxusb_alloc_cmd(adev)) {
+		msg = "acx: no memory for cmd URBs\n";
+		goto end_nomem;
+	}
 
 	/* TODO: move all of fw cmds to open()? But then we won't know our MAC addr
 	   until ifup (it's available via reading ACX1xx_IE_DOT11_STATION_ID)... */
@@ -1736,7 +2067,11 @@ acxusb_probe(struct usb_interface *intf, const struct usb_device_id *devID)
 	acx_debugfs_add_adev(adev);
 
 	/* Init ieee80211_hw  */
-	acx_init_ieee80211(adev, hw);
+	if (acx_init_ieee80211(adev, hw)) {
+		msg = "acx: failed to init the ieee80211 hw (error %d)\n";
+		result = -EIO;
+		goto end_nomem;
+	}
 	hw->wiphy->interface_modes = BIT(NL80211_IFTYPE_STATION)
 	        | BIT(NL80211_IFTYPE_ADHOC);
 
@@ -1770,7 +2105,8 @@ acxusb_probe(struct usb_interface *intf, const struct usb_device_id *devID)
 				usb_free_urb(adev->usb_tx[i].urb);
 			kfree(adev->usb_tx);
 		}
-		ieee80211_free_hw(hw);
+		acxusb_free_cmd(adev);
+		acx_free_hw(hw);
 	}
 
 	result = -ENOMEM;
@@ -1837,11 +2173,13 @@ static void acxusb_disconnect(struct usb_interface *intf)
 	kfree(adev->usb_rx);
 	kfree(adev->usb_tx);
 
+	acxusb_free_cmd(adev);
+
 	acx_sem_unlock(adev);
 
 	acx_free_mechanics(adev);
 
-	ieee80211_free_hw(adev->hw);
+	acx_free_hw(adev->hw);
 
 }
 
@@ -33,6 +33,7 @@ int acxusb_issue_cmd_timeo_debug(acx_device_t * adev, unsigned cmd, void *buffer
 /* Other (Control Path) */
 
 /* Proc, Debug */
+int acxusb_dbgfs_cmd_output(struct seq_file *file, acx_device_t *adev);
 #ifdef UNUSED
 static void dump_device(struct usb_device *usbdev);
 static void dump_config_descriptor(struct usb_config_descriptor *cd);
@@ -88,6 +89,12 @@ static inline int acxusb_issue_cmd_timeo_debug(acx_device_t * adev, unsigned cmd
 	return 0;
 }
 
+static inline int acxusb_dbgfs_cmd_output(struct seq_file *file,
+					acx_device_t *adev)
+{
+	return 0;
+}
+
 static inline tx_t *acxusb_alloc_tx(acx_device_t *adev)
 {
 	return (tx_t*) NULL;